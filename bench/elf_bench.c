@@ -0,0 +1,699 @@
+// SPDX-License-Identifier: MIT
+/*
+ * elf_bench.c - Throughput of the ELF classifiers in bionilux_elf.h
+ *
+ * Runs every classifier bionilux routes launches with over a corpus of
+ * files and reports, per classifier:
+ *
+ *   hot       classifications per second with the corpus in the page
+ *             cache (best of the -n passes)
+ *   cold      one pass with every corpus file evicted from the page
+ *             cache first (dentries and inodes stay cached)
+ *   syscalls  system calls per classification, counted by tracing one
+ *             pass with ptrace(2)
+ *
+ * The classifiers are elf_probe_fd() on a freshly opened descriptor,
+ * elf_classify() without and with the persistent cache (what
+ * analyze_binary() in bionilux.c costs on a miss and on a hit) and
+ * is_glibc_elf() as the preload hooks call it.
+ *
+ * The corpus is every regular file in the given directories (default
+ * /usr/bin) plus synthetic ELFs that stress the probe: hundreds of
+ * program headers, a 3 KiB PT_INTERP, an interpreter 1 MiB into the
+ * file, foreign classes and machines, truncated headers.  Before any
+ * timing, each classifier's answer for each file is checked against
+ * `readelf -hlW`, so an optimisation can never silently change a
+ * routing decision; any disagreement fails the run.
+ *
+ * Usage:
+ *   elf_bench [-n PASSES] [-C] [-S] [-X] [PATH]...
+ *
+ * Normally driven by bench/elf-bench.
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <linux/ptrace.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bionilux_elf.h"
+
+extern char **environ;
+
+#define SYNTH_PHDRS_MANY	512
+#define SYNTH_INTERP_BIG	3000
+#define SYNTH_INTERP_FAR	(1 << 20)
+
+struct corpus {
+	char   **path;
+	size_t   n, cap;
+	size_t   skipped;	/* unreadable */
+};
+
+static volatile unsigned sink;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+/* ── classifiers ─────────────────────────────────────────────────── */
+
+static void run_probe(const char *path, binary_info_t *info)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	memset(info, 0, offsetof(binary_info_t, interp_path) + 1);
+	if (fd < 0) {
+		info->arch = ARCH_ERROR;
+		return;
+	}
+	elf_probe_fd(fd, info);
+	close(fd);
+}
+
+static void run_classify(const char *path, binary_info_t *info)
+{
+	elf_classify(path, info);
+}
+
+/* is_glibc_elf()'s verdict, in info->arch so passes can share a sink */
+static void run_glibc(const char *path, binary_info_t *info)
+{
+	info->arch = (elf_arch_t)(is_glibc_elf(path, NULL) + 1);
+}
+
+static const struct bench_fn {
+	const char *name;
+	int         cached;		/* attach the persistent cache */
+	void      (*run)(const char *path, binary_info_t *info);
+} fns[] = {
+	{ "elf_probe_fd",       0, run_probe },
+	{ "elf_classify",       0, run_classify },
+	{ "elf_classify+cache", 1, run_classify },
+	{ "is_glibc_elf+cache", 1, run_glibc },
+};
+
+#define NFNS	(sizeof(fns) / sizeof(fns[0]))
+
+static struct bl_table_hdr *cache_table;
+
+static void select_fn(const struct bench_fn *fn)
+{
+	elf_cache = fn->cached ? cache_table : NULL;
+}
+
+static void run_pass(const struct bench_fn *fn, const struct corpus *c)
+{
+	binary_info_t info;
+
+	for (size_t i = 0; i < c->n; i++) {
+		fn->run(c->path[i], &info);
+		sink += info.arch;
+	}
+}
+
+/* ── corpus ──────────────────────────────────────────────────────── */
+
+static void corpus_add(struct corpus *c, const char *path)
+{
+	struct stat st;
+
+	if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+		return;
+	if (access(path, R_OK) != 0) {
+		c->skipped++;
+		return;
+	}
+	if (c->n == c->cap) {
+		c->cap = c->cap ? c->cap * 2 : 1024;
+		c->path = realloc(c->path, c->cap * sizeof(*c->path));
+		if (!c->path)
+			die("realloc");
+	}
+	if (!(c->path[c->n++] = strdup(path)))
+		die("strdup");
+}
+
+/* @path itself, or the regular files directly inside it */
+static void corpus_scan(struct corpus *c, const char *path)
+{
+	char sub[PATH_MAX];
+	struct dirent *de;
+	DIR *d = opendir(path);
+
+	if (!d) {
+		if (errno != ENOTDIR)
+			die(path);
+		corpus_add(c, path);
+		return;
+	}
+	while ((de = readdir(d))) {
+		if (de->d_name[0] == '.' ||
+		    snprintf(sub, sizeof(sub), "%s/%s", path, de->d_name) >=
+		    (int)sizeof(sub))
+			continue;
+		corpus_add(c, sub);
+	}
+	closedir(d);
+}
+
+/* ── synthetic ELFs ──────────────────────────────────────────────── */
+
+struct synth {
+	const char *name;
+	uint8_t     cls;		/* 0 → not an ELF at all */
+	uint16_t    machine, type;
+	unsigned    nphdr;		/* PT_INTERP (if any) is the last */
+	int         dynamic;
+	const char *interp;
+	size_t      pad;		/* pad the interpreter to this length */
+	off_t       interp_off;		/* 0 → right after the phdr table */
+	size_t      truncate;		/* keep only this many bytes */
+};
+
+static const struct synth synths[] = {
+	{ "glibc-aarch64", ELFCLASS64, EM_AARCH64, ET_DYN, 4, 1,
+	  "/lib/ld-linux-aarch64.so.1", 0, 0, 0 },
+	{ "glibc-x86_64", ELFCLASS64, EM_X86_64, ET_EXEC, 4, 1,
+	  "/lib64/ld-linux-x86-64.so.2", 0, 0, 0 },
+	{ "bionic", ELFCLASS64, EM_AARCH64, ET_DYN, 4, 1,
+	  "/system/bin/linker64", 0, 0, 0 },
+	{ "musl", ELFCLASS64, EM_AARCH64, ET_DYN, 4, 1,
+	  "/lib/ld-musl-aarch64.so.1", 0, 0, 0 },
+	{ "static-pie", ELFCLASS64, EM_AARCH64, ET_DYN, 4, 1, NULL, 0, 0, 0 },
+	{ "static", ELFCLASS64, EM_AARCH64, ET_EXEC, 2, 0, NULL, 0, 0, 0 },
+	{ "many-phdrs", ELFCLASS64, EM_AARCH64, ET_DYN, SYNTH_PHDRS_MANY, 1,
+	  "/lib/ld-linux-aarch64.so.1", 0, 0, 0 },
+	{ "big-interp", ELFCLASS64, EM_AARCH64, ET_DYN, 4, 1,
+	  "/lib/ld-linux-aarch64.so.1", SYNTH_INTERP_BIG, 0, 0 },
+	{ "far-interp", ELFCLASS64, EM_AARCH64, ET_DYN, 4, 1,
+	  "/lib/ld-linux-aarch64.so.1", 0, SYNTH_INTERP_FAR, 0 },
+	{ "riscv", ELFCLASS64, 243 /* EM_RISCV */, ET_DYN, 4, 1,
+	  "/lib/ld-linux-riscv64-lp64d.so.1", 0, 0, 0 },
+	{ "elf32", ELFCLASS32, EM_ARM, ET_DYN, 0, 0, NULL, 0, 0, 0 },
+	{ "truncated", ELFCLASS64, EM_AARCH64, ET_DYN, 4, 1,
+	  "/lib/ld-linux-aarch64.so.1", 0, 0, 40 },
+	{ "script", 0, 0, 0, 0, 0, NULL, 0, 0, 0 },
+};
+
+static void synth_write(const char *dir, const struct synth *s)
+{
+	char path[PATH_MAX], interp[PATH_MAX] = "";
+	unsigned char *buf;
+	size_t ilen = 0, phend, size;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, s->name);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0755);
+	if (fd < 0)
+		die(path);
+
+	if (!s->cls) {
+		static const char script[] = "#!/bin/sh\nexit 0\n";
+
+		if (write(fd, script, sizeof(script) - 1) < 0)
+			die(path);
+		close(fd);
+		return;
+	}
+
+	if (s->interp) {
+		ilen = strlen(s->interp);
+		if (s->pad > ilen) {
+			/* "/xxx…x" + "/lib/ld-…", NUL included in p_filesz */
+			interp[0] = '/';
+			memset(interp + 1, 'x', s->pad - ilen - 1);
+			ilen = s->pad;
+		}
+		strcpy(interp + strlen(interp), s->interp);
+		ilen++;
+	}
+
+	phend = sizeof(Elf64_Ehdr) + s->nphdr * sizeof(Elf64_Phdr);
+	size = phend + ilen;
+	if (!(buf = calloc(1, size)))
+		die("calloc");
+
+	if (s->cls == ELFCLASS32) {
+		Elf32_Ehdr *eh = (Elf32_Ehdr *)buf;
+
+		memcpy(eh->e_ident, ELFMAG, SELFMAG);
+		eh->e_ident[EI_CLASS]   = ELFCLASS32;
+		eh->e_ident[EI_DATA]    = ELFDATA2LSB;
+		eh->e_ident[EI_VERSION] = EV_CURRENT;
+		eh->e_type    = s->type;
+		eh->e_machine = s->machine;
+		eh->e_version = EV_CURRENT;
+		eh->e_ehsize  = sizeof(*eh);
+		/* keep the 64-byte minimum a real ELF32 always exceeds */
+	} else {
+		Elf64_Ehdr *eh = (Elf64_Ehdr *)buf;
+		Elf64_Phdr *ph = (Elf64_Phdr *)(eh + 1);
+		off_t ioff = s->interp_off ? s->interp_off : (off_t)phend;
+
+		memcpy(eh->e_ident, ELFMAG, SELFMAG);
+		eh->e_ident[EI_CLASS]   = ELFCLASS64;
+		eh->e_ident[EI_DATA]    = ELFDATA2LSB;
+		eh->e_ident[EI_VERSION] = EV_CURRENT;
+		eh->e_type      = s->type;
+		eh->e_machine   = s->machine;
+		eh->e_version   = EV_CURRENT;
+		eh->e_phoff     = s->nphdr ? sizeof(*eh) : 0;
+		eh->e_ehsize    = sizeof(*eh);
+		eh->e_phentsize = sizeof(*ph);
+		eh->e_phnum     = (uint16_t)s->nphdr;
+
+		if (s->nphdr) {
+			ph[0].p_type   = PT_LOAD;
+			ph[0].p_flags  = PF_R | PF_X;
+			ph[0].p_filesz = ph[0].p_memsz = phend;
+			ph[0].p_align  = 4096;
+		}
+		if (s->dynamic && s->nphdr > 1)
+			ph[1].p_type = PT_DYNAMIC;
+		if (ilen) {
+			Elf64_Phdr *ip = &ph[s->nphdr - 1];
+
+			ip->p_type   = PT_INTERP;
+			ip->p_flags  = PF_R;
+			ip->p_offset = (Elf64_Off)ioff;
+			ip->p_filesz = ip->p_memsz = ilen;
+			ip->p_align  = 1;
+		}
+		if (ioff == (off_t)phend) {
+			memcpy(buf + phend, interp, ilen);
+		} else {
+			/* sparse: the string lands far past the table */
+			if (pwrite(fd, interp, ilen, ioff) != (ssize_t)ilen)
+				die(path);
+			size = phend;
+		}
+	}
+
+	if (s->truncate && s->truncate < size)
+		size = s->truncate;
+	if (pwrite(fd, buf, size, 0) != (ssize_t)size)
+		die(path);
+	free(buf);
+	close(fd);
+}
+
+/* ── readelf cross-check ─────────────────────────────────────────── */
+
+/*
+ * What bionilux should conclude about @path, according to
+ * `readelf -hlW`.  Returns -1 if readelf could not be run.
+ */
+static int readelf_info(const char *path, binary_info_t *want)
+{
+	char *argv[] = { "readelf", "-hlW", (char *)path, NULL };
+	posix_spawn_file_actions_t fa;
+	char *line = NULL;
+	size_t cap = 0;
+	int p[2], rc, status, elf64 = 0;
+	pid_t pid;
+	FILE *f;
+
+	memset(want, 0, sizeof(*want));
+	want->arch = ARCH_NOT_ELF;
+
+	if (pipe2(p, O_CLOEXEC) != 0)
+		die("pipe2");
+	posix_spawn_file_actions_init(&fa);
+	posix_spawn_file_actions_adddup2(&fa, p[1], STDOUT_FILENO);
+	posix_spawn_file_actions_addopen(&fa, STDERR_FILENO, "/dev/null",
+					 O_WRONLY, 0);
+	rc = posix_spawnp(&pid, "readelf", &fa, NULL, argv, environ);
+	posix_spawn_file_actions_destroy(&fa);
+	close(p[1]);
+	if (rc != 0) {
+		close(p[0]);
+		return -1;
+	}
+
+	f = fdopen(p[0], "r");
+	if (!f)
+		die("fdopen");
+	while (getline(&line, &cap, f) > 0) {
+		char *s = line + strspn(line, " \t"), *v;
+
+		v = strchr(s, ':');
+		v = v ? v + 1 + strspn(v + 1, " \t") : s;
+
+		if (!strncmp(s, "Class:", 6)) {
+			elf64 = !strncmp(v, "ELF64", 5);
+			want->arch = ARCH_UNKNOWN;
+		} else if (!elf64) {
+			continue;
+		} else if (!strncmp(s, "Type:", 5)) {
+			want->e_type = !strncmp(v, "EXEC", 4) ? ET_EXEC :
+				       !strncmp(v, "DYN", 3)  ? ET_DYN  :
+				       !strncmp(v, "REL", 3)  ? ET_REL  :
+				       !strncmp(v, "CORE", 4) ? ET_CORE : ET_NONE;
+		} else if (!strncmp(s, "Machine:", 8)) {
+			if (!strncmp(v, "AArch64", 7))
+				want->arch = ARCH_AARCH64;
+			else if (strstr(v, "X86-64"))
+				want->arch = ARCH_X86_64;
+		} else if (!strncmp(s, "DYNAMIC ", 8)) {
+			want->flags |= ELF_F_DYNAMIC;
+		} else if (!strncmp(s, "[Requesting program interpreter: ",
+				    33) && !want->interp_path[0]) {
+			size_t n = strcspn(s + 33, "]\n");
+
+			if (n < sizeof(want->interp_path)) {
+				memcpy(want->interp_path, s + 33, n);
+				want->interp_path[n] = '\0';
+				want->interp = elf_interp_type(
+					want->interp_path);
+			}
+		}
+	}
+	free(line);
+	fclose(f);
+	if (waitpid(pid, &status, 0) < 0)
+		die("waitpid");
+	return 0;
+}
+
+static const char *arch_name(elf_arch_t a)
+{
+	static const char *const names[] = {
+		"unknown", "aarch64", "x86_64", "not-elf", "error",
+	};
+
+	return (unsigned)a < 5 ? names[a] : "?";
+}
+
+static void describe(const binary_info_t *i, char *buf, size_t size)
+{
+	snprintf(buf, size, "%s type=%u%s interp=%.*s", arch_name(i->arch),
+		 i->e_type, i->flags & ELF_F_DYNAMIC ? " dynamic" : "",
+		 64, i->interp_path[0] ? i->interp_path : "-");
+}
+
+/* is_glibc_elf()'s contract, restated over readelf's view */
+static int want_glibc(const binary_info_t *w)
+{
+	return w->arch != ARCH_NOT_ELF &&
+	       (w->e_type == ET_EXEC || w->e_type == ET_DYN) &&
+	       w->interp == INTERP_GLIBC;
+}
+
+static int same(const struct bench_fn *fn, const binary_info_t *got,
+		const binary_info_t *want)
+{
+	if (fn->run == run_glibc)
+		return (int)got->arch - 1 == want_glibc(want);
+	return got->arch == want->arch && got->e_type == want->e_type &&
+	       (got->flags & ELF_F_DYNAMIC) == want->flags &&
+	       got->interp == want->interp &&
+	       !strcmp(got->interp_path, want->interp_path);
+}
+
+/*
+ * Check every classifier against readelf on every file.  Runs the
+ * cached classifiers twice so both the miss and the hit are checked.
+ * Returns the number of disagreements, or -1 without readelf.
+ */
+static long cross_check(const struct corpus *c, size_t *routes)
+{
+	long bad = 0;
+
+	for (size_t i = 0; i < c->n; i++) {
+		binary_info_t want, got;
+		char a[160], b[160];
+
+		if (readelf_info(c->path[i], &want) != 0)
+			return -1;
+
+		if (want.arch == ARCH_NOT_ELF)
+			routes[0]++;
+		else if (!want.interp_path[0])
+			routes[1]++;
+		else
+			routes[1 + want.interp]++;
+
+		for (size_t f = 0; f < NFNS; f++) {
+			select_fn(&fns[f]);
+			for (int pass = 0; pass <= fns[f].cached; pass++) {
+				fns[f].run(c->path[i], &got);
+				if (same(&fns[f], &got, &want))
+					continue;
+				describe(&want, a, sizeof(a));
+				if (fns[f].run == run_glibc)
+					snprintf(b, sizeof(b), "%d",
+						 (int)got.arch - 1);
+				else
+					describe(&got, b, sizeof(b));
+				fprintf(stderr, "MISMATCH %s (%s%s)\n"
+					"  readelf: %s\n  got:     %s\n",
+					c->path[i], fns[f].name,
+					pass ? ", hit" : "", a, b);
+				bad++;
+			}
+		}
+	}
+	return bad;
+}
+
+/* ── syscall counting ────────────────────────────────────────────── */
+
+/*
+ * System calls per classification for @fn: a traced child runs one
+ * pass between two getppid() markers and every syscall entry in
+ * between is counted.  Returns -1 if ptrace is unavailable.
+ */
+static double count_syscalls(const struct bench_fn *fn,
+			     const struct corpus *c)
+{
+	long count = 0;
+	int status, markers = 0;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0)
+		die("fork");
+	if (pid == 0) {
+		if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) != 0)
+			_exit(1);
+		raise(SIGSTOP);
+		syscall(SYS_getppid);
+		run_pass(fn, c);
+		syscall(SYS_getppid);
+		_exit(0);
+	}
+
+	if (waitpid(pid, &status, 0) < 0 || !WIFSTOPPED(status))
+		return -1;
+	ptrace(PTRACE_SETOPTIONS, pid, NULL,
+	       (void *)(long)(PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL));
+
+	while (markers < 2) {
+		struct ptrace_syscall_info si;
+
+		if (ptrace(PTRACE_SYSCALL, pid, NULL, NULL) != 0 ||
+		    waitpid(pid, &status, 0) < 0 || !WIFSTOPPED(status))
+			break;
+		if (WSTOPSIG(status) != (SIGTRAP | 0x80))
+			continue;
+		if (ptrace(PTRACE_GET_SYSCALL_INFO, pid,
+			   (void *)sizeof(si), &si) <= 0)
+			break;
+		if (si.op != PTRACE_SYSCALL_INFO_ENTRY)
+			continue;
+		if (si.entry.nr == SYS_getppid)
+			markers++;
+		else if (markers == 1)
+			count++;
+	}
+
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+	return markers == 2 && c->n ? (double)count / (double)c->n : -1;
+}
+
+/* ── main ────────────────────────────────────────────────────────── */
+
+static void evict_all(const struct corpus *c)
+{
+	for (size_t i = 0; i < c->n; i++) {
+		int fd = open(c->path[i], O_RDONLY | O_CLOEXEC);
+
+		if (fd < 0)
+			continue;
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-n PASSES] [-C] [-S] [-X] [PATH]...\n\n"
+		"  -n PASSES  hot passes per classifier (default 20)\n"
+		"  -C         skip the cold pass\n"
+		"  -S         no synthetic ELFs\n"
+		"  -X         skip the readelf cross-check\n"
+		"  PATH       file, or directory whose files to add "
+		"(default /usr/bin)\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	static const char *const route_names[] = {
+		"not ELF", "static", "glibc", "bionic", "musl", "other",
+	};
+	struct corpus c = { 0 };
+	size_t routes[6] = { 0 };
+	char work[] = "/tmp/elf-bench.XXXXXX", cache_file[PATH_MAX];
+	int cold = 1, synth = 1, check = 1, opt;
+	long passes = 20, bad = 0;
+
+	while ((opt = getopt(argc, argv, "n:CSXh")) != -1) {
+		switch (opt) {
+		case 'n': passes = strtol(optarg, NULL, 10); break;
+		case 'C': cold = 0; break;
+		case 'S': synth = 0; break;
+		case 'X': check = 0; break;
+		default:  usage(argv[0]);
+		}
+	}
+	if (passes < 1)
+		usage(argv[0]);
+
+	if (!mkdtemp(work))
+		die("mkdtemp");
+
+	if (optind == argc)
+		corpus_scan(&c, "/usr/bin");
+	for (int i = optind; i < argc; i++)
+		corpus_scan(&c, argv[i]);
+	if (synth) {
+		for (size_t i = 0; i < sizeof(synths) / sizeof(synths[0]); i++) {
+			char path[PATH_MAX];
+
+			synth_write(work, &synths[i]);
+			snprintf(path, sizeof(path), "%s/%s", work,
+				 synths[i].name);
+			corpus_add(&c, path);
+		}
+	}
+	if (!c.n) {
+		fprintf(stderr, "elf_bench: empty corpus\n");
+		return 2;
+	}
+
+	/* a private cache, so hits are ours and not a stale table's */
+	elf_cache_attach(work);
+	cache_table = elf_cache;
+	if (!cache_table)
+		fprintf(stderr, "elf_bench: cannot map the cache in %s\n",
+			work);
+
+	printf("corpus: %zu files", c.n);
+	if (synth)
+		printf(" (%zu synthetic)", sizeof(synths) / sizeof(synths[0]));
+	if (c.skipped)
+		printf(", %zu unreadable skipped", c.skipped);
+	printf("\n");
+
+	/* ── correctness ──────────────────────────────────────────── */
+	if (check) {
+		setenv("LC_ALL", "C", 1);	/* readelf's field names */
+		bad = cross_check(&c, routes);
+		if (bad < 0) {
+			fprintf(stderr, "elf_bench: readelf not found, "
+				"cross-check skipped (-X to silence)\n");
+		} else {
+			printf("routes:");
+			for (int i = 0; i < 6; i++)
+				if (routes[i])
+					printf(" %s %zu", route_names[i],
+					       routes[i]);
+			printf("\nreadelf cross-check: %s (%ld mismatches)\n",
+			       bad ? "FAILED" : "ok", bad);
+		}
+	}
+
+	/* ── timing ───────────────────────────────────────────────── */
+	printf("\n%-20s %12s %12s %10s %10s\n", "classifier", "hot/s",
+	       "cold/s", "ns (hot)", "syscalls");
+
+	for (size_t f = 0; f < NFNS; f++) {
+		const struct bench_fn *fn = &fns[f];
+		uint64_t best = UINT64_MAX, cold_ns = 0, t;
+		double sc;
+
+		if (fn->cached && !cache_table)
+			continue;
+		select_fn(fn);
+		run_pass(fn, &c);	/* warm up, fill the cache */
+
+		for (long p = 0; p < passes; p++) {
+			t = now_ns();
+			run_pass(fn, &c);
+			t = now_ns() - t;
+			if (t < best)
+				best = t;
+		}
+		if (cold) {
+			evict_all(&c);
+			t = now_ns();
+			run_pass(fn, &c);
+			cold_ns = now_ns() - t;
+		}
+		sc = count_syscalls(fn, &c);
+
+		printf("%-20s %12.0f ", fn->name, (double)c.n * 1e9 / best);
+		if (cold)
+			printf("%12.0f ", (double)c.n * 1e9 / cold_ns);
+		else
+			printf("%12s ", "-");
+		printf("%10.0f ", (double)best / c.n);
+		if (sc >= 0)
+			printf("%10.2f\n", sc);
+		else
+			printf("%10s\n", "-");
+	}
+
+	/* ── cleanup ──────────────────────────────────────────────── */
+	for (size_t i = 0; synth && i < sizeof(synths) / sizeof(synths[0]);
+	     i++) {
+		snprintf(cache_file, sizeof(cache_file), "%s/%s", work,
+			 synths[i].name);
+		unlink(cache_file);
+	}
+	snprintf(cache_file, sizeof(cache_file), "%s/" ELF_CACHE_NAME, work);
+	unlink(cache_file);
+	rmdir(work);
+
+	return bad > 0;
+}
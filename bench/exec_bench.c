@@ -0,0 +1,382 @@
+// SPDX-License-Identifier: MIT
+/*
+ * exec_bench.c - What libbionilux_preload.so costs a process that execs
+ *
+ * A glibc program under bionilux (make -j, a shell loop, a build
+ * driver) runs every exec through the preload hooks.  This harness
+ * measures that path against the same program without the preload:
+ *
+ *   exec      for each hooked entry point (execve, execv, execvp,
+ *             execl, execle, execlp via fork(); posix_spawn and
+ *             posix_spawnp directly) and each target, launches per
+ *             second and the p50/p99 latency from fork/spawn until
+ *             the child has been reaped
+ *   readlink  ns per readlink("/proc/self/exe") and
+ *             readlinkat(AT_FDCWD, ...), which the preload rewrites
+ *
+ * Targets are given as LABEL=PATH; the usual set is a dynamic glibc
+ * program (routed through the loader), a static program standing in
+ * for a bionic binary (exec'd directly with a cleaned environment) and
+ * a script (never an ELF).  PATH must contain their directory, since
+ * the *p variants look them up by basename.
+ *
+ * The harness re-runs itself twice, once as the unhooked baseline and
+ * once with LD_PRELOAD=PRELOAD, and prints both side by side.
+ *
+ * Usage:
+ *   exec_bench [-n EXECS] [-c CALLS] -p PRELOAD -t LABEL=PATH...
+ *
+ * Normally driven by bench/exec-bench, which builds the preload, a
+ * stand-in loader and the targets against a scratch prefix.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char **environ;
+
+#define MAX_TARGETS	8
+#define MAX_RESULTS	128
+#define WARMUP		10
+#define ORIG_EXE	"/bench/original-exe"
+
+enum {
+	E_EXECVE, E_EXECV, E_EXECVP, E_EXECL, E_EXECLE, E_EXECLP,
+	E_SPAWN, E_SPAWNP, NENTRIES
+};
+
+static const char *const entry_names[NENTRIES] = {
+	"execve", "execv", "execvp", "execl", "execle", "execlp",
+	"posix_spawn", "posix_spawnp",
+};
+
+struct target {
+	const char *label;
+	const char *path;
+	const char *name;	/* basename, for the *p variants */
+};
+
+static struct target targets[MAX_TARGETS];
+static int ntargets;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* ── one launch ──────────────────────────────────────────────────── */
+
+/* In a fork()ed child: exec @t through entry point @e. */
+static void child_exec(int e, const struct target *t)
+{
+	char *argv[] = { (char *)t->name, NULL };
+
+	switch (e) {
+	case E_EXECVE: execve(t->path, argv, environ); break;
+	case E_EXECV:  execv(t->path, argv); break;
+	case E_EXECVP: execvp(t->name, argv); break;
+	case E_EXECL:  execl(t->path, t->name, (char *)NULL); break;
+	case E_EXECLE: execle(t->path, t->name, (char *)NULL, environ); break;
+	case E_EXECLP: execlp(t->name, t->name, (char *)NULL); break;
+	}
+	_exit(127);
+}
+
+/* Launch @t once through @e and reap it.  Returns the latency in ns. */
+static uint64_t launch(int e, const struct target *t)
+{
+	char *argv[] = { (char *)t->name, NULL };
+	uint64_t t0 = now_ns();
+	int status, rc = 0;
+	pid_t pid;
+
+	if (e == E_SPAWN)
+		rc = posix_spawn(&pid, t->path, NULL, NULL, argv, environ);
+	else if (e == E_SPAWNP)
+		rc = posix_spawnp(&pid, t->name, NULL, NULL, argv, environ);
+	else if ((pid = fork()) == 0)
+		child_exec(e, t);
+	else if (pid < 0)
+		die("fork");
+
+	if (rc != 0) {
+		errno = rc;
+		die(entry_names[e]);
+	}
+	if (waitpid(pid, &status, 0) < 0)
+		die("waitpid");
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "exec_bench: %s %s failed (status 0x%x)\n",
+			entry_names[e], t->path, status);
+		exit(1);
+	}
+	return now_ns() - t0;
+}
+
+/* ── measuring (runs in the baseline and the hooked child) ────────── */
+
+/*
+ * Print one line per measurement:
+ *   exec ENTRY LABEL EXECS_PER_S P50_US P99_US
+ *   call NAME NS_PER_CALL
+ */
+static void measure(long n, long calls)
+{
+	uint64_t *lat = malloc((size_t)n * sizeof(*lat));
+	char buf[PATH_MAX];
+
+	if (!lat)
+		die("malloc");
+
+	for (int ti = 0; ti < ntargets; ti++) {
+		for (int e = 0; e < NENTRIES; e++) {
+			uint64_t total = 0;
+
+			for (int i = 0; i < WARMUP; i++)
+				launch(e, &targets[ti]);
+			for (long i = 0; i < n; i++)
+				total += lat[i] = launch(e, &targets[ti]);
+
+			qsort(lat, (size_t)n, sizeof(*lat), cmp_u64);
+			printf("exec %s %s %.0f %.1f %.1f\n", entry_names[e],
+			       targets[ti].label, (double)n * 1e9 / total,
+			       lat[(n * 50 + 99) / 100 - 1] / 1000.0,
+			       lat[(n * 99 + 99) / 100 - 1] / 1000.0);
+			fflush(stdout);
+		}
+	}
+	free(lat);
+
+	uint64_t t = now_ns();
+
+	for (long i = 0; i < calls; i++)
+		if (readlink("/proc/self/exe", buf, sizeof(buf)) < 0)
+			die("readlink");
+	printf("call readlink %.1f\n", (double)(now_ns() - t) / calls);
+
+	t = now_ns();
+	for (long i = 0; i < calls; i++)
+		if (readlinkat(AT_FDCWD, "/proc/self/exe", buf,
+			       sizeof(buf)) < 0)
+			die("readlinkat");
+	printf("call readlinkat %.1f\n", (double)(now_ns() - t) / calls);
+}
+
+/* The hooked run must really be hooked, or its numbers mean nothing. */
+static void check_hooked(void)
+{
+	char buf[PATH_MAX];
+	ssize_t n = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+
+	if (n < 0 || (size_t)n != strlen(ORIG_EXE) ||
+	    memcmp(buf, ORIG_EXE, (size_t)n) != 0) {
+		fprintf(stderr, "exec_bench: the preload is not active "
+			"in the hooked run\n");
+		exit(1);
+	}
+}
+
+/* ── driving both runs ───────────────────────────────────────────── */
+
+struct run {
+	char *line[MAX_RESULTS];
+	int   n;
+};
+
+/* Re-run ourselves as @mode ("base" or "hook") and collect its lines. */
+static void run_mode(const char *mode, char **argv, struct run *r)
+{
+	char self[PATH_MAX], *line = NULL;
+	size_t cap = 0;
+	posix_spawn_file_actions_t fa;
+	int p[2], rc, status;
+	pid_t pid;
+	FILE *f;
+	ssize_t n;
+
+	n = readlink("/proc/self/exe", self, sizeof(self) - 1);
+	if (n < 0)
+		die("readlink /proc/self/exe");
+	self[n] = '\0';
+
+	argv[1] = (char *)mode;
+	if (pipe2(p, O_CLOEXEC) != 0)
+		die("pipe2");
+	posix_spawn_file_actions_init(&fa);
+	posix_spawn_file_actions_adddup2(&fa, p[1], STDOUT_FILENO);
+	rc = posix_spawn(&pid, self, &fa, NULL, argv, environ);
+	posix_spawn_file_actions_destroy(&fa);
+	close(p[1]);
+	if (rc != 0) {
+		errno = rc;
+		die(self);
+	}
+
+	fprintf(stderr, "%s:", mode);
+	f = fdopen(p[0], "r");
+	if (!f)
+		die("fdopen");
+	while (getline(&line, &cap, f) > 0 && r->n < MAX_RESULTS) {
+		line[strcspn(line, "\n")] = '\0';
+		r->line[r->n++] = strdup(line);
+		fprintf(stderr, ".");
+	}
+	fprintf(stderr, "\n");
+	free(line);
+	fclose(f);
+
+	if (waitpid(pid, &status, 0) < 0)
+		die("waitpid");
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "exec_bench: %s run failed\n", mode);
+		exit(1);
+	}
+}
+
+static void report(const struct run *base, const struct run *hook)
+{
+	printf("\nexecs/s and latency, µs (fork/spawn → child reaped)\n\n");
+	printf("%-13s %-8s %9s %8s %8s %9s %8s %8s %8s\n",
+	       "entry", "target", "base/s", "p50", "p99",
+	       "hook/s", "p50", "p99", "Δp50");
+
+	for (int i = 0; i < base->n && i < hook->n; i++) {
+		char e[32], t[32], e2[32], t2[32];
+		double r1, a1, b1, r2, a2, b2;
+
+		if (sscanf(base->line[i], "exec %31s %31s %lf %lf %lf",
+			   e, t, &r1, &a1, &b1) != 5)
+			continue;
+		if (sscanf(hook->line[i], "exec %31s %31s %lf %lf %lf",
+			   e2, t2, &r2, &a2, &b2) != 5 ||
+		    strcmp(e, e2) || strcmp(t, t2)) {
+			fprintf(stderr, "exec_bench: runs disagree\n");
+			exit(1);
+		}
+		printf("%-13s %-8s %9.0f %8.1f %8.1f %9.0f %8.1f %8.1f "
+		       "%+7.0f%%\n", e, t, r1, a1, b1, r2, a2, b2,
+		       (a2 - a1) * 100.0 / a1);
+	}
+
+	printf("\nns per call\n\n%-13s %9s %9s %9s\n",
+	       "call", "base", "hook", "Δ");
+	for (int i = 0; i < base->n && i < hook->n; i++) {
+		char c[32], c2[32];
+		double a, b;
+
+		if (sscanf(base->line[i], "call %31s %lf", c, &a) != 2 ||
+		    sscanf(hook->line[i], "call %31s %lf", c2, &b) != 2)
+			continue;
+		printf("%-13s %9.1f %9.1f %+9.1f\n", c, a, b, b - a);
+	}
+}
+
+/* ── main ────────────────────────────────────────────────────────── */
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-n EXECS] [-c CALLS] -p PRELOAD "
+		"-t LABEL=PATH...\n\n"
+		"  -n EXECS   launches per entry point and target "
+		"(default 200)\n"
+		"  -c CALLS   readlink calls (default 200000)\n"
+		"  -p FILE    libbionilux_preload.so for the hooked run\n"
+		"  -t L=PATH  target to launch, shown as L\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *mode = NULL, *preload = NULL;
+	long n = 200, calls = 200000;
+	int opt;
+
+	/* argv[1] is the mode when we re-run ourselves */
+	if (argc > 1 && (!strcmp(argv[1], "base") ||
+			 !strcmp(argv[1], "hook")))
+		mode = argv[1];
+
+	optind = mode ? 2 : 1;
+	while ((opt = getopt(argc, argv, "n:c:p:t:h")) != -1) {
+		switch (opt) {
+		case 'n': n = strtol(optarg, NULL, 10); break;
+		case 'c': calls = strtol(optarg, NULL, 10); break;
+		case 'p': preload = optarg; break;
+		case 't': {
+			char *eq = strchr(optarg, '=');
+			struct target *t;
+
+			if (!eq || ntargets == MAX_TARGETS)
+				usage(argv[0]);
+			t = &targets[ntargets++];
+			/* argv is passed on to the re-runs, keep it intact */
+			t->label = strndup(optarg, (size_t)(eq - optarg));
+			t->path = eq + 1;
+			t->name = strrchr(t->path, '/') ?
+				  strrchr(t->path, '/') + 1 : t->path;
+			break;
+		}
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!preload || !ntargets || n < 1 || calls < 1 ||
+	    ntargets * NENTRIES * 2 > MAX_RESULTS)
+		usage(argv[0]);
+
+	if (mode) {
+		if (!strcmp(mode, "hook"))
+			check_hooked();
+		measure(n, calls);
+		return 0;
+	}
+
+	/* ── parent: baseline, then hooked ───────────────────────── */
+	static struct run base, hook;
+	char **args = calloc((size_t)argc + 2, sizeof(*args));
+
+	if (!args)
+		die("calloc");
+	args[0] = argv[0];
+	for (int i = 1; i < argc; i++)
+		args[i + 1] = argv[i];
+
+	unsetenv("LD_PRELOAD");
+	unsetenv("BIONILUX_ORIG_EXE");
+	run_mode("base", args, &base);
+
+	setenv("LD_PRELOAD", preload, 1);
+	setenv("BIONILUX_ORIG_EXE", ORIG_EXE, 1);
+	run_mode("hook", args, &hook);
+
+	report(&base, &hook);
+	return 0;
+}
@@ -0,0 +1,421 @@
+// SPDX-License-Identifier: MIT
+/*
+ * launch_bench.c - Startup latency added by the bionilux launch path
+ *
+ * Spawns `BIONILUX [FLAGS...] TARGET` over and over and measures the
+ * time from posix_spawn() to the target's first user code, together
+ * with the per-stage timings bionilux writes to $BIONILUX_BENCH_FD:
+ *
+ *   cold   fresh cache directory, no wake-lock manager running and
+ *          the files given with -f evicted from the page cache
+ *          before every launch
+ *   warm   steady state, at each concurrency given with -c
+ *
+ * Usage:
+ *   launch_bench [-n WARM] [-C COLD] [-c 1,8,32] [-f FILE]...
+ *                -- BIONILUX [FLAGS...] TARGET
+ *
+ * Normally driven by bench/launch-bench, which builds bionilux, a
+ * stand-in loader and a trivial target against a scratch prefix.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <spawn.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char **environ;
+
+#define BENCH_FD	9	/* $BIONILUX_BENCH_FD in every launch */
+#define MAX_CONC	256
+#define MAX_FILES	16
+#define MAX_SERIES	16
+#define NONE		UINT64_MAX
+
+/* must match WAKE_SOCK_FMT in bionilux.c */
+#define WAKE_SOCK_FMT	"bionilux-wakelock-%u"
+
+enum {
+	ST_STARTUP, ST_FIND, ST_ANALYZE, ST_DEPS, ST_IMPORTS, ST_PRELOAD,
+	ST_READAHEAD, ST_BOX64, ST_ENV, ST_LDCACHE, ST_IOTRACE, ST_WAKE,
+	ST_EXEC, ST_TOTAL, NSTAGES
+};
+
+/* indices match the enum; names match the stages bionilux reports */
+static const char *const stage_names[NSTAGES] = {
+	"startup", "find_in_path", "analyze_binary", "deps", "imports",
+	"extract_preload", "readahead", "box64", "build_environment",
+	"ld_cache", "iotrace", "wake_lock", "exec", "total",
+};
+
+struct sample {
+	uint64_t st[NSTAGES];
+};
+
+struct series {
+	char   name[32];
+	size_t n, cap;
+	struct sample *v;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+/* ── stage records ───────────────────────────────────────────────── */
+
+/*
+ * Turn the "<stage> <begin_ns> <end_ns>" lines of one launch into a
+ * sample.  "main" marks bionilux's entry (startup = main - t0), the
+ * target's "start" ends the launch, and "exec" runs from just before
+ * fork()/execve() to that start.  Returns -1 if the target never
+ * reported.
+ */
+static int parse_records(char *buf, uint64_t t0, struct sample *s)
+{
+	uint64_t start = 0, exec_begin = 0;
+	char *save, *line;
+
+	for (int i = 0; i < NSTAGES; i++)
+		s->st[i] = NONE;
+
+	for (line = strtok_r(buf, "\n", &save); line;
+	     line = strtok_r(NULL, "\n", &save)) {
+		char name[64];
+		unsigned long long b, e;
+
+		if (sscanf(line, "%63s %llu %llu", name, &b, &e) != 3)
+			continue;
+
+		if (!strcmp(name, "start")) {
+			start = b;
+		} else if (!strcmp(name, "main")) {
+			s->st[ST_STARTUP] = b - t0;
+		} else if (!strcmp(name, "exec")) {
+			exec_begin = b;
+		} else {
+			/* a stage can be reported more than once */
+			for (int i = 0; i < NSTAGES; i++)
+				if (!strcmp(name, stage_names[i]))
+					s->st[i] = (s->st[i] == NONE ? 0 :
+						    s->st[i]) + (e - b);
+		}
+	}
+
+	if (!start)
+		return -1;
+	s->st[ST_TOTAL] = start - t0;
+	if (exec_begin)
+		s->st[ST_EXEC] = start - exec_begin;
+	return 0;
+}
+
+static void series_add(struct series *s, const struct sample *smp)
+{
+	if (s->n == s->cap) {
+		s->cap = s->cap ? s->cap * 2 : 64;
+		s->v = realloc(s->v, s->cap * sizeof(*s->v));
+		if (!s->v)
+			die("realloc");
+	}
+	s->v[s->n++] = *smp;
+}
+
+/* ── launching ───────────────────────────────────────────────────── */
+
+/*
+ * Start @conc launches back to back, wait for all of them and add one
+ * sample per launch to @s.  Each launch gets its own pipe on BENCH_FD.
+ */
+static void run_round(char **argv, int conc, struct series *s)
+{
+	pid_t pids[MAX_CONC];
+	int rfds[MAX_CONC];
+	uint64_t t0[MAX_CONC];
+
+	for (int i = 0; i < conc; i++) {
+		posix_spawn_file_actions_t fa;
+		int p[2], rc;
+
+		if (pipe2(p, O_CLOEXEC) != 0)
+			die("pipe2");
+
+		posix_spawn_file_actions_init(&fa);
+		posix_spawn_file_actions_adddup2(&fa, p[1], BENCH_FD);
+
+		t0[i] = now_ns();
+		rc = posix_spawn(&pids[i], argv[0], &fa, NULL, argv, environ);
+		posix_spawn_file_actions_destroy(&fa);
+		close(p[1]);
+		if (rc != 0) {
+			errno = rc;
+			die(argv[0]);
+		}
+		rfds[i] = p[0];
+	}
+
+	for (int i = 0; i < conc; i++) {
+		char buf[4096];
+		size_t len = 0;
+		ssize_t n;
+		int status;
+		struct sample smp;
+
+		if (waitpid(pids[i], &status, 0) < 0)
+			die("waitpid");
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			fprintf(stderr, "launch_bench: launch failed "
+				"(status 0x%x)\n", status);
+			exit(1);
+		}
+
+		/*
+		 * Everyone that writes here has exited or exec'd by now,
+		 * but a wake-lock manager forked by this launch may keep
+		 * the pipe open — read what is there, do not wait for EOF.
+		 */
+		fcntl(rfds[i], F_SETFL, O_NONBLOCK);
+		while (len < sizeof(buf) - 1 &&
+		       (n = read(rfds[i], buf + len,
+				 sizeof(buf) - 1 - len)) > 0)
+			len += (size_t)n;
+		buf[len] = '\0';
+		close(rfds[i]);
+
+		if (parse_records(buf, t0[i], &smp) != 0) {
+			fprintf(stderr, "launch_bench: target did not "
+				"report its start\n");
+			exit(1);
+		}
+		series_add(s, &smp);
+	}
+}
+
+/* ── cold-start preparation ──────────────────────────────────────── */
+
+static void evict_file(const char *path)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+		return;
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+/* Wait (up to 10 s) until no wake-lock manager is listening. */
+static void wait_wake_idle(void)
+{
+	struct sockaddr_un sun = { .sun_family = AF_UNIX };
+	socklen_t len;
+	int n;
+
+	n = snprintf(sun.sun_path + 1, sizeof(sun.sun_path) - 1,
+		     WAKE_SOCK_FMT, (unsigned)getuid());
+	len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 +
+			  (size_t)n);
+
+	for (int i = 0; i < 200; i++) {
+		int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		int up;
+
+		if (fd < 0)
+			return;
+		up = connect(fd, (struct sockaddr *)&sun, len) == 0;
+		close(fd);
+		if (!up)
+			return;
+		usleep(50000);
+	}
+	fprintf(stderr, "launch_bench: wake-lock manager did not exit\n");
+}
+
+/* ── reporting ───────────────────────────────────────────────────── */
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * Nearest-rank p50 and p99 of stage @st in @s, in microseconds.
+ * Returns 0 if no launch reported the stage.
+ */
+static int percentiles(const struct series *s, int st,
+		       double *p50, double *p99)
+{
+	uint64_t *v = malloc(s->n * sizeof(*v));
+	size_t n = 0;
+
+	if (!v)
+		die("malloc");
+	for (size_t i = 0; i < s->n; i++)
+		if (s->v[i].st[st] != NONE)
+			v[n++] = s->v[i].st[st];
+
+	if (n) {
+		qsort(v, n, sizeof(*v), cmp_u64);
+		*p50 = (double)v[(n * 50 + 99) / 100 - 1] / 1000.0;
+		*p99 = (double)v[(n * 99 + 99) / 100 - 1] / 1000.0;
+	}
+	free(v);
+	return n != 0;
+}
+
+static void report(const struct series *all, int nseries)
+{
+	double p50, p99;
+
+	printf("\nlaunch latency, µs (spawn → target's first user code)\n\n");
+	printf("%-10s %6s %10s %10s\n", "run", "runs", "p50", "p99");
+	for (int i = 0; i < nseries; i++) {
+		percentiles(&all[i], ST_TOTAL, &p50, &p99);
+		printf("%-10s %6zu %10.1f %10.1f\n",
+		       all[i].name, all[i].n, p50, p99);
+	}
+
+	printf("\nper stage, µs (p50 / p99)\n\n%-18s", "stage");
+	for (int i = 0; i < nseries; i++)
+		printf(" %19s", all[i].name);
+	printf("\n");
+
+	for (int st = 0; st < NSTAGES; st++) {
+		printf("%-18s", stage_names[st]);
+		for (int i = 0; i < nseries; i++) {
+			if (percentiles(&all[i], st, &p50, &p99))
+				printf(" %9.1f/%-9.1f", p50, p99);
+			else
+				printf(" %19s", "-");
+		}
+		printf("\n");
+	}
+}
+
+/* ── main ────────────────────────────────────────────────────────── */
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-n WARM] [-C COLD] [-c 1,8,32] [-f FILE]...\n"
+		"          -- BIONILUX [FLAGS...] TARGET\n\n"
+		"  -n WARM    warm launches per concurrency (default 200)\n"
+		"  -C COLD    cold launches (default 10, 0 to skip)\n"
+		"  -c LIST    comma-separated concurrencies (default 1,8,32)\n"
+		"  -f FILE    evict FILE from the page cache before cold runs\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	static struct series all[MAX_SERIES];
+	const char *files[MAX_FILES];
+	char conc_list[128] = "1,8,32";
+	char cache_base[PATH_MAX], cache_dir[PATH_MAX + 32];
+	const char *env;
+	int nfiles = 0, nseries = 0;
+	long warm = 200, cold = 10;
+	int opt, fd;
+
+	while ((opt = getopt(argc, argv, "+n:C:c:f:h")) != -1) {
+		switch (opt) {
+		case 'n': warm = strtol(optarg, NULL, 10); break;
+		case 'C': cold = strtol(optarg, NULL, 10); break;
+		case 'c': snprintf(conc_list, sizeof(conc_list), "%s", optarg);
+			  break;
+		case 'f':
+			if (nfiles == MAX_FILES)
+				usage(argv[0]);
+			files[nfiles++] = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind >= argc || warm < 1 || cold < 0)
+		usage(argv[0]);
+	argv += optind;
+
+	/* keep BENCH_FD reserved so no pipe end ever lands on it */
+	fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	if (fd < 0 || (fd != BENCH_FD && dup3(fd, BENCH_FD, O_CLOEXEC) < 0))
+		die("reserve bench fd");
+	if (fd != BENCH_FD)
+		close(fd);
+
+	setenv("BIONILUX_BENCH_FD", "9", 1);
+
+	env = getenv("BIONILUX_CACHE_DIR");
+	snprintf(cache_base, sizeof(cache_base), "%s",
+		 env && *env ? env : "/tmp/bionilux-bench-cache");
+	mkdir(cache_base, 0700);
+
+	/* ── cold ─────────────────────────────────────────────────── */
+	if (cold) {
+		struct series *s = &all[nseries++];
+
+		snprintf(s->name, sizeof(s->name), "cold");
+		for (long i = 0; i < cold; i++) {
+			snprintf(cache_dir, sizeof(cache_dir), "%s/cold-%ld",
+				 cache_base, i);
+			setenv("BIONILUX_CACHE_DIR", cache_dir, 1);
+			for (int f = 0; f < nfiles; f++)
+				evict_file(files[f]);
+			wait_wake_idle();
+			run_round(argv, 1, s);
+		}
+		fprintf(stderr, "cold: %zu launches\n", s->n);
+	}
+
+	/* ── warm ─────────────────────────────────────────────────── */
+	setenv("BIONILUX_CACHE_DIR", cache_base, 1);
+	{
+		struct series scratch = { .n = 0 };
+
+		for (int i = 0; i < 5; i++)	/* fill caches, start daemon */
+			run_round(argv, 1, &scratch);
+		free(scratch.v);
+	}
+
+	for (char *save, *tok = strtok_r(conc_list, ",", &save); tok;
+	     tok = strtok_r(NULL, ",", &save)) {
+		int conc = atoi(tok);
+		struct series *s;
+
+		if (conc < 1 || conc > MAX_CONC || nseries == MAX_SERIES)
+			usage(argv[0]);
+
+		s = &all[nseries++];
+		snprintf(s->name, sizeof(s->name), "warm x%d", conc);
+		for (long done = 0; done < warm; done += conc)
+			run_round(argv, conc, s);
+		fprintf(stderr, "%s: %zu launches\n", s->name, s->n);
+	}
+
+	report(all, nseries);
+	return 0;
+}
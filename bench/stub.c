@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: MIT
+/*
+ * stub.c - Stand-in for the glibc loader and box64 in benchmarks
+ *
+ * Installed as both $GLIBC_PREFIX/lib/ld-linux-aarch64.so.1 and
+ * $PREFIX/bin/box64 in a scratch prefix.  Skips the options bionilux
+ * passes to the loader and execs the program that follows, so a
+ * benchmark measures bionilux rather than dynamic linking or
+ * emulation.  Built static where possible, so it costs one exec.
+ *
+ *   ld.so --library-path DIR --argv0 NAME PROG [ARGS...] → exec PROG
+ *   box64 PROG [ARGS...]                                 → exec PROG
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+int main(int argc, char *argv[])
+{
+	int i = 1;
+
+	while (i < argc && strncmp(argv[i], "--", 2) == 0) {
+		if (!strcmp(argv[i], "--library-path") ||
+		    !strcmp(argv[i], "--argv0") ||
+		    !strcmp(argv[i], "--preload"))
+			i += 2;
+		else
+			i++;
+	}
+
+	if (i >= argc) {
+		fprintf(stderr, "stub: no program given\n");
+		return 127;
+	}
+
+	execv(argv[i], &argv[i]);
+	perror(argv[i]);
+	return 127;
+}
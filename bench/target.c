@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: MIT
+/*
+ * target.c - Trivial launch target for bench/launch_bench
+ *
+ * Reports the moment its first user code runs as a "start" stage line
+ * on $BIONILUX_BENCH_FD, the same descriptor bionilux writes its own
+ * stage timings to, then exits.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+__attribute__((constructor))
+static void report_start(void)
+{
+	const char *fd = getenv("BIONILUX_BENCH_FD");
+	struct timespec ts;
+	char line[64];
+	int n;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	if (!fd)
+		return;
+
+	n = snprintf(line, sizeof(line), "start %llu 0\n",
+		     (unsigned long long)ts.tv_sec * 1000000000ULL +
+		     (unsigned long long)ts.tv_nsec);
+	if (write(atoi(fd), line, (size_t)n) < 0) { /* nobody listening */ }
+}
+
+int main(void)
+{
+	return 0;
+}
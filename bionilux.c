@@ -12,21 +12,40 @@
  */
 
 #define _GNU_SOURCE
+#include <dirent.h>
 #include <errno.h>
 #include <elf.h>
 #include <fcntl.h>
+#include <fnmatch.h>
 #include <libgen.h>
 #include <limits.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "bionilux_elf.h"
+#include "bionilux_events.h"
+#include "bionilux_ldcache.h"
+#include "bionilux_path.h"
+#include "bionilux_trace.h"
 
 /* ── version ─────────────────────────────────────────────────────── */
 
@@ -42,7 +61,16 @@
 
 /* ── paths ───────────────────────────────────────────────────────── */
 
+/*
+ * The glibc prefix can likewise be overridden at compile time via
+ * -DBIONILUX_GLIBC_PREFIX_OVERRIDE="\"/path\"", which lets the
+ * benchmarks in bench/ run the launch path against a scratch prefix.
+ */
+#ifdef BIONILUX_GLIBC_PREFIX_OVERRIDE
+#define GLIBC_PREFIX  BIONILUX_GLIBC_PREFIX_OVERRIDE
+#else
 #define GLIBC_PREFIX  "/data/data/com.termux/files/usr/glibc"
+#endif
 #define GLIBC_LIB     GLIBC_PREFIX "/lib"
 #define GLIBC_LOADER  GLIBC_LIB "/ld-linux-aarch64.so.1"
 
@@ -80,6 +108,17 @@
 	do { fprintf(stderr, C_GREEN  "bionilux: " C_RESET __VA_ARGS__); \
 	     fputc('\n', stderr); } while (0)
 
+/* older bionic headers predate pidfd_open(2) and memfd sealing */
+#ifndef __NR_pidfd_open
+#define __NR_pidfd_open 434
+#endif
+#ifndef __NR_pidfd_send_signal
+#define __NR_pidfd_send_signal 424
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+
 /* ── embedded preload library ────────────────────────────────────── */
 
 #ifdef EMBED_PRELOAD
@@ -89,118 +128,135 @@ static const unsigned char preload_so_data[] __attribute__((unused)) = {0};
 static const unsigned int  preload_so_size   __attribute__((unused)) = 0;
 #endif
 
-/* ── architecture / interpreter enums ────────────────────────────── */
-
-typedef enum {
-	ARCH_UNKNOWN = 0,
-	ARCH_AARCH64,
-	ARCH_X86_64,
-	ARCH_NOT_ELF,
-	ARCH_ERROR,
-} elf_arch_t;
-
-typedef enum {
-	INTERP_NONE = 0,
-	INTERP_GLIBC,
-	INTERP_BIONIC,
-	INTERP_MUSL,
-	INTERP_OTHER,
-} interp_type_t;
+/* ── launch options ──────────────────────────────────────────────── */
 
 typedef struct {
-	elf_arch_t    arch;
-	interp_type_t interp;
-	char          interp_path[PATH_MAX];
-} binary_info_t;
-
-/* ── ELF analysis ────────────────────────────────────────────────── */
+	int debug;
+	int use_preload;	/* 0 with -n */
+	int preload_memfd;	/* -m: serve the preload from a sealed memfd */
+	int exec_in_place;	/* -x: execve() directly, no resident parent */
+	int wake_lock;		/* 0 with -W */
+	int stats;		/* --stats[=json]: STATS_TEXT or STATS_JSON */
+	const char *stats_file;	/* --stats-file, else stderr */
+	const char *record_execs; /* --record-execs FILE */
+	const char *profile;	/* --profile FILE: folded stacks */
+	const char *cpus;	/* --cpus: big, little, all or a list */
+	int threads_hint;	/* --threads-hint */
+	const char *box64_profile; /* --box64-profile: tuning profile for x86_64 */
+	unsigned record_io;	/* --record-io[=SECS]: seconds to trace, 0 off */
+} launch_opts_t;
+
+enum { STATS_OFF, STATS_TEXT, STATS_JSON };
+
+/* ── stage timing ────────────────────────────────────────────────── */
 
 /*
- * Read the ELF header and PT_INTERP from @path using pread() so that
- * we never miss program headers that sit beyond a small initial read.
+ * Launch stages are timed for two consumers:
+ *
+ *   $BIONILUX_BENCH_FD  an open descriptor that receives one
+ *                       "<stage> <begin_ns> <end_ns>" line per stage
+ *                       (CLOCK_MONOTONIC); bench/launch_bench collects
+ *                       them into a per-stage breakdown.  Lines are
+ *                       far below PIPE_BUF, so concurrent launches
+ *                       sharing a pipe never interleave.
+ *   $BIONILUX_TRACE     a Chrome trace-event file shared with the
+ *                       preload library, see bionilux_trace.h.
+ *
+ * With neither set each stage costs a branch.
  */
-static binary_info_t analyze_binary(const char *path)
-{
-	binary_info_t info = { .arch = ARCH_ERROR };
-	Elf64_Ehdr ehdr;
-	int fd;
+#define BENCH_FD_ENV	"BIONILUX_BENCH_FD"
 
-	fd = open(path, O_RDONLY | O_CLOEXEC);
-	if (fd < 0)
-		return info;
+static int g_bench_fd = -1;
 
-	/* ── read ELF header ──────────────────────────────────────── */
-	if (elf_pread(fd, &ehdr, sizeof(ehdr), 0) != (ssize_t)sizeof(ehdr)) {
-		info.arch = ARCH_NOT_ELF;
-		goto out;
-	}
+static void bench_record(const char *stage, uint64_t begin, uint64_t end)
+{
+	char line[128];
+	int n;
 
-	if (memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0) {
-		info.arch = ARCH_NOT_ELF;
-		goto out;
-	}
+	n = snprintf(line, sizeof(line), "%s %llu %llu\n", stage,
+		     (unsigned long long)begin, (unsigned long long)end);
+	if (n > 0 && n < (int)sizeof(line))
+		if (write(g_bench_fd, line, (size_t)n) < 0) { /* best-effort */ }
+}
 
-	if (ehdr.e_ident[EI_CLASS] != ELFCLASS64) {
-		info.arch = ARCH_UNKNOWN;
-		goto out;
+static void stage_init(void)
+{
+	const char *s = getenv(BENCH_FD_ENV);
+	char *end;
+	long fd;
+
+	if (s && *s) {
+		fd = strtol(s, &end, 10);
+		if (*end == '\0' && fd >= 0 && fd <= INT_MAX &&
+		    fcntl((int)fd, F_GETFD) >= 0) {
+			uint64_t t = bl_now_ns();
+
+			g_bench_fd = (int)fd;
+			bench_record("main", t, t);
+		}
 	}
 
-	switch (ehdr.e_machine) {
-	case EM_AARCH64: info.arch = ARCH_AARCH64; break;
-	case EM_X86_64:  info.arch = ARCH_X86_64;  break;
-	default:         info.arch = ARCH_UNKNOWN;  goto out;
-	}
+	s = getenv(BL_TRACE_ENV);
+	if (s && *s) {
+		char abs[PATH_MAX], cwd[PATH_MAX];
 
-	/* ── walk program headers ─────────────────────────────────── */
-	if (ehdr.e_phoff == 0 || ehdr.e_phnum == 0) {
-		info.interp = INTERP_NONE;
-		goto out;
+		/* children chdir — hand them an absolute path */
+		if (s[0] != '/' && getcwd(cwd, sizeof(cwd)) &&
+		    snprintf(abs, sizeof(abs), "%s/%s", cwd, s) <
+		    (int)sizeof(abs)) {
+			setenv(BL_TRACE_ENV, abs, 1);
+			s = getenv(BL_TRACE_ENV);
+		}
+		if (bl_trace_open(s) >= 0)
+			bl_trace_process_start("bionilux");
 	}
+}
 
-	for (unsigned i = 0; i < ehdr.e_phnum; i++) {
-		Elf64_Phdr phdr;
-		off_t off = (off_t)(ehdr.e_phoff + (Elf64_Off)i * ehdr.e_phentsize);
-
-		if (elf_pread(fd, &phdr, sizeof(phdr), off) !=
-		    (ssize_t)sizeof(phdr))
-			break;
-
-		if (phdr.p_type != PT_INTERP)
-			continue;
+static uint64_t stage_begin(void)
+{
+	return (g_bench_fd >= 0 || bl_tracing()) ? bl_now_ns() : 0;
+}
 
-		if (phdr.p_filesz == 0 || phdr.p_filesz >= sizeof(info.interp_path))
-			break;
+static void stage_trace(const char *stage, uint64_t begin,
+			struct bl_trace_args *args)
+{
+	if (g_bench_fd >= 0)
+		bench_record(stage, begin, bl_now_ns());
+	bl_trace_slice(stage, begin, args);
+}
 
-		if (elf_pread(fd, info.interp_path, phdr.p_filesz,
-			      (off_t)phdr.p_offset) != (ssize_t)phdr.p_filesz)
-			break;
+static void stage_end(const char *stage, uint64_t begin)
+{
+	stage_trace(stage, begin, NULL);
+}
 
-		info.interp_path[phdr.p_filesz] = '\0';
+/* ── ELF analysis ────────────────────────────────────────────────── */
 
-		if (strstr(info.interp_path, "ld-linux"))
-			info.interp = INTERP_GLIBC;
-		else if (strstr(info.interp_path, "linker64") ||
-			 strstr(info.interp_path, "linker"))
-			info.interp = INTERP_BIONIC;
-		else if (strstr(info.interp_path, "ld-musl"))
-			info.interp = INTERP_MUSL;
-		else
-			info.interp = INTERP_OTHER;
-		break;
-	}
+/*
+ * Classify @path via the shared helpers in bionilux_elf.h.  Results
+ * come from the persistent cache when the binary is unchanged.
+ */
+static binary_info_t analyze_binary(const char *path)
+{
+	binary_info_t info;
 
-out:
-	close(fd);
+	elf_classify(path, &info);
 	return info;
 }
 
 /* ── path resolution ─────────────────────────────────────────────── */
 
+static const char *get_cache_dir(void);
+
 /*
  * Resolve @name to an executable path.
  *   - contains '/' → treat as relative/absolute path directly
  *   - bare name    → search $PATH, then fall back to CWD
  *
+ * PATH searches go through the shared command index
+ * (bionilux_path.h), so a repeated name costs one access() to confirm
+ * the indexed path instead of one per PATH directory.
+ *
  * Returns @resolved on success, NULL on failure.
  */
 static char *find_in_path(const char *name, char *resolved, size_t size)
@@ -218,21 +274,29 @@ static char *find_in_path(const char *name, char *resolved, size_t size)
 	}
 
 	/* bare name → search PATH first */
-	const char *path_env = getenv("PATH");
-	if (path_env) {
-		char *dup = strdup(path_env);
-		if (dup) {
-			char *saveptr;
-			for (char *dir = strtok_r(dup, ":", &saveptr);
-			     dir;
-			     dir = strtok_r(NULL, ":", &saveptr)) {
-				snprintf(resolved, size, "%s/%s", dir, name);
-				if (access(resolved, X_OK) == 0) {
-					free(dup);
-					return resolved;
-				}
+	const char *dir = getenv("PATH");
+	if (dir) {
+		struct cmd_query q;
+		char hit[PATH_MAX];
+
+		cmd_index_attach(get_cache_dir());
+		if (cmd_index_lookup(dir, name, hit, &q) &&
+		    access(hit, X_OK) == 0) {
+			snprintf(resolved, size, "%s", hit);
+			return resolved;
+		}
+
+		while (dir && *dir) {
+			const char *end = strchrnul(dir, ':');
+			int len = (int)(end - dir);
+
+			if (len && snprintf(resolved, size, "%.*s/%s", len,
+					    dir, name) < (int)size &&
+			    access(resolved, X_OK) == 0) {
+				cmd_index_store(&q, resolved);
+				return resolved;
 			}
-			free(dup);
+			dir = *end ? end + 1 : NULL;
 		}
 	}
 
@@ -255,6 +319,55 @@ static const char *get_prefix(void)
 	return p ? p : "/data/data/com.termux/files/usr";
 }
 
+/*
+ * mkdir -p for @path (which is modified in place and restored).
+ * Returns 0 if the directory exists afterwards.
+ */
+static int mkdir_p(char *path, mode_t mode)
+{
+	for (char *p = path + 1; *p; p++) {
+		if (*p != '/')
+			continue;
+		*p = '\0';
+		if (mkdir(path, mode) != 0 && errno != EEXIST) {
+			*p = '/';
+			return -1;
+		}
+		*p = '/';
+	}
+	return (mkdir(path, mode) == 0 || errno == EEXIST) ? 0 : -1;
+}
+
+/*
+ * Directory for the persistent tables shared with the preload library
+ * (see bionilux_cache.h).  $BIONILUX_CACHE_DIR wins, otherwise
+ * $PREFIX/var/cache/bionilux.  Returns NULL if it cannot be created,
+ * which simply disables caching.
+ */
+static const char *get_cache_dir(void)
+{
+	static char dir[PATH_MAX];
+	static int state; /* 0 = unresolved, 1 = ok, -1 = unavailable */
+	const char *env;
+
+	if (state)
+		return state > 0 ? dir : NULL;
+
+	env = getenv(BL_CACHE_DIR_ENV);
+	if (env && *env)
+		snprintf(dir, sizeof(dir), "%s", env);
+	else
+		snprintf(dir, sizeof(dir), "%s/var/cache/bionilux",
+			 get_prefix());
+
+	/* one mkdir() in the common case, the full walk only on ENOENT */
+	if (mkdir(dir, 0700) == 0 || errno == EEXIST)
+		state = 1;
+	else
+		state = mkdir_p(dir, 0700) == 0 ? 1 : -1;
+	return state > 0 ? dir : NULL;
+}
+
 static char *find_box64(char *resolved, size_t size)
 {
 	char tmp[PATH_MAX];
@@ -324,381 +437,5926 @@ static void ensure_box64_wrapper(const char *real_box64)
 
 /* ── preload library extraction ──────────────────────────────────── */
 
-static char *extract_preload(char *buf, size_t bufsz)
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
+
+static int read_all(int fd, void *buf, size_t len)
+{
+	unsigned char *p = buf;
+
+	while (len > 0) {
+		ssize_t n = read(fd, p, len);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
+
+#ifdef EMBED_PRELOAD
+/*
+ * The embedded preload is extracted under a name derived from its
+ * content, libbionilux_preload-<hash>.so, so a file of that name with
+ * the right size *is* this build: the common case costs one stat().
+ * A new build is written to a private temporary file and rename()d
+ * into place — a process that is mapping the library concurrently
+ * sees either no file or a complete one, never a truncated rewrite.
+ *
+ * With -m (BIONILUX_PRELOAD_MEMFD=1) nothing is written to storage at
+ * all: the library is copied into a sealed memfd that the loader and
+ * every descendant reach as /proc/self/fd/N.
+ */
+#define PRELOAD_MEMFD_MIN_FD	200	/* keep clear of fds programs reuse */
+
+static const char *preload_hash(void)
+{
+#ifdef PRELOAD_SO_HASH
+	return PRELOAD_SO_HASH;		/* generated by ./build */
+#else
+	static char hex[17];
+
+	if (!hex[0])
+		snprintf(hex, sizeof(hex), "%016llx",
+			 (unsigned long long)bl_hash(BL_HASH_INIT,
+						     preload_so_data,
+						     preload_so_size));
+	return hex;
+#endif
+}
+
+/*
+ * Remove libbionilux_preload-*.so files left by other builds.  Only
+ * --rebuild-cache does this, never a launch: shells and servers started
+ * before an upgrade still name the old file in LD_PRELOAD and hand it
+ * to every child, which would lose the preload if it were gone.
+ */
+static int prune_old_preloads(void)
+{
+	DIR *d = opendir(GLIBC_LIB);
+	struct dirent *de;
+	char keep[64];
+	int n = 0;
+
+	if (!d)
+		return 0;
+	snprintf(keep, sizeof(keep), "libbionilux_preload-%s.so",
+		 preload_hash());
+
+	while ((de = readdir(d)) != NULL) {
+		size_t len = strlen(de->d_name);
+
+		if (strncmp(de->d_name, "libbionilux_preload-", 20) != 0 ||
+		    len < 4 || strcmp(de->d_name + len - 3, ".so") != 0 ||
+		    strcmp(de->d_name, keep) == 0)
+			continue;
+		if (unlinkat(dirfd(d), de->d_name, 0) == 0)
+			n++;
+	}
+	closedir(d);
+	return n;
+}
+
+/*
+ * Copy the preload into a sealed memfd at a high descriptor that
+ * survives execve(), and name it through /proc/self/fd.
+ */
+static char *memfd_preload(char *buf, size_t bufsz)
+{
+#ifdef __NR_memfd_create
+	int fd, hi;
+
+	fd = (int)syscall(__NR_memfd_create, "libbionilux_preload",
+			  MFD_ALLOW_SEALING);
+	if (fd < 0)
+		return NULL;
+
+	if (write_all(fd, preload_so_data, preload_so_size) != 0) {
+		close(fd);
+		return NULL;
+	}
+#ifdef F_ADD_SEALS
+	fcntl(fd, F_ADD_SEALS,
+	      F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+#endif
+
+	hi = fcntl(fd, F_DUPFD, PRELOAD_MEMFD_MIN_FD);
+	close(fd);
+	if (hi < 0)
+		return NULL;
+
+	snprintf(buf, bufsz, "/proc/self/fd/%d", hi);
+	return buf;
+#else
+	(void)buf;
+	(void)bufsz;
+	return NULL;
+#endif
+}
+#endif /* EMBED_PRELOAD */
+
+static char *extract_preload(char *buf, size_t bufsz, int memfd)
 {
 #ifdef EMBED_PRELOAD
+	char name[64], tmp[PATH_MAX];
 	struct stat st;
 	int fd;
-	ssize_t written;
 
 	if (preload_so_size == 0)
 		return NULL;
 
-	snprintf(buf, bufsz, "%s/libbionilux_preload.so", GLIBC_LIB);
+	if (memfd && memfd_preload(buf, bufsz))
+		return buf;
+
+	snprintf(name, sizeof(name), "libbionilux_preload-%s.so",
+		 preload_hash());
+	snprintf(buf, bufsz, "%s/%s", GLIBC_LIB, name);
 
-	/* skip write if size matches (common case) */
+	/* common case: this build is already extracted */
 	if (stat(buf, &st) == 0 && (size_t)st.st_size == preload_so_size)
 		return buf;
 
-	fd = open(buf, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+	snprintf(tmp, sizeof(tmp), "%s/.%s.XXXXXX", GLIBC_LIB, name);
+	fd = mkostemp(tmp, O_CLOEXEC);
 	if (fd < 0)
 		return NULL;
 
-	{
-		const unsigned char *p = preload_so_data;
-		size_t remaining = preload_so_size;
-
-		while (remaining > 0) {
-			written = write(fd, p, remaining);
-			if (written < 0) {
-				if (errno == EINTR)
-					continue;
-				close(fd);
-				unlink(buf);
-				return NULL;
-			}
-			p += written;
-			remaining -= (size_t)written;
-		}
+	if (fchmod(fd, 0755) != 0 ||
+	    write_all(fd, preload_so_data, preload_so_size) != 0) {
+		close(fd);
+		unlink(tmp);
+		return NULL;
 	}
-
-	if (close(fd) != 0) {
-		unlink(buf);
+	if (close(fd) != 0 || rename(tmp, buf) != 0) {
+		unlink(tmp);
 		return NULL;
 	}
-
 	return buf;
 #else
+	(void)memfd;
 	snprintf(buf, bufsz, "%s/libbionilux_preload.so", GLIBC_LIB);
 	return access(buf, R_OK) == 0 ? buf : NULL;
 #endif
 }
 
-/* ── environment construction ────────────────────────────────────── */
+/* ── ld.so.cache ─────────────────────────────────────────────────── */
 
 /*
- * Helper: duplicate string with NULL check.
- * Returns NULL on OOM (caller must cope).
+ * Writer for the cache described in bionilux_ldcache.h.  Every ELF
+ * shared library in GLIBC_LIB and GLIBC_LIB/glibc-hwcaps/<name>/ gets
+ * an entry keyed by its DT_SONAME (or file name, like ldconfig), with
+ * the path under its soname whenever that link exists.
  */
-static inline char *xstrdup(const char *s)
-{
-	char *d = strdup(s);
-	if (!d)
-		msg_warn("strdup failed (out of memory)");
-	return d;
-}
+#define LD_CACHE_MAX_LIBS	4096
+#define LD_CACHE_MAX_HWCAPS	32
+
+struct ld_lib {
+	char    *key;
+	char    *path;
+	int32_t  flags;		/* LD_CACHE_FLAGS_* */
+	int      hwcap;		/* glibc-hwcaps index, -1 for GLIBC_LIB */
+	int      order;		/* scan order, keeps the sort stable */
+};
 
 /*
- * Helper: format into a freshly allocated string.
- * Uses proper asprintf(3) — no truncation, no fixed-size buffer.
+ * Read the DT_SONAME of the 64-bit shared library @path into @soname.
+ * Returns 1 with a soname, 0 for a library without one, -1 if @path is
+ * not a library the loader could use.
  */
-__attribute__((format(printf, 1, 2)))
-static char *xasprintf(const char *fmt, ...)
+static int ld_soname(const char *path, char *soname, size_t size,
+		     int32_t *flags)
 {
-	char *p = NULL;
-	va_list ap;
-	int ret;
+	Elf64_Ehdr eh;
+	Elf64_Phdr ph[64];
+	Elf64_Dyn dyn[512];
+	Elf64_Off dyn_off = 0;
+	uint64_t dyn_size = 0, name = 0, strtab = 0;
+	int have_name = 0, rc = -1;
+	unsigned nph;
+	ssize_t n;
+	int fd;
 
-	va_start(ap, fmt);
-	ret = vasprintf(&p, fmt, ap);
-	va_end(ap);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
 
-	if (ret < 0) {
-		msg_warn("vasprintf failed (out of memory)");
-		return NULL;
+	if (elf_pread(fd, &eh, sizeof(eh), 0) != (ssize_t)sizeof(eh) ||
+	    memcmp(eh.e_ident, ELFMAG, SELFMAG) != 0 ||
+	    eh.e_ident[EI_CLASS] != ELFCLASS64 || eh.e_type != ET_DYN ||
+	    eh.e_phentsize != sizeof(Elf64_Phdr))
+		goto out;
+
+	switch (eh.e_machine) {
+	case EM_AARCH64: *flags = LD_CACHE_FLAGS_AARCH64; break;
+	case EM_X86_64:  *flags = LD_CACHE_FLAGS_X86_64;  break;
+	default:         goto out;
 	}
-	return p;
+
+	nph = eh.e_phnum < ARRAY_SIZE(ph) ? eh.e_phnum : ARRAY_SIZE(ph);
+	if (elf_pread(fd, ph, nph * sizeof(ph[0]), (off_t)eh.e_phoff) !=
+	    (ssize_t)(nph * sizeof(ph[0])))
+		goto out;
+
+	for (unsigned i = 0; i < nph; i++) {
+		if (ph[i].p_type == PT_DYNAMIC) {
+			dyn_off  = ph[i].p_offset;
+			dyn_size = ph[i].p_filesz;
+		}
+	}
+	if (!dyn_size)
+		goto out;
+
+	if (dyn_size > sizeof(dyn))
+		dyn_size = sizeof(dyn);
+	n = elf_pread(fd, dyn, dyn_size, (off_t)dyn_off);
+	if (n <= 0)
+		goto out;
+
+	for (size_t i = 0; i < (size_t)n / sizeof(dyn[0]); i++) {
+		if (dyn[i].d_tag == DT_NULL)
+			break;
+		if (dyn[i].d_tag == DT_SONAME) {
+			name = dyn[i].d_un.d_val;
+			have_name = 1;
+		} else if (dyn[i].d_tag == DT_STRTAB) {
+			strtab = dyn[i].d_un.d_ptr;
+		}
+	}
+
+	rc = 0;
+	if (!have_name || !strtab)
+		goto out;
+
+	/* DT_STRTAB is a virtual address: find the segment holding it */
+	for (unsigned i = 0; i < nph; i++) {
+		if (ph[i].p_type != PT_LOAD || strtab < ph[i].p_vaddr ||
+		    strtab - ph[i].p_vaddr >= ph[i].p_filesz)
+			continue;
+
+		Elf64_Off off = ph[i].p_offset + (strtab - ph[i].p_vaddr) +
+				name;
+
+		n = elf_pread(fd, soname, size - 1, (off_t)off);
+		if (n > 0) {
+			soname[n] = '\0';
+			if (strlen(soname) < (size_t)n && soname[0])
+				rc = 1;
+		}
+		break;
+	}
+out:
+	close(fd);
+	return rc;
 }
 
-static void free_env(char **env)
+/* glibc's _dl_cache_libcmp(): digit runs compare numerically. */
+static int ld_libcmp(const char *p1, const char *p2)
 {
-	if (!env)
-		return;
-	for (int i = 0; env[i]; i++)
-		free(env[i]);
-	free(env);
+	while (*p1) {
+		if (*p1 >= '0' && *p1 <= '9') {
+			if (*p2 < '0' || *p2 > '9')
+				return 1;
+
+			unsigned long v1 = 0, v2 = 0;
+
+			while (*p1 >= '0' && *p1 <= '9')
+				v1 = v1 * 10 + (unsigned long)(*p1++ - '0');
+			while (*p2 >= '0' && *p2 <= '9')
+				v2 = v2 * 10 + (unsigned long)(*p2++ - '0');
+			if (v1 != v2)
+				return v1 < v2 ? -1 : 1;
+		} else if (*p2 >= '0' && *p2 <= '9') {
+			return -1;
+		} else if (*p1 != *p2) {
+			return (unsigned char)*p1 - (unsigned char)*p2;
+		} else {
+			p1++;
+			p2++;
+		}
+	}
+	return -(unsigned char)*p2;
 }
 
 /*
- * Build a new environment array for the child process.
- *
- * @preload_path  – path to libbionilux_preload.so (may be NULL)
- * @for_box64     – true when launching an x86_64 binary via box64
- * @use_preload   – false when user passed -n
- * @orig_binary   – resolved path of the target binary
- * @debug         – enable BIONILUX_DEBUG in child
+ * The loader binary-searches for keys in *descending* libcmp order and
+ * then scans equal keys, so sort as ldconfig does: keys descending,
+ * glibc-hwcaps entries ahead of the plain one.
  */
-static char **build_environment(const char *preload_path, int for_box64,
-				int use_preload, const char *orig_binary,
-				int debug)
+static int ld_lib_cmp(const void *a, const void *b)
 {
-	extern char **environ;
-	size_t envc = 0, j = 0;
-	char **env;
+	const struct ld_lib *x = a, *y = b;
+	int r = ld_libcmp(y->key, x->key);
+
+	if (r)
+		return r;
+	if (x->flags != y->flags)
+		return x->flags < y->flags ? 1 : -1;
+	if ((x->hwcap < 0) != (y->hwcap < 0))
+		return x->hwcap < 0 ? 1 : -1;
+	return x->order - y->order;
+}
 
-	while (environ[envc])
-		envc++;
+/* Add every library in @dir to @libs. */
+static void ld_scan(const char *dir, int hwcap, struct ld_lib *libs,
+		    size_t *nlibs)
+{
+	char path[PATH_MAX], soname[256];
+	struct dirent *de;
+	DIR *d = opendir(dir);
 
-	/* room for existing vars + ≤10 new ones + NULL */
-	env = calloc(envc + 12, sizeof(char *));
-	if (!env)
-		return NULL;
+	if (!d)
+		return;
 
-	/* copy existing, filtering vars we'll override */
-	for (size_t i = 0; i < envc; i++) {
-		if (ENVPREFIX(environ[i], "LD_PRELOAD="))        continue;
-		if (ENVPREFIX(environ[i], "BIONILUX_GLIBC_LIB="))   continue;
-		if (ENVPREFIX(environ[i], "BIONILUX_GLIBC_LOADER=")) continue;
-		if (ENVPREFIX(environ[i], "BIONILUX_ORIG_EXE="))     continue;
-		if (ENVPREFIX(environ[i], "BOX64_LD_PRELOAD="))  continue;
-		if (ENVPREFIX(environ[i], "BOX64_PATH="))        continue;
+	while ((de = readdir(d)) != NULL && *nlibs < LD_CACHE_MAX_LIBS) {
+		const char *fname = de->d_name;
+		struct ld_lib *l = &libs[*nlibs];
+		struct stat st;
+		int dup = 0, rc;
 
-		/*
-		 * Strip glibc-specific LD variables that could
-		 * interfere with bionic or the child process.
-		 */
-		if (ENVPREFIX(environ[i], "LD_AUDIT="))   continue;
-		if (ENVPREFIX(environ[i], "LD_DEBUG="))   continue;
+		if ((strncmp(fname, "lib", 3) != 0 &&
+		     strncmp(fname, "ld-", 3) != 0) || !strstr(fname, ".so"))
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", dir, fname);
+		if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+			continue;
 
-		/* keep user's BOX64_LD_LIBRARY_PATH only in box64 mode */
-		if (!for_box64 &&
-		    ENVPREFIX(environ[i], "BOX64_LD_LIBRARY_PATH="))
+		rc = ld_soname(path, soname, sizeof(soname), &l->flags);
+		if (rc < 0)
 			continue;
+		if (rc == 0)
+			snprintf(soname, sizeof(soname), "%s", fname);
 
-		env[j] = xstrdup(environ[i]);
-		if (!env[j]) { free_env(env); return NULL; }
-		j++;
-	}
+		/* libfoo.so.1.2.3 is listed through its libfoo.so.1 link */
+		if (strcmp(soname, fname) != 0) {
+			char link[PATH_MAX];
 
-	/* BIONILUX env vars for the preload library */
-	env[j] = xasprintf("BIONILUX_GLIBC_LIB=%s", GLIBC_LIB);
-	if (!env[j]) { free_env(env); return NULL; } j++;
+			snprintf(link, sizeof(link), "%s/%s", dir, soname);
+			if (access(link, F_OK) == 0)
+				continue;
+		}
+		for (size_t i = 0; i < *nlibs && !dup; i++)
+			dup = libs[i].hwcap == hwcap &&
+			      libs[i].flags == l->flags &&
+			      strcmp(libs[i].key, soname) == 0;
+		if (dup)
+			continue;
 
-	env[j] = xasprintf("BIONILUX_GLIBC_LOADER=%s", GLIBC_LOADER);
-	if (!env[j]) { free_env(env); return NULL; } j++;
+		l->key   = strdup(soname);
+		l->path  = strdup(path);
+		l->hwcap = hwcap;
+		l->order = (int)*nlibs;
+		if (!l->key || !l->path) {
+			free(l->key);
+			free(l->path);
+			continue;
+		}
+		(*nlibs)++;
+	}
+	closedir(d);
+}
+
+static uint32_t ld_align4(uint32_t v)
+{
+	return (v + 3) & ~3u;
+}
+
+/*
+ * Scan GLIBC_LIB and write the cache atomically (temporary file +
+ * rename).  Returns the number of libraries, or -1 on error.
+ */
+static int ld_cache_rebuild(int debug)
+{
+	static struct ld_lib libs[LD_CACHE_MAX_LIBS];
+	char *hwcaps[LD_CACHE_MAX_HWCAPS];
+	char path[PATH_MAX], tmp[PATH_MAX], dir[PATH_MAX], gen[64];
+	uint32_t str_off, str_len = 0, ext_off, gen_off, hw_off, total;
+	uint32_t nsec, nhw = 0;
+	size_t nlibs = 0;
+	unsigned char *buf = NULL;
+	struct dirent *de;
+	int fd = -1, rc = -1;
+	DIR *d;
+
+	if (ld_cache_path(GLIBC_LIB, path, sizeof(path)) != 0)
+		return -1;
+
+	/* state first: a change during the scan makes the result stale */
+	ld_cache_stamp(ld_cache_state(GLIBC_LIB), gen, sizeof(gen));
+
+	ld_scan(GLIBC_LIB, -1, libs, &nlibs);
+
+	d = snprintf(dir, sizeof(dir), "%s/" LD_CACHE_HWCAPS_DIR,
+		     GLIBC_LIB) < (int)sizeof(dir) ? opendir(dir) : NULL;
+	while (d && (de = readdir(d)) != NULL && nhw < LD_CACHE_MAX_HWCAPS) {
+		char sub[PATH_MAX];
+
+		if (de->d_name[0] == '.' ||
+		    snprintf(sub, sizeof(sub), "%s/%s", dir,
+			     de->d_name) >= (int)sizeof(sub) ||
+		    !(hwcaps[nhw] = strdup(de->d_name)))
+			continue;
+		ld_scan(sub, (int)nhw, libs, &nlibs);
+		nhw++;
+	}
+	if (d)
+		closedir(d);
+
+	qsort(libs, nlibs, sizeof(libs[0]), ld_lib_cmp);
+
+	/* header | entries | strings | extension | generator | hwcaps */
+	str_off = (uint32_t)(sizeof(struct ld_cache_hdr) +
+			     nlibs * sizeof(struct ld_cache_entry));
+	for (size_t i = 0; i < nlibs; i++)
+		str_len += (uint32_t)(strlen(libs[i].key) +
+				      strlen(libs[i].path) + 2);
+	for (uint32_t i = 0; i < nhw; i++)
+		str_len += (uint32_t)strlen(hwcaps[i]) + 1;
+
+	nsec    = nhw ? 2 : 1;
+	ext_off = ld_align4(str_off + str_len);
+	gen_off = ext_off + (uint32_t)(sizeof(struct ld_cache_ext) +
+				       nsec * sizeof(struct ld_cache_section));
+	hw_off  = ld_align4(gen_off + (uint32_t)strlen(gen));
+	total   = hw_off + nhw * (uint32_t)sizeof(uint32_t);
+
+	buf = calloc(1, total);
+	if (!buf)
+		goto out;
+
+	struct ld_cache_hdr *hdr = (struct ld_cache_hdr *)buf;
+	struct ld_cache_entry *ent = (struct ld_cache_entry *)(hdr + 1);
+	struct ld_cache_ext *ext = (struct ld_cache_ext *)(buf + ext_off);
+	struct ld_cache_section *sec = (struct ld_cache_section *)(ext + 1);
+	uint32_t *hw = (uint32_t *)(buf + hw_off);
+	uint32_t hw_str[LD_CACHE_MAX_HWCAPS];
+	uint32_t s = str_off;
+
+	memcpy(hdr->magic, LD_CACHE_MAGIC, sizeof(hdr->magic));
+	hdr->nlibs            = (uint32_t)nlibs;
+	hdr->len_strings      = str_len;
+	hdr->flags            = ld_cache_endian();
+	hdr->extension_offset = ext_off;
+
+	for (uint32_t i = 0; i < nhw; i++) {
+		hw_str[i] = s;
+		s = (uint32_t)(stpcpy((char *)buf + s, hwcaps[i]) -
+			       (char *)buf) + 1;
+		hw[i] = hw_str[i];
+	}
+	for (size_t i = 0; i < nlibs; i++) {
+		ent[i].flags = libs[i].flags;
+		ent[i].key   = s;
+		s = (uint32_t)(stpcpy((char *)buf + s, libs[i].key) -
+			       (char *)buf) + 1;
+		ent[i].value = s;
+		s = (uint32_t)(stpcpy((char *)buf + s, libs[i].path) -
+			       (char *)buf) + 1;
+		if (libs[i].hwcap >= 0)
+			ent[i].hwcap = LD_CACHE_HWCAP_EXT |
+				       (uint64_t)libs[i].hwcap;
+	}
+
+	ext->magic = LD_CACHE_EXT_MAGIC;
+	ext->count = nsec;
+	sec[0] = (struct ld_cache_section){
+		.tag = LD_CACHE_EXT_GENERATOR, .offset = gen_off,
+		.size = (uint32_t)strlen(gen),
+	};
+	memcpy(buf + gen_off, gen, strlen(gen));
+	if (nhw)
+		sec[1] = (struct ld_cache_section){
+			.tag = LD_CACHE_EXT_HWCAPS, .offset = hw_off,
+			.size = nhw * (uint32_t)sizeof(uint32_t),
+		};
+
+	snprintf(dir, sizeof(dir), "%s", path);
+	*strrchr(dir, '/') = '\0';
+	mkdir_p(dir, 0755);
+
+	if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= (int)sizeof(tmp))
+		goto out;
+	fd = mkostemp(tmp, O_CLOEXEC);
+	if (fd < 0)
+		goto out;
+	if (fchmod(fd, 0644) != 0 || write_all(fd, buf, total) != 0)
+		goto out;
+	if (close(fd) != 0 || rename(tmp, path) != 0) {
+		fd = -1;
+		unlink(tmp);
+		goto out;
+	}
+	fd = -1;
+	rc = (int)nlibs;
+
+	if (debug)
+		msg_info("ld.so.cache: %d libraries → %s", rc, path);
+out:
+	if (fd >= 0) {
+		close(fd);
+		unlink(tmp);
+	}
+	free(buf);
+	for (size_t i = 0; i < nlibs; i++) {
+		free(libs[i].key);
+		free(libs[i].path);
+	}
+	for (uint32_t i = 0; i < nhw; i++)
+		free(hwcaps[i]);
+	return rc;
+}
+
+/*
+ * Serialise rebuilds of the cache on "<cache>.lock".  Returns the
+ * locked descriptor, or -1 to go ahead unlocked.
+ */
+static int ld_cache_lock(void)
+{
+	char path[PATH_MAX], dir[PATH_MAX];
+	int fd;
+
+	if (ld_cache_path(GLIBC_LIB, dir, sizeof(dir)) != 0 ||
+	    snprintf(path, sizeof(path), "%s.lock", dir) >= (int)sizeof(path))
+		return -1;
+	*strrchr(dir, '/') = '\0';
+	mkdir_p(dir, 0755);
+
+	fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd >= 0 && flock(fd, LOCK_EX) != 0) {
+		close(fd);
+		fd = -1;
+	}
+	return fd;
+}
+
+/*
+ * May this launch leave --library-path out?  Only when the loader
+ * would otherwise read no LD_LIBRARY_PATH (--library-path overrides
+ * it) and our cache is current — regenerating it first if the library
+ * tree changed.  A cache bionilux did not write is left alone.
+ */
+static int ld_cache_ready(int debug)
+{
+	const char *llp = getenv("LD_LIBRARY_PATH");
+	int fresh;
+
+	if (llp && *llp)
+		return 0;
+
+	fresh = ld_cache_fresh(GLIBC_LIB);
+	if (fresh == 0) {
+		int lfd = ld_cache_lock();
+
+		/* a concurrent launch may have rebuilt it while we waited */
+		fresh = ld_cache_fresh(GLIBC_LIB);
+		if (fresh == 0)
+			fresh = ld_cache_rebuild(debug) >= 0;
+		if (lfd >= 0)
+			close(lfd);
+	}
+	return fresh == 1;
+}
+
+/* ── tuning profiles ─────────────────────────────────────────────── */
+
+/*
+ * glibc's defaults suit servers: up to 8 malloc arenas per core, no
+ * huge pages, trimming at 128 KiB.  A tuning profile is a named set of
+ * glibc tunables, picked for a program by $PREFIX/etc/bionilux/profiles:
+ *
+ *   # profiles extend the built-in presets of the same name
+ *   [throughput]
+ *   match = geekbench6 /opt/bench/bin/gb*
+ *
+ *   [server]
+ *   match = bedrock_server node
+ *   glibc.malloc.arena_max = 2
+ *   glibc.malloc.hugetlb = 1
+ *
+ *   [bedrock]
+ *   BOX64_DYNAREC_STRONGMEM = 1
+ *
+ * "match" takes globs, against the resolved path when they contain a
+ * '/', else against the file name, and "hash:<16 hex digits>" for the
+ * content hash shown by -d.  The first section that matches wins, then
+ * the first built-in preset that does.  $BIONILUX_PROFILE names a
+ * profile directly ("none" for no profile), and --box64-profile names
+ * one for x86_64 programs.
+ *
+ * BOX64_* settings tune box64's dynarec and are exported only when the
+ * program runs under box64, unless the variable is already set.
+ *
+ * The profile's tunables go first in GLIBC_TUNABLES, so the user's own
+ * settings still win.  They are also exported as $BIONILUX_TUNABLES, so
+ * the preload can restore GLIBC_TUNABLES for children exec'd with a
+ * rebuilt environment, and so a nested launch can take them back out:
+ * a profile applies to the program it was chosen for, and a nested
+ * bionilux picks its own.  $BIONILUX_PROFILE is only ever the user's.
+ */
+#define TUNE_FILE		"etc/bionilux/profiles"
+#define TUNE_ENV		"BIONILUX_PROFILE"
+#define TUNE_TUNABLES_ENV	"BIONILUX_TUNABLES"
+#define TUNE_MAX_SETTINGS	32
+
+struct tune {
+	char   name[64];
+	size_t n;
+	struct {
+		char key[64];
+		char val[128];
+	} set[TUNE_MAX_SETTINGS];
+	char   tunables[1024];		/* "key=val:key=val" */
+	char   hash[17];		/* content hash, "" until needed */
+};
+
+static const struct {
+	const char *name;
+	const char *match;	/* NULL: only applied by name */
+	const char *settings;	/* "key=val key=val" */
+} tune_presets[] = {
+	/* one arena, and free memory goes back to the kernel early */
+	{ "low-memory", NULL,
+	  "glibc.malloc.arena_max=1 glibc.malloc.trim_threshold=131072 "
+	  "glibc.malloc.mmap_threshold=131072 glibc.malloc.hugetlb=0" },
+	/* an arena per core, THP-backed heaps, lazy trims, deeper tcache */
+	{ "throughput", NULL,
+	  "glibc.malloc.arena_max=8 glibc.malloc.hugetlb=1 "
+	  "glibc.malloc.trim_threshold=67108864 "
+	  "glibc.malloc.mmap_threshold=33554432 "
+	  "glibc.malloc.tcache_count=64" },
+	/* compiled C++ that never rewrites its code: big blocks, fast calls */
+	{ "bedrock", "bedrock_server",
+	  "BOX64_DYNAREC_BIGBLOCK=3 BOX64_DYNAREC_CALLRET=1 "
+	  "BOX64_DYNAREC_SAFEFLAGS=0 BOX64_DYNAREC_FASTNAN=1 "
+	  "BOX64_DYNAREC_FASTROUND=1" },
+	/* Mono JIT: generated code changes under the dynarec, threads race */
+	{ "unity", "*.x86_64",
+	  "BOX64_DYNAREC_BIGBLOCK=0 BOX64_DYNAREC_STRONGMEM=1 "
+	  "BOX64_DYNAREC_SAFEFLAGS=1 BOX64_DYNAREC_CALLRET=0" },
+	/* slowest, for programs that crash or hang under the defaults */
+	{ "box64-safe", NULL,
+	  "BOX64_DYNAREC_BIGBLOCK=0 BOX64_DYNAREC_STRONGMEM=2 "
+	  "BOX64_DYNAREC_SAFEFLAGS=2 BOX64_DYNAREC_CALLRET=0 "
+	  "BOX64_DYNAREC_FASTNAN=0 BOX64_DYNAREC_FASTROUND=0" },
+};
+
+#define TUNE_NPRESETS	(sizeof(tune_presets) / sizeof(tune_presets[0]))
+
+/*
+ * Name for one version of a file in the per-file caches:
+ * "<dev>-<ino>-<size>-<mtime>".  Rebuilding or touching the file
+ * changes it.
+ */
+static void file_identity(const struct stat *st, char *buf, size_t size)
+{
+	snprintf(buf, size, "%llx-%llx-%llx-%lld.%09ld",
+		 (unsigned long long)st->st_dev,
+		 (unsigned long long)st->st_ino,
+		 (unsigned long long)st->st_size,
+		 (long long)st->st_mtim.tv_sec, st->st_mtim.tv_nsec);
+}
+
+/*
+ * FNV-1a of @path's contents as 16 hex digits into @out, or "" if it
+ * cannot be read.  Hashing reads the whole file, so the result is kept
+ * in the cache directory as a symlink named after the file's identity
+ * (device, inode, size, mtime) that points at the hash: later lookups
+ * cost one readlink().
+ */
+static void content_hash(const char *path, char out[17])
+{
+	static unsigned char buf[65536];
+	const char *cache = get_cache_dir();
+	char link[PATH_MAX] = "";
+	uint64_t h = BL_HASH_INIT;
+	struct stat st;
+	ssize_t n;
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	out[0] = '\0';
+	if (fd < 0)
+		return;
+	if (cache && fstat(fd, &st) == 0) {
+		char id[96];
+
+		file_identity(&st, id, sizeof(id));
+		if (snprintf(link, sizeof(link), "%s/hash/%s", cache,
+			     id) >= (int)sizeof(link))
+			link[0] = '\0';	/* too long to cache */
+		else if (readlink(link, out, 16) == 16) {
+			out[16] = '\0';
+			close(fd);
+			return;
+		}
+	}
+
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		h = bl_hash(h, buf, (size_t)n);
+	close(fd);
+	if (n != 0)
+		return;
+	snprintf(out, 17, "%016llx", (unsigned long long)h);
+
+	if (link[0] && symlink(out, link) != 0 && errno == ENOENT) {
+		char dir[PATH_MAX];
+
+		if (snprintf(dir, sizeof(dir), "%s/hash",
+			     cache) < (int)sizeof(dir) &&
+		    (mkdir(dir, 0700) == 0 || errno == EEXIST))
+			(void)!symlink(out, link);
+	}
+}
+
+/* A key bionilux knows how to apply: glibc.* or BOX64_[A-Z0-9_]* */
+static int tune_key_ok(const char *key)
+{
+	if (!strncmp(key, "glibc.", 6))
+		return 1;
+	if (strncmp(key, "BOX64_", 6) != 0)
+		return 0;
+	return key[6] && !key[6 + strspn(key + 6,
+				"ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_")];
+}
+
+/* Set @key to @val in @t, replacing an earlier value. */
+static void tune_set(struct tune *t, const char *key, const char *val)
+{
+	size_t i;
+
+	for (i = 0; i < t->n; i++)
+		if (strcmp(t->set[i].key, key) == 0)
+			break;
+	if (i == TUNE_MAX_SETTINGS)
+		return;
+	if (i == t->n)
+		t->n++;
+	snprintf(t->set[i].key, sizeof(t->set[i].key), "%s", key);
+	snprintf(t->set[i].val, sizeof(t->set[i].val), "%s", val);
+}
+
+static char *tune_trim(char *s)
+{
+	char *e;
+
+	s += strspn(s, " \t");
+	e = s + strlen(s);
+	while (e > s && strchr(" \t\r\n", e[-1]))
+		e--;
+	*e = '\0';
+	return s;
+}
+
+/* Does any pattern in @pats match @binary? */
+static int tune_match(char *pats, const char *binary, struct tune *t)
+{
+	const char *base = strrchr(binary, '/');
+
+	base = base ? base + 1 : binary;
+	for (char *save = NULL, *pat = strtok_r(pats, " \t", &save); pat;
+	     pat = strtok_r(NULL, " \t", &save)) {
+		if (!strncmp(pat, "hash:", 5)) {
+			if (!t->hash[0])
+				content_hash(binary, t->hash);
+			if (t->hash[0] && !strcasecmp(pat + 5, t->hash))
+				return 1;
+		} else if (fnmatch(pat, strchr(pat, '/') ? binary : base,
+				   0) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Apply the "key=val key=val" @settings of a preset to @t. */
+static void tune_apply_preset(struct tune *t, const char *settings)
+{
+	char buf[512], *save = NULL;
+
+	snprintf(buf, sizeof(buf), "%s", settings);
+	for (char *kv = strtok_r(buf, " ", &save); kv;
+	     kv = strtok_r(NULL, " ", &save)) {
+		char *eq = strchr(kv, '=');
+
+		*eq = '\0';
+		tune_set(t, kv, eq + 1);
+	}
+}
+
+/*
+ * Read the profiles file.  Without @t->name[0], find the first section
+ * matching @binary and name @t after it; otherwise apply every setting
+ * of the sections called @t->name.  Returns 1 if a section was found.
+ */
+static int tune_read(struct tune *t, const char *binary, int debug)
+{
+	char path[PATH_MAX], line[512], section[64] = "";
+	unsigned lineno = 0;
+	int found = 0;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s", get_prefix(), TUNE_FILE);
+	f = fopen(path, "re");
+	if (!f)
+		return 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		char *l = tune_trim(line), *eq;
+
+		lineno++;
+		if (!*l || *l == '#' || *l == ';')
+			continue;
+		if (*l == '[') {
+			char *end = strchr(l, ']');
+
+			if (end)
+				*end = '\0';
+			snprintf(section, sizeof(section), "%s",
+				 tune_trim(l + 1));
+			continue;
+		}
+		if (!(eq = strchr(l, '=')) || !section[0]) {
+			if (debug)
+				msg_warn("%s:%u: ignored", path, lineno);
+			continue;
+		}
+		*eq = '\0';
+		l = tune_trim(l);
+		eq = tune_trim(eq + 1);
+
+		if (!t->name[0]) {
+			if (!strcmp(l, "match") && tune_match(eq, binary, t)) {
+				snprintf(t->name, sizeof(t->name), "%s",
+					 section);
+				found = 1;
+				break;
+			}
+		} else if (!strcmp(section, t->name)) {
+			found = 1;
+			if (tune_key_ok(l))
+				tune_set(t, l, eq);
+			else if (strcmp(l, "match") != 0 && debug)
+				msg_warn("%s:%u: unknown setting %s", path,
+					 lineno, l);
+		}
+	}
+	fclose(f);
+	return found;
+}
+
+/* Name @t after the first built-in preset whose patterns match. */
+static int tune_match_preset(struct tune *t, const char *binary)
+{
+	for (size_t i = 0; i < TUNE_NPRESETS; i++) {
+		char pats[256];
+
+		if (!tune_presets[i].match)
+			continue;
+		snprintf(pats, sizeof(pats), "%s", tune_presets[i].match);
+		if (tune_match(pats, binary, t)) {
+			snprintf(t->name, sizeof(t->name), "%s",
+				 tune_presets[i].name);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Pick the tuning profile for @binary into @t: @forced (--box64-profile)
+ * if set, else $BIONILUX_PROFILE, else the first match.  Returns 1 if
+ * there is one, 0 to launch with the defaults.
+ */
+static int tune_lookup(const char *binary, const char *forced,
+		       struct tune *t, int debug)
+{
+	size_t off = 0;
+	int known = 0;
+
+	memset(t, 0, sizeof(*t));
+	if (debug) {
+		content_hash(binary, t->hash);
+		msg_info("content hash: %s", t->hash[0] ? t->hash : "?");
+	}
+	if (!forced || !*forced)
+		forced = getenv(TUNE_ENV);
+	if (forced && *forced)
+		snprintf(t->name, sizeof(t->name), "%s", forced);
+	else if (!tune_read(t, binary, debug) &&
+		 !tune_match_preset(t, binary))
+		return 0;
+	if (!strcmp(t->name, "none"))
+		return 0;
+
+	for (size_t i = 0; i < TUNE_NPRESETS; i++) {
+		if (strcmp(tune_presets[i].name, t->name) != 0)
+			continue;
+		tune_apply_preset(t, tune_presets[i].settings);
+		known = 1;
+	}
+	known |= tune_read(t, binary, debug);
+	if (!known) {
+		msg_warn("unknown profile: %s", t->name);
+		return 0;
+	}
+
+	for (size_t i = 0; i < t->n; i++) {
+		int n;
+
+		if (strncmp(t->set[i].key, "glibc.", 6) != 0)
+			continue;
+		n = snprintf(t->tunables + off, sizeof(t->tunables) - off,
+			     "%s%s=%s", off ? ":" : "", t->set[i].key,
+			     t->set[i].val);
+		if (n < 0 || (size_t)n >= sizeof(t->tunables) - off)
+			break;
+		off += (size_t)n;
+	}
+	if (debug) {
+		msg_info("profile %s: %s", t->name,
+			 t->tunables[0] ? t->tunables : "(no tunables)");
+		for (size_t i = 0; i < t->n; i++)
+			if (strncmp(t->set[i].key, "glibc.", 6) != 0)
+				msg_info("profile %s: %s=%s", t->name,
+					 t->set[i].key, t->set[i].val);
+	}
+	return 1;
+}
+
+/* ── box64 code cache ────────────────────────────────────────────── */
+
+/*
+ * box64 can keep the code its dynarec translates on disk
+ * (BOX64_DYNACACHE) and reuse it on the next run.  bionilux gives every
+ * x86_64 program its own folder for that, named after the program's
+ * content hash and that of the box64 build, so an updated program or
+ * box64 starts clean instead of loading stale translations:
+ *
+ *   $BIONILUX_CACHE_DIR/box64/<program hash>-<box64 hash>/
+ *
+ * Folders are kept under $BIONILUX_BOX64_CACHE_MB (default 512 MiB, 0
+ * turns the cache off) by evicting the least recently launched ones.
+ * Launching touches a folder; a garbage collection runs whenever a new
+ * folder is created and at least hourly otherwise.  A user who sets
+ * BOX64_DYNACACHE=0 or their own BOX64_DYNACACHE_FOLDER is left alone.
+ */
+#define B64C_DIR		"box64"
+#define B64C_BUDGET_ENV		"BIONILUX_BOX64_CACHE_MB"
+#define B64C_DEFAULT_MB		512
+#define B64C_GC_INTERVAL	3600	/* s */
+
+struct b64c_entry {
+	char     name[40];
+	uint64_t bytes;
+	time_t   used;
+};
+
+/*
+ * Bytes used by the files under the directory open on @dfd, which is
+ * closed.  box64 may create subfolders, so this recurses.
+ */
+static uint64_t b64c_usage_fd(int dfd)
+{
+	uint64_t bytes = 0;
+	struct dirent *de;
+	struct stat st;
+	DIR *d = fdopendir(dfd);
+
+	if (!d) {
+		if (dfd >= 0)
+			close(dfd);
+		return 0;
+	}
+	while ((de = readdir(d))) {
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..") ||
+		    fstatat(dirfd(d), de->d_name, &st,
+			    AT_SYMLINK_NOFOLLOW) != 0)
+			continue;
+		if (S_ISREG(st.st_mode))
+			bytes += (uint64_t)st.st_blocks * 512;
+		else if (S_ISDIR(st.st_mode))
+			bytes += b64c_usage_fd(openat(dirfd(d), de->d_name,
+						      O_RDONLY | O_DIRECTORY |
+						      O_NOFOLLOW | O_CLOEXEC));
+	}
+	closedir(d);
+	return bytes;
+}
+
+static uint64_t b64c_usage(const char *dir)
+{
+	return b64c_usage_fd(open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+}
+
+/* Empty the directory open on @dfd, which is closed.  Returns 0 or -1. */
+static int b64c_empty_fd(int dfd)
+{
+	struct dirent *de;
+	DIR *d = fdopendir(dfd);
+	int rc = 0;
+
+	if (!d) {
+		if (dfd >= 0)
+			close(dfd);
+		return -1;
+	}
+	while ((de = readdir(d))) {
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+			continue;
+		if (unlinkat(dirfd(d), de->d_name, 0) == 0)
+			continue;
+		if (errno == EISDIR &&
+		    b64c_empty_fd(openat(dirfd(d), de->d_name,
+					 O_RDONLY | O_DIRECTORY |
+					 O_NOFOLLOW | O_CLOEXEC)) == 0 &&
+		    unlinkat(dirfd(d), de->d_name, AT_REMOVEDIR) == 0)
+			continue;
+		rc = -1;
+	}
+	closedir(d);
+	return rc;
+}
+
+/* Remove the cache folder @dir and everything in it.  Returns 0 or -1. */
+static int b64c_remove(const char *dir)
+{
+	b64c_empty_fd(open(dir, O_RDONLY | O_DIRECTORY | O_NOFOLLOW |
+			   O_CLOEXEC));
+	return rmdir(dir);
+}
+
+static int b64c_cmp_used(const void *a, const void *b)
+{
+	const struct b64c_entry *x = a, *y = b;
+
+	return (x->used > y->used) - (x->used < y->used);
+}
+
+/*
+ * Evict the least recently used folders under @root, other than @keep,
+ * until they fit in @budget bytes.
+ */
+static void b64c_gc(const char *root, uint64_t budget, const char *keep,
+		    int debug)
+{
+	struct b64c_entry *e = NULL;
+	size_t n = 0, cap = 0;
+	uint64_t total = 0;
+	char path[PATH_MAX];
+	struct dirent *de;
+	struct stat st;
+	DIR *d = opendir(root);
+
+	if (!d)
+		return;
+	while ((de = readdir(d))) {
+		if (de->d_name[0] == '.' ||
+		    strlen(de->d_name) >= sizeof(e->name) ||
+		    snprintf(path, sizeof(path), "%s/%s", root,
+			     de->d_name) >= (int)sizeof(path) ||
+		    fstatat(dirfd(d), de->d_name, &st, 0) != 0 ||
+		    !S_ISDIR(st.st_mode))
+			continue;
+		if (n == cap) {
+			struct b64c_entry *ne;
+
+			cap = cap ? cap * 2 : 32;
+			ne = realloc(e, cap * sizeof(*e));
+			if (!ne)
+				break;
+			e = ne;
+		}
+		snprintf(e[n].name, sizeof(e[n].name), "%s", de->d_name);
+		e[n].bytes = b64c_usage(path);
+		e[n].used = st.st_mtime;
+		total += e[n++].bytes;
+	}
+	closedir(d);
+
+	qsort(e, n, sizeof(*e), b64c_cmp_used);
+	for (size_t i = 0; i < n && total > budget; i++) {
+		if (!strcmp(e[i].name, keep) ||
+		    snprintf(path, sizeof(path), "%s/%s", root,
+			     e[i].name) >= (int)sizeof(path))
+			continue;
+		if (b64c_remove(path) != 0) {
+			msg_warn("box64 cache: cannot evict %s: %s", path,
+				 strerror(errno));
+			continue;
+		}
+		total -= e[i].bytes;
+		if (debug)
+			msg_info("box64 cache: evicted %s (%llu KiB)",
+				 e[i].name,
+				 (unsigned long long)(e[i].bytes >> 10));
+	}
+	free(e);
+
+	/* the stamp's mtime says when this last ran */
+	if (snprintf(path, sizeof(path), "%s/.gc", root) < (int)sizeof(path)) {
+		close(open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0600));
+		utimensat(AT_FDCWD, path, NULL, 0);
+	}
+	if (debug)
+		msg_info("box64 cache: %llu of %llu MiB in use",
+			 (unsigned long long)(total >> 20),
+			 (unsigned long long)(budget >> 20));
+}
+
+/*
+ * Add a hit or a miss to the counters in @root/stats.  The update is
+ * done under flock() so concurrent launches do not lose counts.
+ */
+static void b64c_count(const char *root, int hit, int debug)
+{
+	unsigned long long hits = 0, misses = 0;
+	char path[PATH_MAX];
+	FILE *f;
+	int fd;
+
+	if (snprintf(path, sizeof(path), "%s/stats", root) >= (int)sizeof(path))
+		return;
+	fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (fd < 0)
+		return;
+	f = fdopen(fd, "r+");
+	if (!f) {
+		close(fd);
+		return;
+	}
+	flock(fd, LOCK_EX);
+	if (fscanf(f, "hits %llu misses %llu", &hits, &misses) != 2)
+		hits = misses = 0;
+	hit ? hits++ : misses++;
+	rewind(f);
+	fprintf(f, "hits %llu misses %llu\n", hits, misses);
+	fclose(f);
+	if (debug)
+		msg_info("box64 cache: %s (%llu hits, %llu misses, %.0f%%)",
+			 hit ? "hit" : "miss", hits, misses,
+			 100.0 * (double)hits / (double)(hits + misses));
+}
+
+/*
+ * Prepare the code cache folder for running @binary under @box64 into
+ * @dir.  Returns @dir, or NULL when the cache is off or unavailable.
+ */
+static const char *b64c_prepare(const char *binary, const char *box64,
+				char *dir, size_t size, int debug)
+{
+	const char *cache = get_cache_dir(), *env = getenv("BOX64_DYNACACHE");
+	const char *mb = getenv(B64C_BUDGET_ENV);
+	char root[PATH_MAX], name[40], bh[17], xh[17], stamp[PATH_MAX];
+	uint64_t budget = B64C_DEFAULT_MB;
+	struct stat st;
+	int hit;
+
+	if (!cache || getenv("BOX64_DYNACACHE_FOLDER") ||
+	    (env && !strcmp(env, "0")))
+		return NULL;
+	if (mb && *mb)
+		budget = strtoull(mb, NULL, 10);
+	if (budget == 0)
+		return NULL;
+	budget <<= 20;
+
+	content_hash(binary, bh);
+	content_hash(box64, xh);
+	if (!bh[0] || !xh[0])
+		return NULL;
+
+	if (snprintf(root, sizeof(root), "%s/%s", cache,
+		     B64C_DIR) >= (int)sizeof(root))
+		return NULL;
+	snprintf(name, sizeof(name), "%s-%s", bh, xh);
+	if ((size_t)snprintf(dir, size, "%s/%s", root, name) >= size ||
+	    mkdir_p(root, 0700) != 0)
+		return NULL;
+
+	if (mkdir(dir, 0700) == 0) {
+		hit = 0;
+	} else if (errno == EEXIST) {
+		hit = 1;
+		utimensat(AT_FDCWD, dir, NULL, 0);	/* LRU order */
+	} else {
+		return NULL;
+	}
+	b64c_count(root, hit, debug);
+
+	if (!hit ||
+	    snprintf(stamp, sizeof(stamp), "%s/.gc",
+		     root) >= (int)sizeof(stamp) ||
+	    stat(stamp, &st) != 0 ||
+	    time(NULL) - st.st_mtime >= B64C_GC_INTERVAL)
+		b64c_gc(root, budget, name, debug);
+	return dir;
+}
+
+/* ── dependency readahead ────────────────────────────────────────── */
+
+/*
+ * On a cold launch the loader reads the program and each library one
+ * page fault at a time, and phone flash is slow at small random reads.
+ * Before the fork, bionilux resolves the program's DT_NEEDED closure the
+ * way the loader will (DT_RPATH of the library and of what needed it,
+ * the library path, DT_RUNPATH, then the glibc library directory) and
+ * asks the kernel to read all of it with POSIX_FADV_WILLNEED.  The requests
+ * are queued together and complete while the rest of the launch runs.
+ *
+ * Walking the closure reads every library's dynamic section, so the
+ * result is kept in $BIONILUX_CACHE_DIR/deps/<file identity> along with
+ * the state of the library directory; installing or removing a library
+ * changes the directory's mtime and so the walk is redone.  A closure
+ * with libraries that could not be found is never cached.
+ * BIONILUX_READAHEAD=0 turns this off.
+ */
+#define DEPS_ENV	"BIONILUX_READAHEAD"
+#define DEPS_MAX	256
+#define DEPS_RA_MAX	(32 << 20)	/* readahead per file, bytes */
+#define DEPS_MAGIC	"bionilux-deps 1"
+
+struct deps {
+	size_t n;
+	size_t missing;			/* needed libraries not found */
+	char  *path[DEPS_MAX];
+	char  *rpath[DEPS_MAX];		/* DT_RPATH, NULL with DT_RUNPATH */
+	int    from[DEPS_MAX];		/* entry that needed it, -1: a root */
+};
+
+/* box64 runs its own native builds of these, never the x86_64 files */
+static const char *const deps_box64_wrapped[] = {
+	"libc.so.6", "libm.so.6", "libpthread.so.0", "libdl.so.2",
+	"librt.so.1", "ld-linux-x86-64.so.2",
+};
+
+/* Add @path, needed by entry @from, to @d.  No room counts as missing. */
+static void deps_add(struct deps *d, const char *path, int from)
+{
+	for (size_t i = 0; i < d->n; i++)
+		if (!strcmp(d->path[i], path))
+			return;
+	if (d->n < DEPS_MAX && (d->path[d->n] = strdup(path))) {
+		d->rpath[d->n] = NULL;
+		d->from[d->n++] = from;
+	} else {
+		d->missing++;
+	}
+}
+
+static void deps_free(struct deps *d)
+{
+	for (size_t i = 0; i < d->n; i++) {
+		free(d->path[i]);
+		free(d->rpath[i]);
+	}
+	d->n = d->missing = 0;
+}
+
+/*
+ * Look for library @name in each directory of the ':' list @dirs, with
+ * $ORIGIN being the directory of @owner, and add the first hit to @d as
+ * needed by @from.  Returns 1 if found.
+ */
+static int deps_search(struct deps *d, const char *name, const char *dirs,
+		       const char *owner, int from)
+{
+	char path[PATH_MAX], list[PATH_MAX], origin[PATH_MAX] = "";
+	char *slash;
+
+	if (!dirs || !*dirs ||
+	    snprintf(list, sizeof(list), "%s", dirs) >= (int)sizeof(list))
+		return 0;
+	if (owner && snprintf(origin, sizeof(origin), "%s",
+			      owner) < (int)sizeof(origin) &&
+	    (slash = strrchr(origin, '/')))
+		*slash = '\0';
+
+	for (char *save = NULL, *dir = strtok_r(list, ":", &save); dir;
+	     dir = strtok_r(NULL, ":", &save)) {
+		int n;
+
+		if (!strncmp(dir, "$ORIGIN", 7))
+			n = snprintf(path, sizeof(path), "%s%s/%s", origin,
+				     dir + 7, name);
+		else if (!strncmp(dir, "${ORIGIN}", 9))
+			n = snprintf(path, sizeof(path), "%s%s/%s", origin,
+				     dir + 9, name);
+		else
+			n = snprintf(path, sizeof(path), "%s/%s", dir, name);
+		if (n < (int)sizeof(path) && access(path, F_OK) == 0) {
+			deps_add(d, path, from);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Find library @name, needed by entry @i of @d, the way the loader
+ * would: without a DT_RUNPATH (@runpath), the DT_RPATH of @i, of what
+ * needed it and so on up, and of the program; then the library path
+ * @ldpath, @runpath and @libdir.  A library found nowhere is counted in
+ * d->missing.
+ */
+static void deps_resolve(struct deps *d, const char *name, int i,
+			 const char *runpath, const char *ldpath,
+			 const char *libdir, int x86)
+{
+	int root = 0;
+
+	if (x86)
+		for (size_t k = 0; k < ARRAY_SIZE(deps_box64_wrapped); k++)
+			if (!strcmp(name, deps_box64_wrapped[k]))
+				return;
+	if (strchr(name, '/')) {
+		deps_add(d, name, i);
+		return;
+	}
+
+	if (!runpath) {
+		for (int l = i; l >= 0; l = d->from[l]) {
+			root |= l == 0;
+			if (deps_search(d, name, d->rpath[l], d->path[l], i))
+				return;
+		}
+		if (!root && deps_search(d, name, d->rpath[0], d->path[0], i))
+			return;
+	}
+	if (deps_search(d, name, ldpath, NULL, i) ||
+	    deps_search(d, name, runpath, d->path[i], i) ||
+	    deps_search(d, name, libdir, NULL, i))
+		return;
+	d->missing++;
+}
+
+/* File offset of virtual address @vaddr, or 0 if no PT_LOAD maps it. */
+static uint64_t deps_offset(const Elf64_Phdr *load, size_t nload,
+			    uint64_t vaddr)
+{
+	for (size_t i = 0; i < nload; i++)
+		if (vaddr >= load[i].p_vaddr &&
+		    vaddr - load[i].p_vaddr < load[i].p_filesz)
+			return load[i].p_offset + (vaddr - load[i].p_vaddr);
+	return 0;
+}
+
+/* Add the libraries entry @i of @d names in DT_NEEDED to @d. */
+static void deps_scan(struct deps *d, int i, const char *ldpath,
+		      const char *libdir, int x86)
+{
+	Elf64_Phdr load[16], dyn = { .p_type = PT_NULL };
+	uint64_t strtab = 0, strsz = 0;
+	uint64_t rpath = UINT64_MAX, runpath = UINT64_MAX;
+	const char *path = d->path[i], *rp, *run;
+	const unsigned char *m;
+	size_t size, nload = 0;
+	Elf64_Ehdr eh;
+	struct stat st;
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+		return;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(eh)) {
+		close(fd);
+		return;
+	}
+	size = (size_t)st.st_size;
+	m = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (m == MAP_FAILED)
+		return;
+
+	memcpy(&eh, m, sizeof(eh));
+	if (memcmp(eh.e_ident, ELFMAG, SELFMAG) != 0 ||
+	    eh.e_ident[EI_CLASS] != ELFCLASS64 ||
+	    eh.e_phentsize < sizeof(Elf64_Phdr) || eh.e_phoff > size ||
+	    (size - eh.e_phoff) / eh.e_phentsize < eh.e_phnum)
+		goto out;
+
+	for (unsigned k = 0; k < eh.e_phnum; k++) {
+		Elf64_Phdr ph;
+
+		memcpy(&ph, m + eh.e_phoff + (size_t)k * eh.e_phentsize,
+		       sizeof(ph));
+		if (ph.p_type == PT_LOAD && nload < 16)
+			load[nload++] = ph;
+		else if (ph.p_type == PT_DYNAMIC)
+			dyn = ph;
+	}
+	if (dyn.p_type != PT_DYNAMIC || dyn.p_offset > size ||
+	    dyn.p_filesz > size - dyn.p_offset)
+		goto out;
+
+	for (size_t off = 0; off + sizeof(Elf64_Dyn) <= dyn.p_filesz;
+	     off += sizeof(Elf64_Dyn)) {
+		Elf64_Dyn de;
+
+		memcpy(&de, m + dyn.p_offset + off, sizeof(de));
+		if (de.d_tag == DT_NULL)
+			break;
+		if (de.d_tag == DT_STRTAB)
+			strtab = deps_offset(load, nload, de.d_un.d_ptr);
+		else if (de.d_tag == DT_STRSZ)
+			strsz = de.d_un.d_val;
+		else if (de.d_tag == DT_RUNPATH)
+			runpath = de.d_un.d_val;
+		else if (de.d_tag == DT_RPATH)
+			rpath = de.d_un.d_val;
+	}
+	if (!strtab || strtab > size || strsz > size - strtab)
+		goto out;
+
+#define DEPS_STR(o) ((o) < strsz && memchr(m + strtab + (o), '\0', \
+					   strsz - (o)) ? \
+		     (const char *)m + strtab + (o) : NULL)
+
+	rp = DEPS_STR(rpath);
+	run = DEPS_STR(runpath);
+	if (rp && !run)		/* DT_RPATH is ignored next to DT_RUNPATH */
+		d->rpath[i] = strdup(rp);
+
+	for (size_t off = 0; off + sizeof(Elf64_Dyn) <= dyn.p_filesz;
+	     off += sizeof(Elf64_Dyn)) {
+		const char *name;
+		Elf64_Dyn de;
+
+		memcpy(&de, m + dyn.p_offset + off, sizeof(de));
+		if (de.d_tag == DT_NULL)
+			break;
+		if (de.d_tag != DT_NEEDED || !(name = DEPS_STR(de.d_un.d_val)))
+			continue;
+		deps_resolve(d, name, i, run, ldpath, libdir, x86);
+	}
+#undef DEPS_STR
+out:
+	munmap((void *)m, size);
+}
+
+/* Read the closure cached in @file if it was made for library @state. */
+static int deps_load(struct deps *d, const char *file, uint64_t state)
+{
+	char line[PATH_MAX + 2], want[64];
+	FILE *f = fopen(file, "re");
+
+	if (!f)
+		return 0;
+	snprintf(want, sizeof(want), DEPS_MAGIC " %016llx\n",
+		 (unsigned long long)state);
+	if (!fgets(line, sizeof(line), f) || strcmp(line, want) != 0) {
+		fclose(f);
+		return 0;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\n")] = '\0';
+		if (line[0])
+			deps_add(d, line, -1);
+	}
+	fclose(f);
+	return d->n > 0;
+}
+
+static void deps_store(const struct deps *d, const char *file,
+		       uint64_t state)
+{
+	char tmp[PATH_MAX];
+	FILE *f;
+
+	if ((size_t)snprintf(tmp, sizeof(tmp), "%s.%d", file,
+			     (int)getpid()) >= sizeof(tmp))
+		return;
+	f = fopen(tmp, "we");
+	if (!f)
+		return;
+	fprintf(f, DEPS_MAGIC " %016llx\n", (unsigned long long)state);
+	for (size_t i = 0; i < d->n; i++)
+		fprintf(f, "%s\n", d->path[i]);
+	if (fclose(f) != 0 || rename(tmp, file) != 0)
+		unlink(tmp);
+}
+
+/*
+ * The library path the loader of a closure searches, or NULL.  glibc's
+ * loader is given --library-path @libdir, which replaces LD_LIBRARY_PATH,
+ * whenever LD_LIBRARY_PATH is set (see ld_cache_ready()).  box64 puts
+ * LD_LIBRARY_PATH before BOX64_LD_LIBRARY_PATH, which bionilux sets to
+ * @libdir unless the user did.
+ */
+static const char *deps_ldpath(const char *libdir, int x86, char *buf,
+			       size_t size)
+{
+	const char *llp = getenv("LD_LIBRARY_PATH");
+	const char *b64 = getenv("BOX64_LD_LIBRARY_PATH");
+
+	if (!x86)
+		return llp && *llp ? libdir : NULL;
+	if (snprintf(buf, size, "%s%s%s", llp ? llp : "",
+		     llp && *llp ? ":" : "",
+		     b64 && *b64 ? b64 : libdir) >= (int)size)
+		return libdir;
+	return buf;
+}
+
+/*
+ * Fill @d with @root, its interpreter @interp (may be NULL) and the
+ * libraries it needs from @libdir (NULL: none, a bionic program).  @x86
+ * marks an x86_64 program, whose core glibc libraries box64 replaces.
+ * Returns 1 if the closure came from the cache.
+ */
+static int deps_closure(struct deps *d, const char *root, const char *interp,
+			const char *libdir, int x86)
+{
+	const char *cache = get_cache_dir(), *ldpath = NULL;
+	char file[PATH_MAX] = "", lp[PATH_MAX];
+	uint64_t state = 0, t = stage_begin();
+	struct stat st;
+	int cached = 0;
+
+	/* the walk depends on every directory it searches */
+	if (libdir) {
+		char dirs[PATH_MAX];
+
+		state = ld_cache_hash_dir(BL_HASH_INIT, libdir);
+		ldpath = deps_ldpath(libdir, x86, lp, sizeof(lp));
+		if (ldpath) {
+			state = bl_hash(state, ldpath, strlen(ldpath));
+			snprintf(dirs, sizeof(dirs), "%s", ldpath);
+			for (char *save = NULL,
+				  *dir = strtok_r(dirs, ":", &save); dir;
+			     dir = strtok_r(NULL, ":", &save))
+				state = ld_cache_hash_dir(state, dir);
+		}
+	}
+
+	if (cache && stat(root, &st) == 0) {
+		char id[96];
+
+		file_identity(&st, id, sizeof(id));
+		if (snprintf(file, sizeof(file), "%s/deps/%s", cache,
+			     id) >= (int)sizeof(file))
+			file[0] = '\0';	/* too long to cache */
+		else
+			cached = deps_load(d, file, state);
+	}
+	if (!cached) {
+		deps_add(d, root, -1);
+		if (interp)
+			deps_add(d, interp, -1);
+		for (size_t i = 0; libdir && i < d->n; i++)
+			deps_scan(d, (int)i, ldpath, libdir, x86);
+		/* a partial closure would hide what the rest imports */
+		if (file[0] && !d->missing) {
+			char dir[PATH_MAX];
+
+			if (snprintf(dir, sizeof(dir), "%s/deps",
+				     cache) < (int)sizeof(dir) &&
+			    (mkdir(dir, 0700) == 0 || errno == EEXIST))
+				deps_store(d, file, state);
+		}
+	}
+	stage_end("deps", t);
+	return cached;
+}
+
+/* Start reading the files of closure @d into the page cache. */
+static void deps_prefetch(const struct deps *d, int cached, int debug)
+{
+	const char *env = getenv(DEPS_ENV);
+	uint64_t t, bytes = 0;
+	struct stat st;
+
+	if (env && !strcmp(env, "0"))
+		return;
+
+	t = stage_begin();
+	for (size_t i = 0; i < d->n; i++) {
+		int fd = open(d->path[i], O_RDONLY | O_CLOEXEC);
+
+		if (fd < 0)
+			continue;
+		if (fstat(fd, &st) == 0) {
+			off_t len = st.st_size < DEPS_RA_MAX ?
+				    st.st_size : DEPS_RA_MAX;
+
+			posix_fadvise(fd, 0, len, POSIX_FADV_WILLNEED);
+			bytes += (uint64_t)len;
+		}
+		close(fd);
+	}
+	stage_end("readahead", t);
+
+	if (debug)
+		msg_info("readahead: %zu files, %llu KiB (%s)", d->n,
+			 (unsigned long long)(bytes >> 10),
+			 cached ? "cached closure" : "walked");
+}
+
+/* deps_closure() and deps_prefetch() for a closure needed only once. */
+static void deps_readahead(const char *root, const char *interp,
+			   const char *libdir, int x86, int debug)
+{
+	const char *env = getenv(DEPS_ENV);
+	struct deps d = { 0 };
+	int cached;
+
+	if (env && !strcmp(env, "0"))
+		return;
+	cached = deps_closure(&d, root, interp, libdir, x86);
+	deps_prefetch(&d, cached, debug);
+	deps_free(&d);
+}
+
+/* ── preload selection ───────────────────────────────────────────── */
+
+/*
+ * The preload costs every process an extra library, its constructor's
+ * dlsym() calls and interposed readlink().  It only changes anything
+ * for programs that exec, spawn or read /proc/self/exe, so bionilux
+ * leaves it out when nothing in the library closure @d imports one of
+ * the functions it hooks (elf_hooked_imports), and every library it
+ * needs was found.  The scan is cached with each file's
+ * classification.  Libraries a program dlopen()s later are invisible
+ * here; BIONILUX_PRELOAD=1 keeps the preload for such programs, and -n
+ * still drops it for everything.
+ */
+#define PRELOAD_ENV	"BIONILUX_PRELOAD"
+
+static int preload_needed(const struct deps *d, const launch_opts_t *o,
+			  int debug)
+{
+	const char *env = getenv(PRELOAD_ENV);
+	uint64_t t;
+
+	/* --record-io logs through the preload's open() hooks */
+	if ((env && !strcmp(env, "1")) || o->record_io || !d->n)
+		return 1;
+	if (d->missing) {
+		if (debug)
+			msg_info("preload: needed, %zu libraries not found",
+				 d->missing);
+		return 1;
+	}
+
+	t = stage_begin();
+	for (size_t i = 0; i < d->n; i++) {
+		binary_info_t info;
+
+		elf_classify_imports(d->path[i], &info);
+		if (!(info.flags & ELF_F_SCANNED) ||
+		    (info.flags & ELF_F_HOOKED)) {
+			stage_end("imports", t);
+			if (debug)
+				msg_info("preload: needed by %s", d->path[i]);
+			return 1;
+		}
+	}
+	stage_end("imports", t);
+
+	if (debug)
+		msg_info("preload: skipped, nothing imports exec, spawn "
+			 "or readlink");
+	return 0;
+}
+
+/* ── startup I/O traces ──────────────────────────────────────────── */
+
+/*
+ * Libraries are only part of what a program reads as it starts: data
+ * files, fonts and assets are opened by name at run time.  --record-io
+ * learns them.  bionilux hands the tree an O_APPEND memfd and a deadline
+ * in $BIONILUX_IOTRACE, and the preload logs each file opened for
+ * reading until then along with the pages of it that were already
+ * cached (see bionilux_preload.c).  When the deadline passes, or the
+ * program exits if that is sooner, bionilux keeps for each file in
+ * first-open order the ranges that are resident in the page cache and
+ * were not at the first open — the parts that were actually read or
+ * faulted in.  The trace is written to
+ *
+ *   $BIONILUX_CACHE_DIR/iotrace/<hash of the program's path>
+ *
+ * one file per line, "path<TAB>page+count page+count ...", and each
+ * later launch of the program replays it with POSIX_FADV_WILLNEED right
+ * after the library closure, in the order the files were needed.
+ * Files that have since gone away are skipped, so a trace outlives
+ * program updates; recording again replaces it.  Only programs that
+ * load the preload (arm64 glibc) can be traced.
+ */
+#define IOT_ENV			"BIONILUX_IOTRACE"
+#define IOT_DIR			"iotrace"
+#define IOT_MAGIC		"bionilux-iotrace 1"
+#define IOT_DEFAULT_SECS	10
+#define IOT_MAX_FILES		1024
+#define IOT_MAX_BYTES		(256ULL << 20)
+#define IOT_GAP_PAGES		16	/* merge ranges closer than this */
+#define IOT_MIN_FD		200	/* like the event ring */
+
+/* --record-io log descriptor, -1 when not recording */
+static int g_iot_fd = -1;
+static uint64_t g_iot_end;	/* and its deadline, CLOCK_MONOTONIC ns */
+
+/* Start logging opens for @secs seconds in every process started now. */
+static int iot_create(unsigned secs)
+{
+#ifdef __NR_memfd_create
+	char val[48];
+	int fd, hi;
+
+	fd = (int)syscall(__NR_memfd_create, "bionilux-iotrace", 0);
+	if (fd < 0)
+		return -1;
+	hi = fcntl(fd, F_DUPFD, IOT_MIN_FD);
+	close(fd);
+	if (hi < 0 || fcntl(hi, F_SETFL, O_APPEND) != 0) {
+		if (hi >= 0)
+			close(hi);
+		return -1;
+	}
+	g_iot_fd = hi;
+	g_iot_end = bl_now_ns() + secs * 1000000000ULL;
+
+	snprintf(val, sizeof(val), "%d:%llu", hi,
+		 (unsigned long long)g_iot_end);
+	return setenv(IOT_ENV, val, 1);
+#else
+	(void)secs;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+static int iot_path(const char *binary, char *buf, size_t size)
+{
+	const char *cache = get_cache_dir();
+
+	if (!cache)
+		return -1;
+	return (size_t)snprintf(buf, size, "%s/" IOT_DIR "/%016llx", cache,
+				(unsigned long long)bl_hash(BL_HASH_INIT,
+							    binary,
+							    strlen(binary)))
+	       < size ? 0 : -1;
+}
+
+/*
+ * Write the resident ranges of @path to @out as "\tpage+count page+count".
+ * Pages in @cached ("page+count ..." logged at the first open, "?" if
+ * unknown) were there before the program read them and are left out,
+ * unless that leaves nothing.  Where residency cannot be seen (mincore()
+ * only reports pages of files we may write, or that we map), the whole
+ * file counts.  Returns the bytes covered.
+ */
+static uint64_t iot_ranges(FILE *out, const char *path, const struct stat *st,
+			   char *cached)
+{
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t npages = ((size_t)st->st_size + page - 1) / page;
+	unsigned char *vec = NULL, *old = NULL;
+	uint64_t covered = 0;
+	size_t resident = 0, fresh = 0;
+	char sep = '\t', *save = NULL;
+	void *map = MAP_FAILED;
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd >= 0) {
+		map = mmap(NULL, (size_t)st->st_size, PROT_READ, MAP_SHARED,
+			   fd, 0);
+		close(fd);
+	}
+	if (map != MAP_FAILED && (vec = malloc(npages)) &&
+	    mincore(map, (size_t)st->st_size, vec) == 0)
+		for (size_t i = 0; i < npages; i++)
+			resident += vec[i] & 1;
+
+	if (resident && strcmp(cached, "?") != 0 &&
+	    (old = calloc(1, npages))) {
+		for (char *r = strtok_r(cached, " ", &save); r;
+		     r = strtok_r(NULL, " ", &save)) {
+			unsigned long long start, count;
+
+			if (sscanf(r, "%llu+%llu", &start, &count) != 2)
+				continue;
+			for (; count && start < npages; start++, count--)
+				old[start] = 1;
+		}
+		for (size_t i = 0; i < npages; i++)
+			fresh += (vec[i] & 1) && !old[i];
+		for (size_t i = 0; fresh && i < npages; i++)
+			if (old[i])
+				vec[i] = 0;
+		free(old);
+	}
+
+	if (!resident) {
+		fprintf(out, "%c0+%zu", sep, npages);
+		covered = (uint64_t)npages * page;
+	} else {
+		for (size_t i = 0; i < npages;) {
+			size_t start, end, gap;
+
+			if (!(vec[i] & 1)) {
+				i++;
+				continue;
+			}
+			start = end = i;
+			for (gap = 0; ++i < npages && gap < IOT_GAP_PAGES;) {
+				if (vec[i] & 1) {
+					end = i;
+					gap = 0;
+				} else {
+					gap++;
+				}
+			}
+			i = end + 1;
+			fprintf(out, "%c%zu+%zu", sep, start, end - start + 1);
+			sep = ' ';
+			covered += (uint64_t)(end - start + 1) * page;
+		}
+	}
+	free(vec);
+	if (map != MAP_FAILED)
+		munmap(map, (size_t)st->st_size);
+	return covered;
+}
+
+/*
+ * Turn the --record-io log into the trace of @binary.  Runs once, at
+ * the deadline or when the program exits.
+ */
+static void iot_save(const char *binary)
+{
+	uint64_t seen[IOT_MAX_FILES * 2] = { 0 }, bytes = 0;
+	char file[PATH_MAX], tmp[PATH_MAX + 16], *log = NULL, *save = NULL;
+	size_t nfiles = 0;
+	struct stat st;
+	FILE *out;
+	int fd = g_iot_fd;
+
+	if (fd < 0)
+		return;
+	g_iot_fd = -1;
+	if (iot_path(binary, file, sizeof(file)) != 0) {
+		msg_warn("--record-io: no cache directory");
+		close(fd);
+		return;
+	}
+	if (fstat(fd, &st) != 0 || st.st_size == 0 ||
+	    !(log = calloc(1, (size_t)st.st_size + 1)) ||
+	    pread(fd, log, (size_t)st.st_size, 0) != st.st_size) {
+		msg_warn("--record-io: no files were opened (only programs "
+			 "that load the preload are traced)");
+		free(log);
+		close(fd);
+		return;
+	}
+	close(fd);
+
+	snprintf(tmp, sizeof(tmp), "%s", file);
+	*strrchr(tmp, '/') = '\0';
+	mkdir_p(tmp, 0700);
+	snprintf(tmp, sizeof(tmp), "%s.%d", file, (int)getpid());
+	out = fopen(tmp, "we");
+	if (!out) {
+		msg_warn("--record-io: %s: %s", tmp, strerror(errno));
+		free(log);
+		return;
+	}
+	fprintf(out, IOT_MAGIC " %ld\n", sysconf(_SC_PAGESIZE));
+
+	for (char *l = strtok_r(log, "\n", &save);
+	     l && nfiles < IOT_MAX_FILES && bytes < IOT_MAX_BYTES;
+	     l = strtok_r(NULL, "\n", &save)) {
+		char *cached = strrchr(l, '\t');
+		uint64_t h;
+		size_t slot, probe;
+
+		if (!cached)
+			continue;
+		*cached++ = '\0';
+		h = bl_hash(BL_HASH_INIT, l, strlen(l)) | 1;
+		slot = h % ARRAY_SIZE(seen);
+		if (!strncmp(l, "/proc/", 6) || !strncmp(l, "/dev/", 5) ||
+		    !strncmp(l, "/sys/", 5) || strchr(l, '\t'))
+			continue;
+
+		/*
+		 * First open only.  Only kept files are entered, at most
+		 * IOT_MAX_FILES of them, so the table never fills.
+		 */
+		for (probe = 0; probe < ARRAY_SIZE(seen) && seen[slot] &&
+				seen[slot] != h; probe++)
+			slot = (slot + 1) % ARRAY_SIZE(seen);
+		if (probe == ARRAY_SIZE(seen) || seen[slot] ||
+		    stat(l, &st) != 0 || !S_ISREG(st.st_mode) ||
+		    st.st_size == 0)
+			continue;
+		seen[slot] = h;
+
+		fputs(l, out);
+		bytes += iot_ranges(out, l, &st, cached);
+		fputc('\n', out);
+		nfiles++;
+	}
+	free(log);
+
+	if (fclose(out) != 0 || rename(tmp, file) != 0) {
+		msg_warn("--record-io: %s: %s", file, strerror(errno));
+		unlink(tmp);
+		return;
+	}
+	msg_info("I/O trace: %zu files, %llu KiB → %s", nfiles,
+		 (unsigned long long)(bytes >> 10), file);
+}
+
+/* Replay the trace recorded for @binary, if there is one. */
+static void iot_replay(const char *binary, int debug)
+{
+	const char *env = getenv(DEPS_ENV);
+	char file[PATH_MAX], line[PATH_MAX + 4096];
+	uint64_t t, bytes = 0;
+	size_t nfiles = 0;
+	long page = 0;
+	FILE *f;
+
+	if ((env && !strcmp(env, "0")) || g_iot_fd >= 0 ||
+	    iot_path(binary, file, sizeof(file)) != 0 ||
+	    !(f = fopen(file, "re")))
+		return;
+
+	t = stage_begin();
+	if (!fgets(line, sizeof(line), f) ||
+	    sscanf(line, IOT_MAGIC " %ld", &page) != 1 || page <= 0) {
+		fclose(f);
+		return;
+	}
+	while (bytes < IOT_MAX_BYTES && fgets(line, sizeof(line), f)) {
+		char *tab = strchr(line, '\t'), *r, *save = NULL;
+		int fd;
+
+		if (!tab)
+			continue;
+		*tab = '\0';
+		fd = open(line, O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			continue;
+		for (r = strtok_r(tab + 1, " \n", &save); r;
+		     r = strtok_r(NULL, " \n", &save)) {
+			unsigned long long start, count;
+
+			if (sscanf(r, "%llu+%llu", &start, &count) != 2)
+				continue;
+			posix_fadvise(fd, (off_t)(start * (uint64_t)page),
+				      (off_t)(count * (uint64_t)page),
+				      POSIX_FADV_WILLNEED);
+			bytes += count * (uint64_t)page;
+		}
+		close(fd);
+		nfiles++;
+	}
+	fclose(f);
+	stage_end("iotrace", t);
+
+	if (debug)
+		msg_info("I/O trace: %zu files, %llu KiB read ahead", nfiles,
+			 (unsigned long long)(bytes >> 10));
+}
+
+/* ── environment construction ────────────────────────────────────── */
+
+/*
+ * Helper: duplicate string with NULL check.
+ * Returns NULL on OOM (caller must cope).
+ */
+static inline char *xstrdup(const char *s)
+{
+	char *d = strdup(s);
+	if (!d)
+		msg_warn("strdup failed (out of memory)");
+	return d;
+}
+
+/*
+ * Helper: format into a freshly allocated string.
+ * Uses proper asprintf(3) — no truncation, no fixed-size buffer.
+ */
+__attribute__((format(printf, 1, 2)))
+static char *xasprintf(const char *fmt, ...)
+{
+	char *p = NULL;
+	va_list ap;
+	int ret;
+
+	va_start(ap, fmt);
+	ret = vasprintf(&p, fmt, ap);
+	va_end(ap);
+
+	if (ret < 0) {
+		msg_warn("vasprintf failed (out of memory)");
+		return NULL;
+	}
+	return p;
+}
+
+static void free_env(char **env)
+{
+	if (!env)
+		return;
+	for (int i = 0; env[i]; i++)
+		free(env[i]);
+	free(env);
+}
+
+/*
+ * Build a new environment array for the child process.
+ *
+ * @preload_path  – path to libbionilux_preload.so (may be NULL)
+ * @for_box64     – true when launching an x86_64 binary via box64
+ * @use_preload   – false when user passed -n
+ * @orig_binary   – resolved path of the target binary
+ * @tune          – tuning profile to apply (may be NULL)
+ * @box64_cache   – box64 code cache folder (may be NULL)
+ * @debug         – enable BIONILUX_DEBUG in child
+ */
+static char **build_environment(const char *preload_path, int for_box64,
+				int use_preload, const char *orig_binary,
+				const struct tune *tune,
+				const char *box64_cache, int debug)
+{
+	extern char **environ;
+	const char *user_tunables = getenv("GLIBC_TUNABLES");
+	const char *outer = getenv(TUNE_TUNABLES_ENV);
+	size_t envc = 0, j = 0, n;
+	int own_tunables = tune && tune->tunables[0];
+	char **env;
+
+	while (environ[envc])
+		envc++;
+
+	/* a launch from inside a profiled program: drop that profile */
+	if (user_tunables && outer && *outer &&
+	    !strncmp(user_tunables, outer, n = strlen(outer)) &&
+	    (user_tunables[n] == ':' || !user_tunables[n]))
+		user_tunables += n + (user_tunables[n] == ':');
+	else
+		outer = NULL;
+
+	/* room for existing vars + ≤15 new ones + profile settings + NULL */
+	env = calloc(envc + 17 + (tune ? tune->n : 0), sizeof(char *));
+	if (!env)
+		return NULL;
+
+	/* copy existing, filtering vars we'll override */
+	for (size_t i = 0; i < envc; i++) {
+		if (ENVPREFIX(environ[i], "LD_PRELOAD="))        continue;
+		if (ENVPREFIX(environ[i], "BIONILUX_GLIBC_LIB="))   continue;
+		if (ENVPREFIX(environ[i], "BIONILUX_GLIBC_LOADER=")) continue;
+		if (ENVPREFIX(environ[i], "BIONILUX_ORIG_EXE="))     continue;
+		if (ENVPREFIX(environ[i], "BIONILUX_CACHE_DIR="))    continue;
+		if (ENVPREFIX(environ[i], "BOX64_LD_PRELOAD="))  continue;
+		if (ENVPREFIX(environ[i], "BOX64_PATH="))        continue;
+		if ((own_tunables || outer) &&
+		    ENVPREFIX(environ[i], "GLIBC_TUNABLES="))      continue;
+		if (ENVPREFIX(environ[i], TUNE_TUNABLES_ENV "="))   continue;
+
+		/*
+		 * Strip glibc-specific LD variables that could
+		 * interfere with bionic or the child process.
+		 */
+		if (ENVPREFIX(environ[i], "LD_AUDIT="))   continue;
+		if (ENVPREFIX(environ[i], "LD_DEBUG="))   continue;
+
+		/* keep user's BOX64_LD_LIBRARY_PATH only in box64 mode */
+		if (!for_box64 &&
+		    ENVPREFIX(environ[i], "BOX64_LD_LIBRARY_PATH="))
+			continue;
+
+		env[j] = xstrdup(environ[i]);
+		if (!env[j]) { free_env(env); return NULL; }
+		j++;
+	}
+
+	/* BIONILUX env vars for the preload library */
+	env[j] = xasprintf("BIONILUX_GLIBC_LIB=%s", GLIBC_LIB);
+	if (!env[j]) { free_env(env); return NULL; } j++;
+
+	env[j] = xasprintf("BIONILUX_GLIBC_LOADER=%s", GLIBC_LOADER);
+	if (!env[j]) { free_env(env); return NULL; } j++;
 
 	if (orig_binary) {
 		env[j] = xasprintf("BIONILUX_ORIG_EXE=%s", orig_binary);
 		if (!env[j]) { free_env(env); return NULL; } j++;
 	}
 
-	if (for_box64) {
-		/* set BOX64_LD_LIBRARY_PATH if user hasn't overridden it */
-		if (!getenv("BOX64_LD_LIBRARY_PATH")) {
-			env[j] = xasprintf("BOX64_LD_LIBRARY_PATH=%s",
-					   GLIBC_LIB_X86);
-			if (!env[j]) { free_env(env); return NULL; } j++;
-		}
+	if (get_cache_dir()) {
+		env[j] = xasprintf("%s=%s", BL_CACHE_DIR_ENV, get_cache_dir());
+		if (!env[j]) { free_env(env); return NULL; } j++;
+	}
+
+	/* the profile's box64 settings, unless the user set them */
+	for (size_t i = 0; tune && for_box64 && i < tune->n; i++) {
+		if (strncmp(tune->set[i].key, "BOX64_", 6) != 0 ||
+		    getenv(tune->set[i].key))
+			continue;
+		env[j] = xasprintf("%s=%s", tune->set[i].key, tune->set[i].val);
+		if (!env[j]) { free_env(env); return NULL; } j++;
+	}
+
+	if (own_tunables) {
+		env[j] = xasprintf("GLIBC_TUNABLES=%s%s%s", tune->tunables,
+				   user_tunables && *user_tunables ? ":" : "",
+				   user_tunables ? user_tunables : "");
+		if (!env[j]) { free_env(env); return NULL; } j++;
+
+		env[j] = xasprintf("%s=%s", TUNE_TUNABLES_ENV, tune->tunables);
+		if (!env[j]) { free_env(env); return NULL; } j++;
+	} else if (outer && *user_tunables) {
+		env[j] = xasprintf("GLIBC_TUNABLES=%s", user_tunables);
+		if (!env[j]) { free_env(env); return NULL; } j++;
+	}
+
+	if (for_box64) {
+		/* set BOX64_LD_LIBRARY_PATH if user hasn't overridden it */
+		if (!getenv("BOX64_LD_LIBRARY_PATH")) {
+			env[j] = xasprintf("BOX64_LD_LIBRARY_PATH=%s",
+					   GLIBC_LIB_X86);
+			if (!env[j]) { free_env(env); return NULL; } j++;
+		}
+
+		/* BOX64_PATH for child process re-exec */
+		env[j] = xasprintf("BOX64_PATH=%s/glibc/bin/:%s/bin/",
+				    get_prefix(), get_prefix());
+		if (!env[j]) { free_env(env); return NULL; } j++;
+
+		env[j] = xstrdup("BOX64_UNAME=x86_64");
+		if (!env[j]) { free_env(env); return NULL; } j++;
+
+		/* persistent dynarec cache, see b64c_prepare() */
+		if (box64_cache) {
+			if (!getenv("BOX64_DYNACACHE")) {
+				env[j] = xstrdup("BOX64_DYNACACHE=1");
+				if (!env[j]) { free_env(env); return NULL; } j++;
+			}
+			env[j] = xasprintf("BOX64_DYNACACHE_FOLDER=%s",
+					   box64_cache);
+			if (!env[j]) { free_env(env); return NULL; } j++;
+		}
+
+		/*
+		 * Do NOT set BOX64_LD_PRELOAD — the preload .so is ARM64
+		 * glibc and cannot be loaded into box64's x86_64 context.
+		 * Omit LD_PRELOAD entirely so neither box64 nor the
+		 * emulated process inherits a stale value.
+		 */
+	} else {
+		if (preload_path && use_preload) {
+			env[j] = xasprintf("LD_PRELOAD=%s", preload_path);
+			if (!env[j]) { free_env(env); return NULL; } j++;
+		}
+		/* No preload → don't set LD_PRELOAD at all */
+	}
+
+	if (debug) {
+		env[j] = xstrdup("BIONILUX_DEBUG=1");
+		if (!env[j]) { free_env(env); return NULL; } j++;
+	}
+
+	env[j] = NULL;
+	return env;
+}
+
+/* ── signal forwarding ───────────────────────────────────────────── */
+
+/*
+ * Signals to forward to the child process.
+ * Includes SIGWINCH for correct terminal-resize handling in TUI apps.
+ */
+static const int forwarded_sigs[] = {
+	SIGINT, SIGTERM, SIGHUP, SIGQUIT, SIGUSR1, SIGUSR2, SIGWINCH,
+};
+
+/*
+ * Use sig_atomic_t — pid_t writes are not guaranteed atomic on all
+ * architectures.  Valid PIDs fit comfortably in sig_atomic_t.
+ */
+static volatile sig_atomic_t g_child_pid;
+
+static void forward_signal(int sig)
+{
+	pid_t pid = (pid_t)g_child_pid;
+
+	if (pid > 0)
+		kill(pid, sig);
+}
+
+/*
+ * Install signal forwarding handlers.
+ * Must be called BEFORE fork() to avoid a race where a signal arrives
+ * between fork() and handler installation.
+ * g_child_pid is set to 0 initially — the handler checks pid > 0, so
+ * signals arriving before we record the real PID are harmlessly ignored.
+ */
+static void install_signal_handlers(void)
+{
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = forward_signal;
+	sa.sa_flags   = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+
+	g_child_pid = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(forwarded_sigs); i++)
+		sigaction(forwarded_sigs[i], &sa, NULL);
+}
+
+/* ── wake lock ───────────────────────────────────────────────────── */
+
+/*
+ * termux-wake-lock / termux-wake-unlock go through the Android
+ * activity manager and take hundreds of milliseconds, so they never
+ * run on the launch path.  Instead every launch registers a *hold*
+ * with a per-user manager daemon over an abstract Unix socket:
+ *
+ *   client → { pid, delay_ms }      daemon → 1-byte ack
+ *
+ * The daemon watches each held PID through a pidfd, takes the lock
+ * once some hold has lived for delay_ms, and drops it WAKE_LINGER_MS
+ * after the last hold is gone.  Concurrent and nested bionilux
+ * invocations therefore share a single wake lock.
+ *
+ * The first client to bind the socket name forks the daemon and hands
+ * it the already-listening socket, so there is no startup race.
+ */
+#define WAKE_SOCK_NAME		"wakelock"
+#define WAKE_LINGER_MS		2000
+#define WAKE_MAX_HOLDS		256
+#define WAKE_DELAY_ENV		"BIONILUX_WAKELOCK_DELAY"
+
+struct wake_req {
+	int32_t  pid;
+	uint32_t delay_ms;
+};
+
+struct wake_hold {
+	pid_t   pid;
+	int     pidfd;		/* -1 → poll with kill(pid, 0) */
+	int64_t until_ms;	/* lock wanted from this time on */
+};
+
+static int64_t now_ms(void)
+{
+	return (int64_t)(bl_now_ns() / 1000000);
+}
+
+/* Abstract socket address of the per-user daemon @name. */
+static socklen_t daemon_sock_addr(struct sockaddr_un *sun, const char *name)
+{
+	int n;
+
+	memset(sun, 0, sizeof(*sun));
+	sun->sun_family = AF_UNIX;
+	/* abstract namespace: leading NUL, no filesystem entry */
+	n = snprintf(sun->sun_path + 1, sizeof(sun->sun_path) - 1,
+		     "bionilux-%s-%u", name, (unsigned)getuid());
+	return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 +
+			   (size_t)n);
+}
+
+/*
+ * Abstract socket names have no permissions: anyone who can reach the
+ * namespace can connect to, or squat on, "bionilux-<name>-<uid>".
+ * Both ends of a daemon connection therefore check that the other end
+ * runs as the same user.
+ */
+static int daemon_peer_ok(int fd)
+{
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+
+	return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 &&
+	       cred.uid == getuid();
+}
+
+/*
+ * Start termux-wake-lock / termux-wake-unlock without waiting for it.
+ * Returns the command's PID, 0 if it is not installed, -1 on error.
+ */
+static pid_t start_wakelock_cmd(const char *cmd, int debug)
+{
+	char path[PATH_MAX];
+	pid_t pid;
+
+	snprintf(path, sizeof(path), "%s/bin/%s", get_prefix(), cmd);
+	if (access(path, X_OK) != 0) {
+		if (debug)
+			msg_warn("%s not found, skipping", cmd);
+		return 0;
+	}
+
+	pid = fork();
+	if (pid == 0) {
+		int fd = open("/dev/null", O_WRONLY);
+		if (fd >= 0) {
+			dup2(fd, STDOUT_FILENO);
+			dup2(fd, STDERR_FILENO);
+			close(fd);
+		}
+		execl(path, cmd, (char *)NULL);
+		_exit(127);
+	}
+	if (pid > 0 && debug)
+		msg_ok("%s started", cmd);
+	return pid;
+}
+
+static int hold_alive(const struct wake_hold *h, const struct pollfd *pfd)
+{
+	if (h->pidfd >= 0)
+		return !(pfd->revents & (POLLIN | POLLHUP | POLLERR));
+	return kill(h->pid, 0) == 0 || errno == EPERM;
+}
+
+/*
+ * Accept one hold request on @lfd.  The ack is written before the
+ * hold is processed so clients are never delayed by the daemon.
+ * Returns 0 once nothing is pending.
+ */
+static int wake_accept(int lfd, struct wake_hold *holds, size_t *nholds)
+{
+	struct timeval tv = { .tv_sec = 1 };
+	struct wake_req req;
+	char ack = 1;
+	int cfd;
+
+	cfd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+	if (cfd < 0)
+		return 0;
+	if (!daemon_peer_ok(cfd)) {
+		close(cfd);
+		return 1;
+	}
+
+	/* a client stopped before writing must not wedge every launch */
+	setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	if (read(cfd, &req, sizeof(req)) != (ssize_t)sizeof(req) ||
+	    req.pid <= 0 || *nholds >= WAKE_MAX_HOLDS)
+		ack = 0;
+	if (write(cfd, &ack, 1) != 1) { /* client gave up, still hold */ }
+	close(cfd);
+	if (!ack)
+		return 1;
+
+	struct wake_hold *h = &holds[(*nholds)++];
+
+	h->pid      = (pid_t)req.pid;
+	h->pidfd    = (int)syscall(__NR_pidfd_open, h->pid, 0);
+	h->until_ms = now_ms() + req.delay_ms;
+
+	if (h->pidfd < 0 && errno == ESRCH) /* already gone */
+		(*nholds)--;
+	return 1;
+}
+
+/*
+ * Daemon main loop.  Owns @lfd (listening, non-blocking) and never
+ * returns.  At most one wake-lock command runs at a time; state
+ * changes requested meanwhile are applied once it finishes.
+ */
+__attribute__((noreturn))
+static void wake_daemon(int lfd, int debug)
+{
+	static struct wake_hold holds[WAKE_MAX_HOLDS];
+	struct pollfd pfds[WAKE_MAX_HOLDS + 1];
+	size_t nholds = 0;
+	int held = 0;
+	pid_t cmd = 0;
+	int64_t idle_since = now_ms();
+
+	/* the client that started us connects right after the fork */
+	pfds[0] = (struct pollfd){ .fd = lfd, .events = POLLIN };
+	poll(pfds, 1, 1000);
+
+	for (;;) {
+		int64_t now = now_ms(), next = -1;
+		int want = 0;
+
+		/* reap a finished wake-lock command */
+		if (cmd > 0 && waitpid(cmd, NULL, WNOHANG) != 0)
+			cmd = 0;
+
+		for (size_t i = 0; i < nholds; i++) {
+			if (holds[i].until_ms <= now) {
+				want = 1;
+			} else {
+				int64_t wait = holds[i].until_ms - now;
+				if (next < 0 || wait < next)
+					next = wait;
+			}
+		}
+		if (nholds)
+			idle_since = now;
+
+		if (!want && held && now - idle_since < WAKE_LINGER_MS) {
+			want = 1;	/* linger: avoid lock/unlock churn */
+			int64_t wait = WAKE_LINGER_MS - (now - idle_since);
+			if (next < 0 || wait < next)
+				next = wait;
+		}
+
+		if (!cmd && want != held) {
+			cmd = start_wakelock_cmd(want ? "termux-wake-lock"
+						      : "termux-wake-unlock",
+						 debug);
+			held = want;
+		}
+
+		if (!nholds && !held && !cmd) {
+			/*
+			 * Idle: take over anything still queued, else
+			 * exit.  Clients that lose this race see no ack
+			 * and simply start a new daemon.
+			 */
+			wake_accept(lfd, holds, &nholds);
+			if (!nholds)
+				_exit(0);
+			continue;
+		}
+
+		if (cmd > 0 && (next < 0 || next > 50))
+			next = 50;	/* poll for the command's exit */
+
+		pfds[0] = (struct pollfd){ .fd = lfd, .events = POLLIN };
+		for (size_t i = 0; i < nholds; i++)
+			pfds[i + 1] = (struct pollfd){
+				.fd = holds[i].pidfd, .events = POLLIN,
+			};
+		for (size_t i = 0; i < nholds; i++)
+			if (holds[i].pidfd < 0 && (next < 0 || next > 1000))
+				next = 1000;
+
+		if (poll(pfds, nholds + 1, (int)next) < 0 && errno != EINTR)
+			_exit(1);
+
+		/* drop finished holds (compact in place) */
+		size_t j = 0;
+		for (size_t i = 0; i < nholds; i++) {
+			if (hold_alive(&holds[i], &pfds[i + 1])) {
+				holds[j++] = holds[i];
+				continue;
+			}
+			if (holds[i].pidfd >= 0)
+				close(holds[i].pidfd);
+		}
+		nholds = j;
+
+		if (pfds[0].revents & POLLIN)
+			while (nholds < WAKE_MAX_HOLDS &&
+			       wake_accept(lfd, holds, &nholds))
+				;
+	}
+}
+
+/*
+ * Close every descriptor above stderr except @keep.  A daemon forked
+ * from a launch would otherwise hold the caller's pipes, the event
+ * ring and the iotrace log open for as long as it lives.
+ */
+static void close_inherited(int keep)
+{
+	DIR *d = opendir("/proc/self/fd");
+	struct dirent *de;
+
+	if (!d)
+		return;
+	while ((de = readdir(d)) != NULL) {
+		int fd;
+
+		if (de->d_name[0] < '0' || de->d_name[0] > '9')
+			continue;
+		fd = atoi(de->d_name);
+		if (fd > STDERR_FILENO && fd != keep && fd != dirfd(d))
+			close(fd);
+	}
+	closedir(d);
+}
+
+/*
+ * Bind the manager's socket name.  On success we are the first
+ * client: fork the daemon with the listening socket and return 0.
+ * Returns -1 if a daemon already owns the name.
+ */
+static int wake_daemon_start(int debug)
+{
+	struct sockaddr_un sun;
+	socklen_t len = daemon_sock_addr(&sun, WAKE_SOCK_NAME);
+	pid_t pid;
+	int lfd;
+
+	lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (lfd < 0)
+		return -1;
+	if (bind(lfd, (struct sockaddr *)&sun, len) != 0 ||
+	    listen(lfd, 128) != 0) {
+		close(lfd);
+		return -1;
+	}
+
+	pid = fork();
+	if (pid == 0) {
+		setsid();
+		if (fork() != 0)
+			_exit(0);
+
+		/* $(bionilux -d ...) must not wait for the daemon */
+		int fd = open("/dev/null", O_RDWR);
+		if (fd >= 0) {
+			dup2(fd, STDIN_FILENO);
+			dup2(fd, STDOUT_FILENO);
+			dup2(fd, STDERR_FILENO);
+			close(fd);
+		}
+		close_inherited(lfd);
+		if (chdir("/") < 0) { /* keep whatever directory we had */ }
+		signal(SIGPIPE, SIG_IGN);
+		for (size_t i = 0; i < ARRAY_SIZE(forwarded_sigs); i++)
+			signal(forwarded_sigs[i], SIG_IGN);
+		wake_daemon(lfd, debug);
+	}
+
+	close(lfd);
+	if (pid > 0)
+		waitpid(pid, NULL, 0);
+	return pid > 0 ? 0 : -1;
+}
+
+/*
+ * Register a wake-lock hold for the lifetime of @pid.  Costs a
+ * connect/write/read round trip; the lock itself is taken by the
+ * daemon in the background.
+ */
+static void wake_lock_hold(pid_t pid, int debug)
+{
+	struct wake_req req = { .pid = (int32_t)pid };
+	struct timeval tv = { .tv_sec = 2 };
+	const char *delay = getenv(WAKE_DELAY_ENV);
+	struct sockaddr_un sun;
+	socklen_t len = daemon_sock_addr(&sun, WAKE_SOCK_NAME);
+
+	if (delay && *delay)
+		req.delay_ms = (uint32_t)strtoul(delay, NULL, 10);
+
+	for (int attempt = 0; attempt < 3; attempt++) {
+		char ack = 0;
+		int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+		if (fd < 0)
+			return;
+
+		if (connect(fd, (struct sockaddr *)&sun, len) != 0) {
+			close(fd);
+			/* nobody listening → become the first client */
+			wake_daemon_start(debug);
+			continue;
+		}
+		if (!daemon_peer_ok(fd)) {
+			close(fd);
+			msg_warn("wake lock: socket owned by another user, "
+				 "not used");
+			return;
+		}
+		/* never hang the launch on a stalled daemon */
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+		if (write(fd, &req, sizeof(req)) == (ssize_t)sizeof(req) &&
+		    read(fd, &ack, 1) == 1 && ack) {
+			close(fd);
+			if (debug)
+				msg_info("wake lock: hold registered for "
+					 "pid %d", (int)pid);
+			return;
+		}
+		close(fd);	/* daemon was exiting — retry */
+	}
+
+	if (debug)
+		msg_warn("wake lock: manager unavailable");
+}
+
+/* ── CPU placement ───────────────────────────────────────────────── */
+
+/*
+ * --cpus=big|little|all|LIST pins bionilux, and so every process it
+ * starts, to a set of cores before anything is exec'd; benchmarks then
+ * stop migrating between clusters run to run.  Clusters are told apart
+ * by each core's cpu_capacity (the scheduler's own view on arm64) or,
+ * without it, cpufreq/cpuinfo_max_freq.  "little" is the slowest
+ * cluster and "big" every other core, so on tri-cluster SoCs it spans
+ * the prime and performance cores.  Offline cores stay in the mask: the
+ * kernel skips them until they are brought back.
+ *
+ * --threads-hint exports the size of that set as OMP_NUM_THREADS and
+ * BOX64_MAXCPU (unless already set), for programs that size thread
+ * pools from /proc/cpuinfo or the online count instead of their
+ * affinity mask.
+ */
+
+/* @cpu's relative speed: cpu_capacity, else max frequency, else 0 */
+static unsigned long cpu_score(int cpu)
+{
+	static const char *const files[] = {
+		"cpu_capacity", "cpufreq/cpuinfo_max_freq",
+	};
+	char path[96], buf[32];
+
+	for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+		ssize_t n;
+		int fd;
+
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/%s",
+			 cpu, files[i]);
+		fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			continue;
+		n = read(fd, buf, sizeof(buf) - 1);
+		close(fd);
+		if (n > 0) {
+			buf[n] = '\0';
+			return strtoul(buf, NULL, 10);
+		}
+	}
+	return 0;
+}
+
+/* Parse a list such as "0-3,6" into @set.  Returns 0 or -1. */
+static int cpus_parse_list(const char *spec, cpu_set_t *set)
+{
+	const char *p = spec;
+
+	CPU_ZERO(set);
+	while (*p) {
+		char *end;
+		unsigned long lo = strtoul(p, &end, 10), hi = lo;
+
+		if (end == p)
+			return -1;
+		if (*end == '-') {
+			p = end + 1;
+			hi = strtoul(p, &end, 10);
+			if (end == p || hi < lo)
+				return -1;
+		}
+		if (hi >= CPU_SETSIZE)
+			return -1;
+		for (unsigned long c = lo; c <= hi; c++)
+			CPU_SET((int)c, set);
+		if (*end == ',')
+			end++;
+		else if (*end)
+			return -1;
+		p = end;
+	}
+	return CPU_COUNT(set) ? 0 : -1;
+}
+
+/* Resolve @spec (big, little, all or a list) into @set. */
+static int cpus_resolve(const char *spec, cpu_set_t *set, int debug)
+{
+	unsigned long score[CPU_SETSIZE], lo = ULONG_MAX;
+	long n = sysconf(_SC_NPROCESSORS_CONF);
+	int big = !strcmp(spec, "big"), little = !strcmp(spec, "little");
+
+	if (!big && !little && strcmp(spec, "all") != 0)
+		return cpus_parse_list(spec, set);
+
+	if (n < 1 || n > CPU_SETSIZE)
+		n = n < 1 ? 1 : CPU_SETSIZE;
+	for (int c = 0; c < n; c++) {
+		score[c] = cpu_score(c);
+		if (score[c] < lo)
+			lo = score[c];
+	}
+
+	CPU_ZERO(set);
+	for (int c = 0; c < n; c++)
+		if ((!big && !little) || (little && score[c] == lo) ||
+		    (big && score[c] > lo))
+			CPU_SET(c, set);
+
+	/* one cluster: every core is both big and little */
+	if (!CPU_COUNT(set))
+		for (int c = 0; c < n; c++)
+			CPU_SET(c, set);
+
+	if (debug)
+		for (int c = 0; c < n; c++)
+			msg_info("cpu%d: score %lu%s", c, score[c],
+				 CPU_ISSET(c, set) ? " (selected)" : "");
+	return 0;
+}
+
+/*
+ * Apply --cpus @spec (NULL: keep the inherited mask) and, with @hint,
+ * export the thread-count hints.  Returns 0, or -1 after reporting.
+ */
+static int cpus_apply(const char *spec, int hint, int debug)
+{
+	cpu_set_t set;
+	char count[16];
+
+	if (spec) {
+		if (cpus_resolve(spec, &set, debug) != 0) {
+			msg_err("--cpus: not big, little, all or a CPU list: %s",
+				spec);
+			return -1;
+		}
+		if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+			msg_err("--cpus %s: %s", spec, strerror(errno));
+			return -1;
+		}
+	}
+	if (!hint)
+		return 0;
+
+	if (sched_getaffinity(0, sizeof(set), &set) != 0)
+		return 0;
+	snprintf(count, sizeof(count), "%d", CPU_COUNT(&set));
+	setenv("OMP_NUM_THREADS", count, 0);
+	setenv("BOX64_MAXCPU", count, 0);
+	if (debug)
+		msg_info("threads hint: %s", count);
+	return 0;
+}
+
+/* ── process-tree statistics ─────────────────────────────────────── */
+
+/*
+ * --stats keeps bionilux resident as a child subreaper, so descendants
+ * orphaned by their parents are re-parented to and reaped by us, and
+ * prints per-process and whole-tree resource usage when the program
+ * exits.
+ *
+ * The totals are exact: getrusage(RUSAGE_CHILDREN) covers every process
+ * in the tree that was waited for, and storage I/O is its
+ * ru_inblock/ru_oublock.  Per-process rows come from sampling each
+ * descendant's /proc/<pid>/{stat,status,smaps_rollup,io} every
+ * STATS_SAMPLE_MS, plus one last read of every process we reap
+ * ourselves while it is still a zombie (waitid(WNOWAIT)).  A process
+ * its own parent reaps keeps the figures of its last sample and is
+ * reported as exited; one that starts and ends between two samples and
+ * is not our child only counts towards the totals.  PSS only exists while a process is
+ * alive, so rows show the peak sampled and the total is the peak of
+ * the sampled sum.
+ */
+#define STATS_SAMPLE_MS		100
+#define STATS_TEXT_ROWS		20
+
+struct stats_proc {
+	pid_t    pid, ppid;
+	uint64_t start;			/* starttime, clock ticks after boot */
+	uint64_t last_ns;		/* CLOCK_BOOTTIME when last read */
+	uint64_t utime, stime;		/* clock ticks */
+	uint64_t majflt, vcsw, ivcsw;
+	uint64_t hwm_kb, pss_kb;	/* peak RSS, peak sampled PSS */
+	uint64_t rd, wr;		/* bytes from/to storage */
+	int      reaped;		/* final values, read as a zombie */
+	int      ended;			/* gone, reaped by its own parent */
+	char     name[64];
+};
+
+struct stats {
+	struct stats_proc *p;
+	size_t   n, cap;
+	size_t   running;		/* descendants alive in the last sample */
+	uint64_t peak_pss_kb;
+	uint64_t t0_ns;
+	long     hz;
+};
+
+static uint64_t boot_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_BOOTTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Read /proc/@pid/@file into @buf, NUL-terminated.  -1 if it is gone. */
+static ssize_t proc_read(pid_t pid, const char *file, char *buf, size_t size)
+{
+	char path[64];
+	size_t len = 0;
+	ssize_t n;
+	int fd;
+
+	snprintf(path, sizeof(path), "/proc/%d/%s", (int)pid, file);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	while (len < size - 1 &&
+	       ((n = read(fd, buf + len, size - 1 - len)) > 0 ||
+		(n < 0 && errno == EINTR)))
+		if (n > 0)
+			len += (size_t)n;
+	close(fd);
+	buf[len] = '\0';
+	return (ssize_t)len;
+}
+
+/* Value of the "@key <n>" line in a /proc key-value file, else 0. */
+static uint64_t proc_field(const char *buf, const char *key)
+{
+	size_t klen = strlen(key);
+
+	for (const char *p = buf; p; p = strchr(p, '\n')) {
+		if (*p == '\n')
+			p++;
+		if (!strncmp(p, key, klen))
+			return strtoull(p + klen, NULL, 10);
+	}
+	return 0;
+}
+
+/* ppid, major faults, CPU ticks and start time from /proc/@pid/stat. */
+static int stats_read_stat(pid_t pid, struct stats_proc *sp)
+{
+	char buf[1024], *p;
+	unsigned long long majflt, utime, stime, start;
+	int ppid;
+
+	if (proc_read(pid, "stat", buf, sizeof(buf)) < 0 ||
+	    !(p = strrchr(buf, ')')))
+		return -1;
+
+	/* state ppid … majflt(12) … utime(14) stime(15) … starttime(22) */
+	if (sscanf(p + 2, "%*c %d %*s %*s %*s %*s %*s %*s %*s %llu %*s "
+		   "%llu %llu %*s %*s %*s %*s %*s %*s %llu",
+		   &ppid, &majflt, &utime, &stime, &start) != 5)
+		return -1;
+
+	sp->pid    = pid;
+	sp->ppid   = ppid;
+	sp->majflt = majflt;
+	sp->utime  = utime;
+	sp->stime  = stime;
+	sp->start  = start;
+
+	if (!sp->name[0]) {
+		char *b = strchr(buf, '(');
+
+		if (b && b < p)
+			snprintf(sp->name, sizeof(sp->name), "%.*s",
+				 (int)(p - b - 1), b + 1);
+	}
+	return 0;
+}
+
+/*
+ * Name @pid by what the user ran: for "ld-linux… --argv0 NAME …" that
+ * is NAME, for "box64 PROG" PROG, else argv[0], all as basenames.
+ */
+static void stats_name(pid_t pid, char *out, size_t size)
+{
+	char buf[4096];
+	ssize_t len = proc_read(pid, "cmdline", buf, sizeof(buf));
+	const char *arg = buf, *end = buf + (len > 0 ? len : 0);
+	const char *base;
+
+	if (len <= 0)
+		return;
+
+	base = strrchr(arg, '/') ? strrchr(arg, '/') + 1 : arg;
+	if (!strncmp(base, "ld-linux", 8)) {
+		for (const char *a = arg; a < end; a += strlen(a) + 1)
+			if (!strcmp(a, "--argv0") && a + strlen(a) + 1 < end) {
+				arg = a + strlen(a) + 1;
+				break;
+			}
+	} else if (!strcmp(base, "box64") && arg + strlen(arg) + 1 < end) {
+		arg += strlen(arg) + 1;
+	}
+
+	base = strrchr(arg, '/') ? strrchr(arg, '/') + 1 : arg;
+	if (*base)
+		snprintf(out, size, "%s", base);
+}
+
+static struct stats_proc *stats_slot(struct stats *st,
+				     const struct stats_proc *key)
+{
+	for (size_t i = st->n; i-- > 0;)
+		if (st->p[i].pid == key->pid && st->p[i].start == key->start)
+			return &st->p[i];
+
+	if (st->n == st->cap) {
+		size_t cap = st->cap ? st->cap * 2 : 64;
+		struct stats_proc *p = realloc(st->p, cap * sizeof(*p));
+
+		if (!p)
+			return NULL;
+		st->p = p;
+		st->cap = cap;
+	}
+	memset(&st->p[st->n], 0, sizeof(st->p[0]));
+	return &st->p[st->n++];
+}
+
+/*
+ * Read @pid's counters into its row.  @zombie: the final read of a
+ * process we are about to reap.  Returns its PSS in kB.
+ */
+static uint64_t stats_read(struct stats *st, pid_t pid, int zombie)
+{
+	struct stats_proc cur = { 0 }, *sp;
+	char buf[4096];
+	uint64_t pss = 0;
+
+	if (stats_read_stat(pid, &cur) != 0 || !(sp = stats_slot(st, &cur)))
+		return 0;
+
+	/* re-read while alive: a forked child may have exec'd since */
+	if (!sp->pid)
+		memcpy(sp->name, cur.name, sizeof(sp->name));
+	if (!zombie)
+		stats_name(pid, sp->name, sizeof(sp->name));
+	sp->pid     = cur.pid;
+	sp->ppid    = cur.ppid;
+	sp->start   = cur.start;
+	sp->majflt  = cur.majflt;
+	sp->utime   = cur.utime;
+	sp->stime   = cur.stime;
+	sp->last_ns = boot_ns();
+	sp->reaped  = zombie;
+
+	if (proc_read(pid, "status", buf, sizeof(buf)) > 0) {
+		uint64_t hwm = proc_field(buf, "VmHWM:");
+
+		sp->vcsw  = proc_field(buf, "voluntary_ctxt_switches:");
+		sp->ivcsw = proc_field(buf, "nonvoluntary_ctxt_switches:");
+		if (hwm > sp->hwm_kb)
+			sp->hwm_kb = hwm;
+	}
+	if (!zombie && proc_read(pid, "smaps_rollup", buf, sizeof(buf)) > 0) {
+		pss = proc_field(buf, "Pss:");
+		if (pss > sp->pss_kb)
+			sp->pss_kb = pss;
+	}
+	if (proc_read(pid, "io", buf, sizeof(buf)) > 0) {
+		sp->rd = proc_field(buf, "read_bytes:");
+		sp->wr = proc_field(buf, "write_bytes:");
+	}
+	return pss;
+}
+
+/* Sample every live descendant of ours, found by walking /proc. */
+static void stats_sample(struct stats *st)
+{
+	struct { pid_t pid, ppid; int mine; } *e = NULL;
+	size_t n = 0, cap = 0;
+	uint64_t pss = 0;
+	struct dirent *de;
+	DIR *d = opendir("/proc");
+	pid_t self = getpid();
+	int grew;
+
+	if (!d)
+		return;
+	while ((de = readdir(d))) {
+		struct stats_proc sp = { 0 };
+		pid_t pid = (pid_t)atoi(de->d_name);
+
+		if (pid <= 0 || pid == self || stats_read_stat(pid, &sp) != 0)
+			continue;
+		if (n == cap) {
+			void *p = realloc(e, (cap = cap ? cap * 2 : 256) *
+					  sizeof(*e));
+			if (!p)
+				break;
+			e = p;
+		}
+		e[n].pid  = pid;
+		e[n].ppid = sp.ppid;
+		e[n].mine = sp.ppid == self;
+		n++;
+	}
+	closedir(d);
+
+	/* mark descendants until a pass adds none */
+	do {
+		grew = 0;
+		for (size_t i = 0; i < n; i++) {
+			if (e[i].mine)
+				continue;
+			for (size_t j = 0; j < n; j++)
+				if (e[j].mine && e[j].pid == e[i].ppid) {
+					e[i].mine = grew = 1;
+					break;
+				}
+		}
+	} while (grew);
+
+	st->running = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (!e[i].mine)
+			continue;
+		pss += stats_read(st, e[i].pid, 0);
+		st->running++;
+	}
+	if (pss > st->peak_pss_kb)
+		st->peak_pss_kb = pss;
+	free(e);
+}
+
+/* Is the process of row @sp still running: there, same start, no zombie? */
+static int stats_alive(const struct stats_proc *sp)
+{
+	unsigned long long start;
+	char buf[1024], *p, state;
+
+	if (proc_read(sp->pid, "stat", buf, sizeof(buf)) < 0 ||
+	    !(p = strrchr(buf, ')')))
+		return 0;
+
+	/* state(3) … starttime(22) */
+	if (sscanf(p + 2, "%c %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s "
+		   "%*s %*s %*s %*s %*s %*s %*s %llu", &state, &start) != 2)
+		return 0;
+	return state != 'Z' && state != 'X' && start == sp->start;
+}
+
+/*
+ * Sort out, at the end, which rows are still running: a process that
+ * vanished since its last sample was reaped by its own parent.
+ */
+static void stats_settle(struct stats *st)
+{
+	st->running = 0;
+	for (size_t i = 0; i < st->n; i++) {
+		struct stats_proc *sp = &st->p[i];
+
+		if (sp->reaped)
+			continue;
+		sp->ended = !stats_alive(sp);
+		if (!sp->ended)
+			st->running++;
+	}
+}
+
+/* @bytes as "512B", "12.3K", "1.5M", … */
+static const char *stats_size(char *buf, size_t size, uint64_t bytes)
+{
+	static const char unit[] = "BKMGT";
+	double v = (double)bytes;
+	int u = 0;
+
+	while (v >= 1024 && u < 4) {
+		v /= 1024;
+		u++;
+	}
+	snprintf(buf, size, u ? "%.1f%c" : "%.0f%c", v, unit[u]);
+	return buf;
+}
+
+static int stats_cmp_cpu(const void *a, const void *b)
+{
+	const struct stats_proc *x = a, *y = b;
+	uint64_t cx = x->utime + x->stime, cy = y->utime + y->stime;
+
+	return (cx < cy) - (cx > cy);
+}
+
+static uint64_t stats_wall_ns(const struct stats *st,
+			      const struct stats_proc *sp)
+{
+	uint64_t start = sp->start * (1000000000ULL / (uint64_t)st->hz);
+
+	return sp->last_ns > start ? sp->last_ns - start : 0;
+}
+
+static void stats_json_str(FILE *f, const char *key, const char *val)
+{
+	char buf[PATH_MAX * 2];
+	size_t off = 0;
+
+	bl_json_put(buf, sizeof(buf) - 1, &off, val);
+	buf[off] = '\0';
+	fprintf(f, "\"%s\":\"%s\"", key, buf);
+}
+
+static void stats_report_json(FILE *f, const struct stats *st,
+			      const char *binary, int code,
+			      const struct rusage *ru, uint64_t wall)
+{
+	double ns_tick = 1e9 / (double)st->hz;
+
+	fputc('{', f);
+	stats_json_str(f, "command", binary);
+	fprintf(f, ",\"exit\":%d,\"wall_ns\":%llu,\"running\":%zu,"
+		"\"total\":{\"user_ns\":%llu,\"sys_ns\":%llu,"
+		"\"max_rss_kb\":%ld,\"peak_pss_kb\":%llu,"
+		"\"major_faults\":%ld,\"voluntary_ctxsw\":%ld,"
+		"\"involuntary_ctxsw\":%ld,\"read_bytes\":%llu,"
+		"\"write_bytes\":%llu},\"processes\":[",
+		code, (unsigned long long)wall, st->running,
+		(unsigned long long)ru->ru_utime.tv_sec * 1000000000ULL +
+		(unsigned long long)ru->ru_utime.tv_usec * 1000ULL,
+		(unsigned long long)ru->ru_stime.tv_sec * 1000000000ULL +
+		(unsigned long long)ru->ru_stime.tv_usec * 1000ULL,
+		ru->ru_maxrss, (unsigned long long)st->peak_pss_kb,
+		ru->ru_majflt, ru->ru_nvcsw, ru->ru_nivcsw,
+		(unsigned long long)ru->ru_inblock * 512ULL,
+		(unsigned long long)ru->ru_oublock * 512ULL);
+
+	for (size_t i = 0; i < st->n; i++) {
+		const struct stats_proc *sp = &st->p[i];
+
+		fprintf(f, "%s{\"pid\":%d,\"ppid\":%d,", i ? "," : "",
+			(int)sp->pid, (int)sp->ppid);
+		stats_json_str(f, "name", sp->name);
+		fprintf(f, ",\"wall_ns\":%llu,\"user_ns\":%.0f,"
+			"\"sys_ns\":%.0f,\"max_rss_kb\":%llu,"
+			"\"peak_pss_kb\":%llu,\"major_faults\":%llu,"
+			"\"voluntary_ctxsw\":%llu,\"involuntary_ctxsw\":%llu,"
+			"\"read_bytes\":%llu,\"write_bytes\":%llu,"
+			"\"exited\":%s}",
+			(unsigned long long)stats_wall_ns(st, sp),
+			(double)sp->utime * ns_tick,
+			(double)sp->stime * ns_tick,
+			(unsigned long long)sp->hwm_kb,
+			(unsigned long long)sp->pss_kb,
+			(unsigned long long)sp->majflt,
+			(unsigned long long)sp->vcsw,
+			(unsigned long long)sp->ivcsw,
+			(unsigned long long)sp->rd,
+			(unsigned long long)sp->wr,
+			sp->reaped || sp->ended ? "true" : "false");
+	}
+	fputs("]}\n", f);
+}
+
+static void stats_report_text(FILE *f, const struct stats *st,
+			      const char *binary, int code,
+			      const struct rusage *ru, uint64_t wall)
+{
+	char a[16], b[16], c[16], d[16];
+	double tick = 1.0 / (double)st->hz;
+	size_t rows = st->n < STATS_TEXT_ROWS ? st->n : STATS_TEXT_ROWS;
+
+	fprintf(f, "\nbionilux: %s exited %d after %.3fs — %zu processes "
+		"sampled", binary, code, (double)wall / 1e9, st->n);
+	if (st->running)
+		fprintf(f, ", %zu still running", st->running);
+	fprintf(f, "\n\n%7s %7s %-16s %9s %9s %9s %8s %8s %7s %8s %8s %8s\n",
+		"pid", "ppid", "command", "wall", "user", "sys", "maxrss",
+		"pss", "majflt", "ctxsw", "read", "write");
+
+	for (size_t i = 0; i < rows; i++) {
+		const struct stats_proc *sp = &st->p[i];
+
+		fprintf(f, "%7d %7d %-16.16s %8.3fs %8.3fs %8.3fs %8s %8s "
+			"%7llu %8llu %8s %8s\n",
+			(int)sp->pid, (int)sp->ppid, sp->name,
+			(double)stats_wall_ns(st, sp) / 1e9,
+			(double)sp->utime * tick, (double)sp->stime * tick,
+			stats_size(a, sizeof(a), sp->hwm_kb * 1024),
+			stats_size(b, sizeof(b), sp->pss_kb * 1024),
+			(unsigned long long)sp->majflt,
+			(unsigned long long)(sp->vcsw + sp->ivcsw),
+			stats_size(c, sizeof(c), sp->rd),
+			stats_size(d, sizeof(d), sp->wr));
+	}
+	if (st->n > rows)
+		fprintf(f, "%7s %7s … %zu more (--stats=json lists all)\n",
+			"", "", st->n - rows);
+
+	fprintf(f, "%7s %7s %-16s %8.3fs %8.3fs %8.3fs %8s %8s %7ld %8ld "
+		"%8s %8s\n", "", "", "total", (double)wall / 1e9,
+		(double)ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1e6,
+		(double)ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1e6,
+		stats_size(a, sizeof(a), (uint64_t)ru->ru_maxrss * 1024),
+		stats_size(b, sizeof(b), st->peak_pss_kb * 1024),
+		ru->ru_majflt, ru->ru_nvcsw + ru->ru_nivcsw,
+		stats_size(c, sizeof(c), (uint64_t)ru->ru_inblock * 512),
+		stats_size(d, sizeof(d), (uint64_t)ru->ru_oublock * 512));
+	fprintf(f, "\n(total maxrss is the largest single process, "
+		"pss the peak of the whole tree)\n");
+}
+
+/* Print the summary for the tree of @binary that exited with @code. */
+static void stats_report(struct stats *st, const char *binary, int code,
+			 const launch_opts_t *o)
+{
+	uint64_t wall = bl_now_ns() - st->t0_ns;
+	struct rusage ru;
+	FILE *f = stderr;
+
+	getrusage(RUSAGE_CHILDREN, &ru);
+	stats_settle(st);
+	qsort(st->p, st->n, sizeof(*st->p), stats_cmp_cpu);
+
+	if (o->stats_file && !(f = fopen(o->stats_file, "we"))) {
+		msg_err("--stats-file %s: %s", o->stats_file, strerror(errno));
+		return;
+	}
+	if (o->stats == STATS_JSON)
+		stats_report_json(f, st, binary, code, &ru, wall);
+	else
+		stats_report_text(f, st, binary, code, &ru, wall);
+	if (f != stderr)
+		fclose(f);
+}
+
+/* ── exec event ring ─────────────────────────────────────────────── */
+
+/*
+ * --record-execs FILE creates the ring of bionilux_events.h before
+ * anything is planned, so every descendant inherits it and each
+ * preload appends its exec and spawn decisions.  bionilux records its
+ * own decision as the root of the tree and writes the ring out as JSON
+ * lines once the program exits; records made by processes that outlive
+ * bionilux are lost.  A bionilux started inside a recorded tree
+ * records into the inherited ring.  bionilux_graph.py --events renders
+ * the file as a process tree or a timeline.
+ */
+#define EVENTS_MIN_FD		200	/* like the preload memfd */
+
+/* decision of the plan being launched, recorded by run_child() */
+static struct bl_event *g_launch_ev;
+
+/* Create the ring and export it to every process started from now on. */
+static int events_create(void)
+{
+#ifdef __NR_memfd_create
+	struct bl_events_hdr hdr = {
+		.magic = BL_EVENTS_MAGIC, .version = BL_EVENTS_VERSION,
+		.nslots = BL_EVENTS_SLOTS, .slot_size = sizeof(struct bl_event),
+	};
+	size_t size = bl_events_size(BL_EVENTS_SLOTS);
+	char fdstr[16];
+	void *map;
+	int fd, hi;
+
+	fd = (int)syscall(__NR_memfd_create, "bionilux-events", 0);
+	if (fd < 0)
+		return -1;
+	hi = fcntl(fd, F_DUPFD, EVENTS_MIN_FD);
+	close(fd);
+	if (hi < 0)
+		return -1;
+
+	if (ftruncate(hi, (off_t)size) != 0 ||
+	    (map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			hi, 0)) == MAP_FAILED) {
+		close(hi);
+		return -1;
+	}
+	memcpy(map, &hdr, sizeof(hdr));
+	bl_events = map;
+
+	snprintf(fdstr, sizeof(fdstr), "%d", hi);
+	return setenv(BL_EVENTS_ENV, fdstr, 1);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/*
+ * Record the decision @ev as run by @child.  A batch plan reused for
+ * later jobs decides nothing new, so those are stamped with the time
+ * they start and no decision latency.
+ */
+static void events_launch(struct bl_event *ev, pid_t child)
+{
+	if (!bl_events || !ev)
+		return;
+
+	if (!ev->ts_ns)
+		ev->ts_ns = bl_now_ns();
+	ev->pid = (int32_t)getpid();
+	ev->ppid = (int32_t)getppid();
+	ev->child = (int32_t)child;
+	bl_event_put(ev);
+	ev->ts_ns = 0;
+	ev->decide_ns = 0;
+}
+
+/* Write every record still in the ring to @path as JSON lines. */
+static int events_dump(const char *path)
+{
+	uint64_t head = __atomic_load_n(&bl_events->head, __ATOMIC_ACQUIRE);
+	uint64_t first = head > BL_EVENTS_SLOTS ? head - BL_EVENTS_SLOTS : 0;
+	unsigned long long n = 0, dropped = first;
+	struct bl_event ev;
+	char p[sizeof(ev.path) * 6], x[sizeof(ev.exec) * 6];
+	FILE *f;
+
+	f = fopen(path, "we");
+	if (!f) {
+		msg_err("--record-execs %s: %s", path, strerror(errno));
+		return -1;
+	}
+
+	for (uint64_t t = first; t < head; t++) {
+		size_t pl = 0, xl = 0;
+
+		if (bl_event_get(bl_events, t, &ev) != 0) {
+			dropped++;
+			continue;
+		}
+		ev.path[sizeof(ev.path) - 1] = ev.exec[sizeof(ev.exec) - 1] = 0;
+		bl_json_put(p, sizeof(p) - 1, &pl, ev.path);
+		bl_json_put(x, sizeof(x) - 1, &xl, ev.exec);
+		p[pl] = x[xl] = '\0';
+
+		fprintf(f, "{\"seq\":%llu,\"ts_ns\":%llu,\"decide_ns\":%u,"
+			"\"hook\":\"%s\",\"pid\":%d,\"ppid\":%d,\"child\":%d,"
+			"\"action\":\"%s\",\"glibc\":%d,\"errno\":%d,"
+			"\"path\":\"%s\",\"exec\":\"%s\"}\n",
+			(unsigned long long)t, (unsigned long long)ev.ts_ns,
+			ev.decide_ns, bl_event_hook_name(ev.hook), ev.pid,
+			ev.ppid, ev.child, bl_event_action_name(ev.action),
+			ev.glibc, ev.err, p, x);
+		n++;
+	}
+	fprintf(f, "{\"bionilux_events\":%d,\"records\":%llu,"
+		"\"dropped\":%llu}\n", BL_EVENTS_VERSION, n, dropped);
+
+	if (fclose(f) != 0) {
+		msg_err("--record-execs %s: %s", path, strerror(errno));
+		return -1;
+	}
+	if (dropped)
+		msg_warn("record-execs: %llu of %llu events lost (ring of %d)",
+			 dropped, (unsigned long long)head, BL_EVENTS_SLOTS);
+	return 0;
+}
+
+/* Finish --record-execs for a launch that ended with @rc. */
+static int events_finish(const launch_opts_t *o, int rc)
+{
+	if (o->record_execs && events_dump(o->record_execs) != 0 && !rc)
+		rc = 1;
+	return rc;
+}
+
+/* ── sampling profiler ───────────────────────────────────────────── */
+
+/*
+ * --profile FILE samples the program's user-space call stacks with
+ * perf_event_open(): CPU-clock events at PROFILE_HZ are attached to the
+ * child before it execs (enable_on_exec) and inherited by every thread
+ * and process it starts.  The kernel cannot share one ring buffer among
+ * inherited events, so like perf record there is one event and ring per
+ * CPU; bionilux drains them every STATS_SAMPLE_MS while it waits and
+ * replays their records in timestamp order, so a sample is always
+ * resolved against the mappings its process had at the time.  Stacks
+ * are the kernel's frame-pointer call chains.
+ *
+ * Profilers that go by /proc/<pid>/exe only ever see the glibc loader.
+ * Here every address is resolved through the mappings the kernel
+ * reports (PERF_RECORD_MMAP2), so the program's frames come from the
+ * real binary and library frames from the GLIBC_LIB files actually
+ * mapped, symbolised from their .symtab or .dynsym on first use.  The
+ * program is named after BIONILUX_ORIG_EXE and every process the loader
+ * starts after the first file the loader maps, not "ld-linux-aarch6".
+ * The result is written as folded stacks, one "process;outer;…;leaf
+ * count" line per distinct stack, for flamegraph.pl, inferno or
+ * speedscope.
+ */
+#define PROFILE_HZ		999
+#define PROFILE_PAGES		64	/* data pages per CPU, power of two */
+#define PROFILE_SLACK_NS	1000000	/* records may land this late */
+#define PROFILE_MAX_DEPTH	128
+#define PROF_NONE		UINT32_MAX
+
+struct prof_sym {
+	uint64_t    addr, size;
+	const char *name;		/* inside the file's mapping */
+};
+
+struct prof_file {
+	char            *path;
+	int              loaded;	/* symbols looked up (maybe none) */
+	void            *map;
+	size_t           len;
+	const Elf64_Phdr *phdr;
+	size_t           phnum;
+	struct prof_sym *syms;		/* sorted by address */
+	size_t           nsyms;
+};
+
+struct prof_map {
+	uint64_t start, end, pgoff;
+	uint32_t file;
+};
+
+struct prof_proc {
+	pid_t            pid;
+	uint32_t         name;		/* index into prof.names */
+	int              loader;	/* still named after the loader */
+	struct prof_map *maps;		/* later entries override earlier */
+	size_t           nmaps, cap;
+};
+
+struct prof_frame {
+	uint32_t file, sym;		/* PROF_NONE when unknown */
+};
+
+struct prof_stack {
+	uint64_t hash, count;
+	size_t   frame;			/* first of @depth in prof.frames */
+	uint32_t depth, name;
+};
+
+struct prof_pending {
+	uint64_t time, seq;
+	struct perf_event_header *rec;
+};
+
+struct profile {
+	int               *fd;		/* per CPU, -1 where unavailable */
+	unsigned char    **ring;	/* control page + PROFILE_PAGES */
+	unsigned           ncpu, active;
+	size_t             page;
+	int                clock;	/* timestamps are CLOCK_MONOTONIC */
+	struct prof_pending *pending;	/* drained, not yet replayed */
+	size_t             npending, pending_cap;
+	uint64_t           seq;
+	pid_t              root;
+	const char        *binary;
+	struct prof_file  *files;
+	size_t             nfiles, files_cap;
+	char             **names;
+	size_t             nnames, names_cap;
+	struct prof_proc  *procs;
+	size_t             nprocs, procs_cap;
+	struct prof_stack *stacks;
+	size_t             nstacks, stacks_cap;
+	uint32_t          *index;	/* stack hash table, entries + 1 */
+	size_t             index_size;
+	struct prof_frame *frames;
+	size_t             nframes, frames_cap;
+	uint64_t           samples, lost;
+};
+
+struct prof_sample {
+	uint64_t ip;
+	uint32_t pid, tid;
+	uint64_t time;
+	uint64_t nr;
+	uint64_t ips[];
+};
+
+struct prof_mmap2 {
+	uint32_t pid, tid;
+	uint64_t addr, len, pgoff;
+	uint32_t maj, min;
+	uint64_t ino, ino_generation;
+	uint32_t prot, flags;
+	char     filename[];
+};
+
+struct prof_comm {
+	uint32_t pid, tid;
+	char     comm[];
+};
+
+struct prof_fork {
+	uint32_t pid, ppid, tid, ptid;
+	uint64_t time;
+};
+
+/* Make room for element @n of the array *@arr holding *@cap of @size. */
+static int prof_grow(void **arr, size_t *cap, size_t n, size_t size)
+{
+	size_t c = *cap ? *cap * 2 : 64;
+	void *p;
+
+	if (n < *cap)
+		return 0;
+	p = realloc(*arr, c * size);
+	if (!p)
+		return -1;
+	*arr = p;
+	*cap = c;
+	return 0;
+}
+
+#define PROF_GROW(pf, arr, n) \
+	prof_grow((void **)&(pf)->arr, &(pf)->arr##_cap, (pf)->n, \
+		  sizeof(*(pf)->arr))
+
+static uint32_t prof_name(struct profile *pf, const char *s)
+{
+	for (size_t i = 0; i < pf->nnames; i++)
+		if (strcmp(pf->names[i], s) == 0)
+			return (uint32_t)i;
+	if (PROF_GROW(pf, names, nnames) != 0 ||
+	    !(pf->names[pf->nnames] = strdup(s)))
+		return PROF_NONE;
+	return (uint32_t)pf->nnames++;
+}
+
+static uint32_t prof_file(struct profile *pf, const char *path)
+{
+	for (size_t i = 0; i < pf->nfiles; i++)
+		if (strcmp(pf->files[i].path, path) == 0)
+			return (uint32_t)i;
+	if (PROF_GROW(pf, files, nfiles) != 0)
+		return PROF_NONE;
+	memset(&pf->files[pf->nfiles], 0, sizeof(pf->files[0]));
+	if (!(pf->files[pf->nfiles].path = strdup(path)))
+		return PROF_NONE;
+	return (uint32_t)pf->nfiles++;
+}
+
+static int prof_cmp_sym(const void *a, const void *b)
+{
+	const struct prof_sym *x = a, *y = b;
+
+	return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+/*
+ * Map @f and collect its function symbols: .symtab if it was not
+ * stripped, else .dynsym.  The mapping stays until the report is
+ * written, since the names point into it.
+ */
+static void prof_load(struct prof_file *f)
+{
+	const Elf64_Ehdr *eh;
+	const Elf64_Shdr *sh, *tab = NULL;
+	const Elf64_Sym *sym;
+	const char *strs;
+	struct stat st;
+	size_t n, strsz;
+	int fd;
+
+	f->loaded = 1;
+	fd = open(f->path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*eh) ||
+	    (f->map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+			   fd, 0)) == MAP_FAILED) {
+		f->map = NULL;
+		close(fd);
+		return;
+	}
+	close(fd);
+	f->len = (size_t)st.st_size;
+
+	eh = f->map;
+	if (memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 ||
+	    eh->e_ident[EI_CLASS] != ELFCLASS64 ||
+	    eh->e_phoff > f->len ||
+	    eh->e_phnum > (f->len - eh->e_phoff) / sizeof(Elf64_Phdr) ||
+	    eh->e_shoff > f->len ||
+	    eh->e_shnum > (f->len - eh->e_shoff) / sizeof(Elf64_Shdr))
+		return;
+	f->phdr = (const Elf64_Phdr *)((const char *)f->map + eh->e_phoff);
+	f->phnum = eh->e_phnum;
+
+	sh = (const Elf64_Shdr *)((const char *)f->map + eh->e_shoff);
+	for (size_t i = 0; i < eh->e_shnum; i++)
+		if (sh[i].sh_type == SHT_SYMTAB ||
+		    (sh[i].sh_type == SHT_DYNSYM && !tab))
+			tab = &sh[i];
+	if (!tab || tab->sh_link >= eh->e_shnum ||
+	    tab->sh_offset > f->len ||
+	    tab->sh_size > f->len - tab->sh_offset ||
+	    sh[tab->sh_link].sh_offset > f->len ||
+	    sh[tab->sh_link].sh_size > f->len - sh[tab->sh_link].sh_offset)
+		return;
+
+	sym = (const Elf64_Sym *)((const char *)f->map + tab->sh_offset);
+	n = tab->sh_size / sizeof(*sym);
+	strs = (const char *)f->map + sh[tab->sh_link].sh_offset;
+	strsz = sh[tab->sh_link].sh_size;
+
+	f->syms = calloc(n ? n : 1, sizeof(*f->syms));
+	if (!f->syms)
+		return;
+	for (size_t i = 0; i < n; i++) {
+		unsigned type = ELF64_ST_TYPE(sym[i].st_info);
+
+		if ((type != STT_FUNC && type != STT_GNU_IFUNC) ||
+		    sym[i].st_shndx == SHN_UNDEF || !sym[i].st_value ||
+		    sym[i].st_name >= strsz ||
+		    !memchr(strs + sym[i].st_name, '\0',
+			    strsz - sym[i].st_name))
+			continue;
+		f->syms[f->nsyms++] = (struct prof_sym){
+			sym[i].st_value, sym[i].st_size,
+			strs + sym[i].st_name,
+		};
+	}
+	qsort(f->syms, f->nsyms, sizeof(*f->syms), prof_cmp_sym);
+}
+
+/* Symbol of @f containing file offset @off, or PROF_NONE. */
+static uint32_t prof_symbol(struct prof_file *f, uint64_t off)
+{
+	uint64_t va = 0;
+	size_t lo = 0, hi;
+	int found = 0;
+
+	if (!f->loaded)
+		prof_load(f);
+
+	for (size_t i = 0; i < f->phnum && !found; i++) {
+		const Elf64_Phdr *ph = &f->phdr[i];
+
+		if (ph->p_type == PT_LOAD && off >= ph->p_offset &&
+		    off - ph->p_offset < ph->p_filesz) {
+			va = off - ph->p_offset + ph->p_vaddr;
+			found = 1;
+		}
+	}
+	if (!found || !f->nsyms)
+		return PROF_NONE;
+
+	/* last symbol starting at or below @va */
+	hi = f->nsyms;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (f->syms[mid].addr <= va)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (!lo || va - f->syms[lo - 1].addr >= f->syms[lo - 1].size)
+		return PROF_NONE;
+	return (uint32_t)(lo - 1);
+}
+
+static struct prof_proc *prof_proc(struct profile *pf, pid_t pid)
+{
+	struct prof_proc *p;
+
+	for (size_t i = pf->nprocs; i-- > 0;)
+		if (pf->procs[i].pid == pid)
+			return &pf->procs[i];
+	if (PROF_GROW(pf, procs, nprocs) != 0)
+		return NULL;
+	p = &pf->procs[pf->nprocs++];
+	memset(p, 0, sizeof(*p));
+	p->pid = pid;
+	p->name = PROF_NONE;
+	return p;
+}
+
+/* A process image starts: @comm is the name the kernel gave it. */
+static void prof_exec(struct profile *pf, const struct prof_comm *c)
+{
+	const char *loader = strrchr(GLIBC_LOADER, '/') + 1;
+	struct prof_proc *p = prof_proc(pf, (pid_t)c->pid);
+
+	if (!p)
+		return;
+	p->nmaps = 0;
+	p->loader = strncmp(c->comm, loader, 15) == 0;
+	if ((pid_t)c->pid == pf->root && pf->binary) {
+		const char *base = strrchr(pf->binary, '/');
+
+		p->name = prof_name(pf, base ? base + 1 : pf->binary);
+		p->loader = 0;
+	} else {
+		p->name = prof_name(pf, c->comm);
+	}
+}
+
+/* A new process (not thread) starts as a copy of its parent. */
+static void prof_fork(struct profile *pf, const struct prof_fork *f)
+{
+	struct prof_proc *p, *parent;
+	size_t pi;
+
+	if (f->pid == f->ppid || !(parent = prof_proc(pf, (pid_t)f->ppid)))
+		return;
+	pi = (size_t)(parent - pf->procs);
+	if (!(p = prof_proc(pf, (pid_t)f->pid)))
+		return;
+	parent = &pf->procs[pi];
+
+	p->name = parent->name;
+	p->loader = parent->loader;
+	p->nmaps = 0;
+	if (parent->nmaps > p->cap) {
+		struct prof_map *m = realloc(p->maps,
+					     parent->nmaps * sizeof(*m));
+
+		if (!m)
+			return;
+		p->maps = m;
+		p->cap = parent->nmaps;
+	}
+	if (parent->nmaps)
+		memcpy(p->maps, parent->maps, parent->nmaps * sizeof(*p->maps));
+	p->nmaps = parent->nmaps;
+}
+
+static void prof_mmap(struct profile *pf, const struct prof_mmap2 *m)
+{
+	struct prof_proc *p = prof_proc(pf, (pid_t)m->pid);
+	uint32_t file = prof_file(pf, m->filename);
+
+	if (!p || file == PROF_NONE)
+		return;
+
+	/* the first file the loader maps is the program it runs */
+	if (p->loader && m->filename[0] == '/' &&
+	    strcmp(m->filename, GLIBC_LOADER) != 0) {
+		const char *base = strrchr(m->filename, '/') + 1;
+
+		p->name = prof_name(pf, base);
+		p->loader = 0;
+	}
+
+	if (p->nmaps == p->cap) {
+		size_t cap = p->cap ? p->cap * 2 : 32;
+		struct prof_map *n = realloc(p->maps, cap * sizeof(*n));
+
+		if (!n)
+			return;
+		p->maps = n;
+		p->cap = cap;
+	}
+	p->maps[p->nmaps++] = (struct prof_map){
+		m->addr, m->addr + m->len, m->pgoff, file,
+	};
+}
+
+static int prof_same(const struct profile *pf, const struct prof_stack *s,
+		     uint32_t name, const struct prof_frame *f, uint32_t depth)
+{
+	return s->name == name && s->depth == depth &&
+	       memcmp(&pf->frames[s->frame], f, depth * sizeof(*f)) == 0;
+}
+
+static int prof_rehash(struct profile *pf)
+{
+	size_t size = pf->index_size ? pf->index_size * 2 : 1024;
+	uint32_t *index = calloc(size, sizeof(*index));
+
+	if (!index)
+		return -1;
+	for (size_t i = 0; i < pf->nstacks; i++) {
+		size_t h = pf->stacks[i].hash & (size - 1);
+
+		while (index[h])
+			h = (h + 1) & (size - 1);
+		index[h] = (uint32_t)i + 1;
+	}
+	free(pf->index);
+	pf->index = index;
+	pf->index_size = size;
+	return 0;
+}
+
+/* Count one sample of stack @f[0..@depth) in the process named @name. */
+static void prof_count(struct profile *pf, uint32_t name,
+		       const struct prof_frame *f, uint32_t depth)
+{
+	uint64_t hash = bl_hash(bl_hash(BL_HASH_INIT, &name, sizeof(name)),
+				f, depth * sizeof(*f));
+	struct prof_stack *s;
+	size_t h;
+
+	if (pf->nstacks * 2 >= pf->index_size && prof_rehash(pf) != 0)
+		return;
+
+	for (h = hash & (pf->index_size - 1); pf->index[h];
+	     h = (h + 1) & (pf->index_size - 1)) {
+		s = &pf->stacks[pf->index[h] - 1];
+		if (s->hash == hash && prof_same(pf, s, name, f, depth)) {
+			s->count++;
+			return;
+		}
+	}
+
+	if (PROF_GROW(pf, stacks, nstacks) != 0)
+		return;
+	while (pf->nframes + depth > pf->frames_cap)
+		if (prof_grow((void **)&pf->frames, &pf->frames_cap,
+			      pf->frames_cap, sizeof(*pf->frames)) != 0)
+			return;
+
+	if (depth)
+		memcpy(&pf->frames[pf->nframes], f, depth * sizeof(*f));
+	pf->stacks[pf->nstacks] = (struct prof_stack){
+		hash, 1, pf->nframes, depth, name,
+	};
+	pf->nframes += depth;
+	pf->index[h] = (uint32_t)++pf->nstacks;
+}
+
+static void prof_sample(struct profile *pf, const struct prof_sample *s,
+			size_t len)
+{
+	struct prof_frame f[PROFILE_MAX_DEPTH];
+	struct prof_proc *p = prof_proc(pf, (pid_t)s->pid);
+	uint64_t nr = s->nr;
+	uint32_t depth = 0;
+
+	pf->samples++;
+	if (!p || len < sizeof(*s))
+		return;
+	if (nr > (len - sizeof(*s)) / sizeof(s->ips[0]))
+		nr = (len - sizeof(*s)) / sizeof(s->ips[0]);
+
+	/* the chain runs leaf first; folded stacks are root first */
+	for (uint64_t i = nr; i-- > 0 && depth < PROFILE_MAX_DEPTH;) {
+		uint64_t ip = s->ips[i];
+		struct prof_frame fr = { PROF_NONE, PROF_NONE };
+
+		if (ip >= PERF_CONTEXT_MAX)
+			continue;
+		for (size_t m = p->nmaps; m-- > 0;) {
+			const struct prof_map *pm = &p->maps[m];
+
+			if (ip >= pm->start && ip < pm->end) {
+				fr.file = pm->file;
+				fr.sym = prof_symbol(&pf->files[pm->file],
+						     ip - pm->start + pm->pgoff);
+				break;
+			}
+		}
+		f[depth++] = fr;
+	}
+	prof_count(pf, p->name, f, depth);
+}
+
+static void prof_record(struct profile *pf, const struct perf_event_header *h)
+{
+	const void *body = h + 1;
+	size_t len = h->size - sizeof(*h);
+
+	switch (h->type) {
+	case PERF_RECORD_SAMPLE:
+		prof_sample(pf, body, len);
+		break;
+	case PERF_RECORD_MMAP2:
+		if (len > sizeof(struct prof_mmap2))
+			prof_mmap(pf, body);
+		break;
+	case PERF_RECORD_COMM:
+		if ((h->misc & PERF_RECORD_MISC_COMM_EXEC) &&
+		    len > sizeof(struct prof_comm))
+			prof_exec(pf, body);
+		break;
+	case PERF_RECORD_FORK:
+		if (len >= sizeof(struct prof_fork))
+			prof_fork(pf, body);
+		break;
+	case PERF_RECORD_LOST:
+		pf->lost += ((const uint64_t *)body)[1];
+		break;
+	}
+}
+
+/*
+ * When @h was recorded: samples carry PERF_SAMPLE_TIME, every other
+ * record ends with its sample_id, whose last field is the time.
+ */
+static uint64_t prof_time(const struct perf_event_header *h)
+{
+	uint64_t t;
+
+	if (h->type == PERF_RECORD_SAMPLE)
+		return ((const struct prof_sample *)(h + 1))->time;
+	memcpy(&t, (const char *)h + h->size - sizeof(t), sizeof(t));
+	return t;
+}
+
+static int prof_cmp_pending(const void *a, const void *b)
+{
+	const struct prof_pending *x = a, *y = b;
+
+	if (x->time != y->time)
+		return (x->time > y->time) - (x->time < y->time);
+	return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+/* Move everything the kernel has written to ring @cpu onto the list. */
+static void prof_collect(struct profile *pf, unsigned cpu)
+{
+	struct perf_event_mmap_page *mp = (void *)pf->ring[cpu];
+	const unsigned char *data = pf->ring[cpu] + pf->page;
+	size_t size = PROFILE_PAGES * pf->page;
+	uint64_t head, tail;
+
+	head = __atomic_load_n(&mp->data_head, __ATOMIC_ACQUIRE);
+	tail = mp->data_tail;
+
+	while (head - tail >= sizeof(struct perf_event_header)) {
+		struct perf_event_header h, *rec;
+		size_t off = tail & (size - 1), first;
+
+		first = size - off < sizeof(h) ? size - off : sizeof(h);
+		memcpy(&h, data + off, first);
+		memcpy((char *)&h + first, data, sizeof(h) - first);
+		if (h.size < sizeof(h) + sizeof(uint64_t) ||
+		    head - tail < h.size)
+			break;
+		tail += h.size;
+
+		if (PROF_GROW(pf, pending, npending) != 0 ||
+		    !(rec = malloc(h.size)))
+			continue;
+		first = size - off < h.size ? size - off : h.size;
+		memcpy(rec, data + off, first);
+		memcpy((char *)rec + first, data, h.size - first);
+		pf->pending[pf->npending++] = (struct prof_pending){
+			prof_time(rec), pf->seq++, rec,
+		};
+	}
+	__atomic_store_n(&mp->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+/*
+ * Drain every ring and replay, in time order, the records made before
+ * this pass began; later ones wait for the next pass in case another
+ * CPU's ring still holds older records.  @final replays everything.
+ */
+static void profile_drain(struct profile *pf, int final)
+{
+	uint64_t limit = UINT64_MAX;
+	size_t n = 0;
+
+	if (!final && pf->clock)
+		limit = bl_now_ns() - PROFILE_SLACK_NS;
+	for (unsigned c = 0; c < pf->ncpu; c++)
+		if (pf->fd[c] >= 0)
+			prof_collect(pf, c);
+
+	qsort(pf->pending, pf->npending, sizeof(*pf->pending),
+	      prof_cmp_pending);
+	for (; n < pf->npending && pf->pending[n].time < limit; n++) {
+		prof_record(pf, pf->pending[n].rec);
+		free(pf->pending[n].rec);
+	}
+	pf->npending -= n;
+	memmove(pf->pending, pf->pending + n,
+		pf->npending * sizeof(*pf->pending));
+}
+
+/*
+ * Attach the profiler to @child, which must not have exec'd yet: one
+ * inherited event per possible CPU.  CPUs that are offline now are
+ * skipped, so threads that run there later go unsampled.  Returns the
+ * number of CPUs covered; with none the program still runs, just
+ * without a profile.
+ */
+static unsigned profile_open(struct profile *pf, pid_t child, int debug)
+{
+	struct perf_event_attr a = {
+		.type = PERF_TYPE_SOFTWARE,
+		.size = sizeof(a),
+		.config = PERF_COUNT_SW_CPU_CLOCK,
+		.sample_freq = PROFILE_HZ,
+		.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID |
+			       PERF_SAMPLE_TIME | PERF_SAMPLE_CALLCHAIN,
+		.freq = 1,
+		.disabled = 1,
+		.enable_on_exec = 1,
+		.inherit = 1,
+		.exclude_kernel = 1,
+		.exclude_hv = 1,
+		.exclude_callchain_kernel = 1,
+		.mmap = 1,
+		.mmap2 = 1,
+		.comm = 1,
+		.comm_exec = 1,
+		.task = 1,
+		.sample_id_all = 1,
+		.use_clockid = 1,
+		.clockid = CLOCK_MONOTONIC,
+	};
+	long page = sysconf(_SC_PAGESIZE), ncpu = sysconf(_SC_NPROCESSORS_CONF);
+	size_t len;
+	int err = 0;
+
+	pf->page = page > 0 ? (size_t)page : 4096;
+	pf->ncpu = ncpu > 0 ? (unsigned)ncpu : 1;
+	pf->root = child;
+	pf->clock = 1;
+	len = (PROFILE_PAGES + 1) * pf->page;
+
+	pf->fd = malloc(pf->ncpu * sizeof(*pf->fd));
+	pf->ring = calloc(pf->ncpu, sizeof(*pf->ring));
+	if (!pf->fd || !pf->ring) {
+		pf->ncpu = 0;
+		return 0;
+	}
+
+	for (unsigned c = 0; c < pf->ncpu; c++) {
+		void *ring;
+
+		pf->fd[c] = (int)syscall(__NR_perf_event_open, &a, child, c,
+					 -1, PERF_FLAG_FD_CLOEXEC);
+		/* kernels before 4.1 only have perf's own clock */
+		if (pf->fd[c] < 0 && errno == EINVAL && a.use_clockid) {
+			a.use_clockid = 0;
+			a.clockid = 0;
+			pf->clock = 0;
+			c--;
+			continue;
+		}
+		if (pf->fd[c] < 0) {
+			if (errno != ENODEV)
+				err = errno;
+			continue;
+		}
+
+		ring = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED,
+			    pf->fd[c], 0);
+		if (ring == MAP_FAILED) {
+			err = errno;
+			close(pf->fd[c]);
+			pf->fd[c] = -1;
+			continue;
+		}
+		pf->ring[c] = ring;
+		pf->active++;
+	}
+
+	if (!pf->active) {
+		char paranoid[16] = "?";
+		int fd;
+
+		fd = open("/proc/sys/kernel/perf_event_paranoid",
+			  O_RDONLY | O_CLOEXEC);
+		if (fd >= 0) {
+			ssize_t r = read(fd, paranoid, sizeof(paranoid) - 1);
+
+			if (r > 0)
+				paranoid[r] = '\0';
+			close(fd);
+		}
+		paranoid[strcspn(paranoid, "\n")] = '\0';
+		msg_warn("profile: perf_event_open: %s "
+			 "(kernel.perf_event_paranoid=%s)",
+			 strerror(err ? err : ENODEV), paranoid);
+	} else if (debug) {
+		msg_info("profile: sampling pid %d at %d Hz on %u of %u CPUs",
+			 (int)child, PROFILE_HZ, pf->active, pf->ncpu);
+	}
+	return pf->active;
+}
+
+static void prof_frame_name(const struct profile *pf,
+			    const struct prof_frame *f, char *buf, size_t size)
+{
+	const struct prof_file *file;
+	const char *base;
+
+	if (f->file == PROF_NONE) {
+		snprintf(buf, size, "[unknown]");
+		return;
+	}
+	file = &pf->files[f->file];
+	if (f->sym != PROF_NONE) {
+		snprintf(buf, size, "%s", file->syms[f->sym].name);
+		return;
+	}
+	base = strrchr(file->path, '/');
+	snprintf(buf, size, base && file->path[0] != '[' ? "[%s]" : "%s",
+		 base ? base + 1 : file->path);
+}
+
+struct prof_line {
+	char    *text;
+	uint64_t count;
+};
+
+static int prof_cmp_line(const void *a, const void *b)
+{
+	return strcmp(((const struct prof_line *)a)->text,
+		      ((const struct prof_line *)b)->text);
+}
+
+/*
+ * Stop sampling and write the folded stacks to @path.  Stacks that
+ * differ only below symbol level are merged.
+ */
+static int profile_report(struct profile *pf, const char *path)
+{
+	struct prof_line *lines;
+	size_t n = 0, out = 0;
+	FILE *f;
+
+	if (!pf->active)
+		return -1;
+	for (unsigned c = 0; c < pf->ncpu; c++)
+		if (pf->fd[c] >= 0)
+			ioctl(pf->fd[c], PERF_EVENT_IOC_DISABLE, 0);
+	profile_drain(pf, 1);
+
+	lines = calloc(pf->nstacks ? pf->nstacks : 1, sizeof(*lines));
+	if (!lines)
+		return -1;
+	for (size_t i = 0; i < pf->nstacks; i++) {
+		const struct prof_stack *s = &pf->stacks[i];
+		char *buf = NULL, frame[512];
+		size_t len = 0;
+		FILE *m = open_memstream(&buf, &len);
+
+		if (!m)
+			break;
+		fputs(s->name != PROF_NONE ? pf->names[s->name] : "?", m);
+		for (uint32_t d = 0; d < s->depth; d++) {
+			prof_frame_name(pf, &pf->frames[s->frame + d], frame,
+					sizeof(frame));
+			fprintf(m, ";%s", frame);
+		}
+		if (fclose(m) != 0 || !buf) {
+			free(buf);
+			break;
+		}
+		lines[n++] = (struct prof_line){ buf, s->count };
+	}
+	qsort(lines, n, sizeof(*lines), prof_cmp_line);
+
+	f = fopen(path, "we");
+	if (!f) {
+		msg_err("--profile %s: %s", path, strerror(errno));
+	} else {
+		for (size_t i = 0; i < n; i++) {
+			uint64_t count = lines[i].count;
+
+			while (i + 1 < n &&
+			       strcmp(lines[i].text, lines[i + 1].text) == 0)
+				count += lines[++i].count;
+			fprintf(f, "%s %llu\n", lines[i].text,
+				(unsigned long long)count);
+			out++;
+		}
+		if (fclose(f) != 0) {
+			msg_err("--profile %s: %s", path, strerror(errno));
+			f = NULL;
+		}
+	}
+	for (size_t i = 0; i < n; i++)
+		free(lines[i].text);
+	free(lines);
+	if (!f)
+		return -1;
+
+	msg_ok("profile: %llu samples, %zu stacks → %s",
+	       (unsigned long long)pf->samples, out, path);
+	if (pf->lost)
+		msg_warn("profile: %llu samples lost to a full ring",
+			 (unsigned long long)pf->lost);
+	return 0;
+}
+
+static void profile_free(struct profile *pf)
+{
+	if (!pf)
+		return;
+	for (unsigned c = 0; c < pf->ncpu; c++) {
+		if (pf->ring[c])
+			munmap(pf->ring[c], (PROFILE_PAGES + 1) * pf->page);
+		if (pf->fd[c] >= 0)
+			close(pf->fd[c]);
+	}
+	for (size_t i = 0; i < pf->npending; i++)
+		free(pf->pending[i].rec);
+	for (size_t i = 0; i < pf->nfiles; i++) {
+		free(pf->files[i].path);
+		free(pf->files[i].syms);
+		if (pf->files[i].map)
+			munmap(pf->files[i].map, pf->files[i].len);
+	}
+	for (size_t i = 0; i < pf->nnames; i++)
+		free(pf->names[i]);
+	for (size_t i = 0; i < pf->nprocs; i++)
+		free(pf->procs[i].maps);
+	free(pf->fd);
+	free(pf->ring);
+	free(pf->pending);
+	free(pf->files);
+	free(pf->names);
+	free(pf->procs);
+	free(pf->stacks);
+	free(pf->index);
+	free(pf->frames);
+	free(pf);
+}
+
+/* ── child process execution ─────────────────────────────────────── */
+
+/*
+ * Wait for @child under --stats, --profile and/or --record-io.  With
+ * @st the tree is sampled and everything re-parented to us is reaped on
+ * the way; with @pf the profile rings are drained.  Both happen every
+ * STATS_SAMPLE_MS, which is also when the I/O trace of @binary is taken
+ * once its deadline has passed.  Returns @child's wait status.
+ */
+static int child_wait(pid_t child, struct stats *st, struct profile *pf,
+		      const char *binary)
+{
+	int pfd = (int)syscall(__NR_pidfd_open, child, 0);
+	int status = 0, done = 0;
+
+	while (!done) {
+		struct pollfd p = { .fd = pfd, .events = POLLIN };
+		siginfo_t si;
+
+		if (st)
+			stats_sample(st);
+		if (pf)
+			profile_drain(pf, 0);
+		if (g_iot_fd >= 0 && bl_now_ns() >= g_iot_end)
+			iot_save(binary);
+		for (;;) {
+			int s;
+
+			memset(&si, 0, sizeof(si));
+			if (waitid(st ? P_ALL : P_PID, st ? 0 : (id_t)child,
+				   &si, WEXITED | WNOHANG | WNOWAIT) != 0 ||
+			    !si.si_pid)
+				break;
+			if (st)
+				stats_read(st, si.si_pid, 1);
+			if (waitpid(si.si_pid, &s, 0) == child) {
+				status = s;
+				done = 1;
+			}
+		}
+		if (!done)
+			poll(&p, pfd >= 0 ? 1 : 0,
+			     st || pf || g_iot_fd >= 0 || pfd < 0 ?
+			     STATS_SAMPLE_MS : -1);
+	}
+	if (pfd >= 0)
+		close(pfd);
+
+	if (st)
+		stats_sample(st);	/* whatever outlives the program */
+	return status;
+}
+
+/*
+ * Reset signal dispositions so the child starts with defaults.
+ * Called between fork() and execve() — only uses async-signal-safe
+ * functions.
+ */
+static void child_reset_signals(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(forwarded_sigs); i++)
+		signal(forwarded_sigs[i], SIG_DFL);
+}
+
+/*
+ * Change CWD to the directory containing @binary_path.
+ * Many programs (servers, benchmarks) expect to run from their own
+ * directory so they can find adjacent data files.
+ */
+static void chdir_to_binary(const char *binary_path)
+{
+	char *copy, *dir;
+
+	if (!binary_path)	/* native program: stays where it was started */
+		return;
+	copy = strdup(binary_path);
+	if (!copy)
+		return;
+
+	dir = dirname(copy);
+	if (dir && *dir && strcmp(dir, ".") != 0) {
+		if (chdir(dir) < 0) { /* best-effort, non-fatal */ }
+	}
+
+	free(copy);
+}
+
+/*
+ * Close the "exec" stage begun at @t and hand the trace over to the
+ * process image @pid runs next.
+ */
+static void exec_trace(const char *exec_path, uint64_t t, pid_t pid)
+{
+	struct bl_trace_args a = { 0, "" };
+
+	if (bl_tracing()) {
+		bl_trace_arg_str(&a, "path", exec_path);
+		bl_trace_arg_int(&a, "child", (long long)pid);
+	}
+	stage_trace("exec", t, &a);
+	bl_trace_flow_start(t, pid);
+}
+
+/* Exit code for a wait status: the program's, or 128 + signal. */
+static int wait_code(int status)
+{
+	if (WIFEXITED(status))
+		return WEXITSTATUS(status);
+	if (WIFSIGNALED(status))
+		return 128 + WTERMSIG(status);
+	return 1;
+}
+
+/*
+ * Unified fork → exec → wait.  Used by both arm64 and x86_64 paths.
+ *
+ * @exec_path  – binary to execve() (loader or box64)
+ * @argv       – full argv array (already constructed by caller)
+ * @envp       – full envp array
+ * @binary     – user's target binary (for chdir, NULL for none)
+ * @o          – launch options
+ *
+ * With --stats the whole process tree is accounted for while we wait
+ * and summarised afterwards; with --profile it is sampled from its
+ * first instruction on, see child_wait().
+ *
+ * Returns the process exit code (0–255), or 1 on fork failure.
+ */
+static int run_child(const char *exec_path, char **argv, char **envp,
+		     const char *binary, const launch_opts_t *o)
+{
+	int debug = o->debug;
+	struct stats st = { .t0_ns = bl_now_ns() };
+	struct profile *pf = NULL;
+	int gate[2] = { -1, -1 };
+	uint64_t t;
+	pid_t child;
+	int status, code;
+
+	/*
+	 * The profiler must be attached before the child execs, so the
+	 * child waits for the parent to close @gate first.
+	 */
+	if (o->profile && (!(pf = calloc(1, sizeof(*pf))) ||
+			   pipe2(gate, O_CLOEXEC) != 0)) {
+		msg_warn("profile: %s", strerror(errno));
+		free(pf);
+		pf = NULL;
+	}
+	if (pf)
+		pf->binary = binary ? binary : argv[0];
+
+	/*
+	 * Install signal handlers BEFORE fork() to close the race
+	 * window where a signal could arrive after fork() but before
+	 * handler installation.
+	 */
+	install_signal_handlers();
+
+	t = stage_begin();
+	child = fork();
+	if (child == 0) {
+		/* child */
+		child_reset_signals();
+		if (pf) {
+			char c;
+
+			close(gate[1]);
+			while (read(gate[0], &c, 1) < 0 && errno == EINTR)
+				;
+		}
+		chdir_to_binary(binary);
+		execve(exec_path, argv, envp);
+		msg_err("execve %s: %s", exec_path, strerror(errno));
+		_exit(127);
+	}
+
+	if (pf) {
+		if (child > 0)
+			profile_open(pf, child, debug);
+		close(gate[0]);
+		close(gate[1]);
+	}
+	if (child < 0) {
+		perror("fork");
+		profile_free(pf);
+		return 1;
+	}
+
+	/* parent — record PID so the handler can forward signals */
+	g_child_pid = (sig_atomic_t)child;
+	exec_trace(exec_path, t, child);
+	events_launch(g_launch_ev, child);
+
+	/* the child is already exec'ing; the lock follows asynchronously */
+	if (o->wake_lock) {
+		t = stage_begin();
+		wake_lock_hold(child, debug);
+		stage_end("wake_lock", t);
+	}
+
+	/*
+	 * Only now become the subreaper, or a wake-lock manager started
+	 * above would be re-parented to us.  The child is still starting
+	 * the loader, long before it could orphan anything.
+	 */
+	if (o->stats) {
+		st.hz = sysconf(_SC_CLK_TCK) > 0 ? sysconf(_SC_CLK_TCK) : 100;
+		if (prctl(PR_SET_CHILD_SUBREAPER, 1) != 0 && debug)
+			msg_warn("stats: not a subreaper: %s",
+				 strerror(errno));
+	}
+
+	t = stage_begin();
+	if (pf && !pf->active) {
+		profile_free(pf);
+		pf = NULL;
+	}
+	if (o->stats || pf || g_iot_fd >= 0)
+		status = child_wait(child, o->stats ? &st : NULL, pf,
+				    binary);
+	else
+		waitpid(child, &status, 0);
+	stage_end("wait", t);
+
+	code = wait_code(status);
+	if (o->stats) {
+		stats_report(&st, binary ? binary : argv[0], code, o);
+		free(st.p);
+	}
+	if (pf) {
+		profile_report(pf, o->profile);
+		profile_free(pf);
+	}
+	return code;
+}
+
+/*
+ * Exec-in-place: become the loader (or box64) without leaving a
+ * resident bionilux parent, so each launch costs one process instead
+ * of two.  The exit status reaches our parent directly and signals
+ * need no forwarding; the wake lock is tracked by the manager daemon,
+ * which follows our PID across the execve().
+ *
+ * Returns only on failure, with 127 like a failed exec in run_child().
+ */
+static int exec_child(const char *exec_path, char **argv, char **envp,
+		      const char *binary, const launch_opts_t *o)
+{
+	uint64_t t;
+
+	if (o->wake_lock) {
+		t = stage_begin();
+		wake_lock_hold(getpid(), o->debug);
+		stage_end("wake_lock", t);
+	}
+
+	chdir_to_binary(binary);
+	t = stage_begin();
+	exec_trace(exec_path, t, getpid());
+	execve(exec_path, argv, envp);
+	msg_err("execve %s: %s", exec_path, strerror(errno));
+	return 127;
+}
+
+/* ── zygote ──────────────────────────────────────────────────────── */
+
+/*
+ * Opt-in launch server (`bionilux --zygote`).  A per-user daemon keeps
+ * the glibc loader, the GLIBC_LIB libraries and the preload mapped and
+ * locked in memory, so launches never wait for them to be read back
+ * from storage after Android reclaimed the page cache, and forks each
+ * program on behalf of the bionilux client:
+ *
+ *   client → zygote_req + SCM_RIGHTS fds, then the strings
+ *            exec_path, cwd, binary, argv[], envp[]
+ *   zygote → { ZYGOTE_PID, pid }  once forked (or -errno)
+ *            { ZYGOTE_EXIT, wait status }  when the program ends
+ *
+ * The client passes every descriptor it would have let the program
+ * inherit, its umask, signal state, CPU affinity, nice value and
+ * resource limits, and the zygote applies them to the child.  A
+ * client in another cgroup, or with a lower nice value or a higher hard
+ * limit than the zygote may grant, is refused and runs the program
+ * itself.  The client relays signals to the PID it is given and exits
+ * with the program's status, exactly like run_child().  When no zygote
+ * is running the connect() fails and launch() falls back to
+ * run_child().
+ *
+ * The program is a child of the zygote, outside the caller's session:
+ * it has no controlling terminal, so tools that open /dev/tty need
+ * BIONILUX_ZYGOTE=0.  For the same reason the preload's execve() hook
+ * never hands off — an exec must keep its PID and parent.
+ */
+#define ZYGOTE_SOCK_NAME	"zygote"
+#define ZYGOTE_MAGIC		0x3247595au	/* "ZYG2" */
+#define ZYGOTE_MAX_FDS		64
+#define ZYGOTE_MAX_JOBS		256
+#define ZYGOTE_MAX_PINS		512
+#define ZYGOTE_MAX_STRINGS	(1U << 20)
+#define ZYGOTE_WARM_MS		60000
+#define ZYGOTE_ENV		"BIONILUX_ZYGOTE"
+#define ZYGOTE_MB_ENV		"BIONILUX_ZYGOTE_MB"
+
+enum {
+	ZYGOTE_OP_RUN  = 1,
+	ZYGOTE_OP_STOP = 2,
+	ZYGOTE_PID     = 1,
+	ZYGOTE_EXIT    = 2,
+};
+
+struct zygote_req {
+	uint32_t magic;
+	uint32_t op;		/* ZYGOTE_OP_* */
+	uint32_t argc, envc;
+	uint32_t len;		/* bytes of strings that follow */
+	uint32_t umask;
+	uint64_t ignored;	/* bit n: signal n is SIG_IGN */
+	uint64_t blocked;	/* bit n: signal n is blocked */
+	uint32_t nfds;
+	int32_t  fds[ZYGOTE_MAX_FDS];	/* target numbers of the passed fds */
+	int32_t  nice;
+	uint8_t  cpus[sizeof(cpu_set_t)];	/* affinity mask */
+	struct {
+		uint64_t cur, max;
+	} rlim[RLIM_NLIMITS];
+	char     cgroup[256];		/* /proc/self/cgroup, truncated */
+};
+
+struct zygote_resp {
+	int32_t kind;		/* ZYGOTE_PID / ZYGOTE_EXIT */
+	int32_t value;
+};
+
+struct zygote_job {
+	pid_t pid;
+	int   pidfd;		/* -1 → found by the periodic waitpid() */
+	int   cfd;		/* client connection */
+};
+
+struct zygote_pin {
+	void  *addr;
+	size_t len;
+	int    locked;		/* 0 → re-advised every ZYGOTE_WARM_MS */
+};
+
+/*
+ * Map @path and lock it in memory (or at least fault it in) unless it
+ * would exceed @budget.  Files already pinned under another name —
+ * libc.so.6 and what it links to — are skipped.
+ */
+static void zygote_pin(const char *path, struct zygote_pin *pins,
+		       size_t *npins, dev_t *devs, ino_t *inos,
+		       size_t *budget)
+{
+	struct stat st;
+	void *addr;
+	int fd;
+
+	if (*npins >= ZYGOTE_MAX_PINS)
+		return;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+	    (size_t)st.st_size > *budget) {
+		close(fd);
+		return;
+	}
+	for (size_t i = 0; i < *npins; i++) {
+		if (devs[i] == st.st_dev && inos[i] == st.st_ino) {
+			close(fd);
+			return;
+		}
+	}
+
+	addr = mmap(NULL, (size_t)st.st_size, PROT_READ,
+		    MAP_SHARED | MAP_POPULATE, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+		return;
+
+	devs[*npins] = st.st_dev;
+	inos[*npins] = st.st_ino;
+	pins[*npins] = (struct zygote_pin){
+		.addr   = addr,
+		.len    = (size_t)st.st_size,
+		.locked = mlock(addr, (size_t)st.st_size) == 0,
+	};
+	(*npins)++;
+	*budget -= (size_t)st.st_size;
+}
+
+/*
+ * Pin the loader, the preload and the core libraries first, then the
+ * rest of GLIBC_LIB until BIONILUX_ZYGOTE_MB (default 128) is used up.
+ */
+static size_t zygote_pin_all(struct zygote_pin *pins, const char *preload)
+{
+	static const char *const core[] = {
+		"libc.so.6", "libm.so.6", "libstdc++.so.6", "libgcc_s.so.1",
+		"libpthread.so.0", "libdl.so.2", "librt.so.1",
+	};
+	static dev_t devs[ZYGOTE_MAX_PINS];
+	static ino_t inos[ZYGOTE_MAX_PINS];
+	const char *mb = getenv(ZYGOTE_MB_ENV);
+	size_t budget = (size_t)(mb && *mb ? strtoul(mb, NULL, 10) : 128)
+			<< 20;
+	char path[PATH_MAX];
+	size_t n = 0;
+	struct dirent *de;
+	DIR *d;
+
+	zygote_pin(GLIBC_LOADER, pins, &n, devs, inos, &budget);
+	if (preload)
+		zygote_pin(preload, pins, &n, devs, inos, &budget);
+	for (size_t i = 0; i < ARRAY_SIZE(core); i++) {
+		snprintf(path, sizeof(path), "%s/%s", GLIBC_LIB, core[i]);
+		zygote_pin(path, pins, &n, devs, inos, &budget);
+	}
+
+	d = opendir(GLIBC_LIB);
+	if (!d)
+		return n;
+	while ((de = readdir(d)) != NULL) {
+		if (de->d_name[0] == '.' || !strstr(de->d_name, ".so"))
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", GLIBC_LIB, de->d_name);
+		zygote_pin(path, pins, &n, devs, inos, &budget);
+	}
+	closedir(d);
+	return n;
+}
+
+/* First line of /proc/self/cgroup into @buf ("" if unreadable). */
+static void zygote_cgroup(char *buf, size_t size)
+{
+	int fd = open("/proc/self/cgroup", O_RDONLY | O_CLOEXEC);
+	ssize_t n = fd >= 0 ? read(fd, buf, size - 1) : -1;
+
+	if (fd >= 0)
+		close(fd);
+	buf[n > 0 ? n : 0] = '\0';
+	buf[strcspn(buf, "\n")] = '\0';
+}
+
+/*
+ * Can a child of the zygote run with the limits, nice value and cgroup
+ * of the client?  Raising a hard limit or the priority needs privileges
+ * the zygote lacks, and it cannot move the child into another cgroup.
+ */
+static int zygote_fits(const struct zygote_req *req)
+{
+	char cgroup[sizeof(req->cgroup)];
+	int nice;
+
+	zygote_cgroup(cgroup, sizeof(cgroup));
+	if (strncmp(cgroup, req->cgroup, sizeof(cgroup)) != 0)
+		return 0;
+
+	errno = 0;
+	nice = getpriority(PRIO_PROCESS, 0);
+	if (errno || req->nice < nice)
+		return 0;
+
+	for (int i = 0; i < RLIM_NLIMITS; i++) {
+		struct rlimit rl;
+
+		if (getrlimit(i, &rl) != 0 || req->rlim[i].max > rl.rlim_max ||
+		    req->rlim[i].cur > req->rlim[i].max)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Runs in the forked child: install the client's descriptors, CPU
+ * affinity, nice value, resource limits, umask, signal state and
+ * directory, then exec.  Single-threaded parent, so strdup() in
+ * chdir_to_binary() is safe here.
+ */
+__attribute__((noreturn))
+static void zygote_child(const struct zygote_req *req, int *fds,
+			 const char *exec_path, const char *cwd,
+			 const char *binary, char **argv, char **envp)
+{
+	int top = 0;
+	sigset_t set;
+
+	/* move the received fds above every target, then into place */
+	for (uint32_t i = 0; i < req->nfds; i++)
+		if (req->fds[i] >= top)
+			top = req->fds[i] + 1;
+	for (uint32_t i = 0; i < req->nfds; i++)
+		fds[i] = fcntl(fds[i], F_DUPFD_CLOEXEC, top);
+	for (uint32_t i = 0; i < req->nfds; i++)
+		if (fds[i] < 0 || dup2(fds[i], req->fds[i]) < 0)
+			_exit(127);
+
+	/* zygote_fits() checked that all of this is allowed */
+	sched_setaffinity(0, sizeof(cpu_set_t), (const cpu_set_t *)req->cpus);
+	setpriority(PRIO_PROCESS, 0, req->nice);
+	for (int i = 0; i < RLIM_NLIMITS; i++) {
+		struct rlimit rl = {
+			(rlim_t)req->rlim[i].cur, (rlim_t)req->rlim[i].max,
+		};
+
+		setrlimit(i, &rl);
+	}
+
+	umask((mode_t)req->umask);
+	sigemptyset(&set);
+	for (int sig = 1; sig < 64 && sig < NSIG; sig++) {
+		if (sig == SIGKILL || sig == SIGSTOP)
+			continue;
+		signal(sig, req->ignored & (1ULL << sig) ? SIG_IGN : SIG_DFL);
+		if (req->blocked & (1ULL << sig))
+			sigaddset(&set, sig);
+	}
+	sigprocmask(SIG_SETMASK, &set, NULL);
+
+	if (chdir(cwd) < 0) { /* best-effort, as in run_child() */ }
+	chdir_to_binary(binary);
+	execve(exec_path, argv, envp);
+	msg_err("execve %s: %s", exec_path, strerror(errno));
+	_exit(127);
+}
+
+/* Split the string block into its fields.  Returns -1 if malformed. */
+static int zygote_parse(const struct zygote_req *req, char *blob,
+			char **fields, size_t nfields)
+{
+	char *p = blob, *end = blob + req->len;
+
+	for (size_t i = 0; i < nfields; i++) {
+		char *nul = memchr(p, '\0', (size_t)(end - p));
+
+		if (!nul)
+			return -1;
+		fields[i] = p;
+		p = nul + 1;
+	}
+	return p == end ? 0 : -1;
+}
+
+static void zygote_reply(int cfd, int kind, int value)
+{
+	struct zygote_resp resp = { kind, value };
+
+	if (write(cfd, &resp, sizeof(resp)) < 0) { /* client gone */ }
+}
+
+/*
+ * Serve one connection.  Returns 1 if it asked the zygote to stop.
+ * A forked job's connection moves into @jobs; anything else is
+ * answered and closed here.
+ */
+static int zygote_serve(int cfd, struct zygote_job *jobs, size_t *njobs)
+{
+	union {
+		struct cmsghdr h;
+		char buf[CMSG_SPACE(sizeof(int) * ZYGOTE_MAX_FDS)];
+	} ctl;
+	struct timeval tv = { .tv_sec = 2 };
+	struct zygote_req req;
+	struct iovec iov = { &req, sizeof(req) };
+	struct msghdr msg = {
+		.msg_iov = &iov, .msg_iovlen = 1,
+		.msg_control = ctl.buf, .msg_controllen = sizeof(ctl.buf),
+	};
+	int fds[ZYGOTE_MAX_FDS];
+	uint32_t nfds = 0;
+	char **fields = NULL, *blob = NULL;
+	int err = EINVAL, stop = 0;
+	pid_t pid;
+
+	/* another user must not exec as us with fds of its choosing */
+	if (!daemon_peer_ok(cfd)) {
+		close(cfd);
+		return 0;
+	}
+
+	/* a stuck client must not wedge every other launch */
+	setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	if (recvmsg(cfd, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC) !=
+	    (ssize_t)sizeof(req))
+		goto out;
+
+	for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c;
+	     c = CMSG_NXTHDR(&msg, c)) {
+		if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+			continue;
+		size_t n = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for (size_t i = 0; i < n && nfds < ZYGOTE_MAX_FDS; i++)
+			memcpy(&fds[nfds++], CMSG_DATA(c) + i * sizeof(int),
+			       sizeof(int));
+	}
+
+	if (req.magic != ZYGOTE_MAGIC || (msg.msg_flags & MSG_CTRUNC))
+		goto out;
+	if (req.op == ZYGOTE_OP_STOP) {
+		zygote_reply(cfd, ZYGOTE_PID, (int)getpid());
+		stop = 1;
+		goto out;
+	}
+	if (req.op != ZYGOTE_OP_RUN || req.nfds != nfds || !req.argc ||
+	    req.len > ZYGOTE_MAX_STRINGS || req.argc + req.envc > req.len)
+		goto out;
+
+	err = ENOMEM;
+	size_t nfields = 3 + (size_t)req.argc + 1 + (size_t)req.envc + 1;
+	blob = malloc(req.len);
+	fields = calloc(nfields, sizeof(char *));
+	if (!blob || !fields)
+		goto out;
 
-		/* BOX64_PATH for child process re-exec */
-		env[j] = xasprintf("BOX64_PATH=%s/glibc/bin/:%s/bin/",
-				    get_prefix(), get_prefix());
-		if (!env[j]) { free_env(env); return NULL; } j++;
+	err = EINVAL;
+	if (read_all(cfd, blob, req.len) != 0 ||
+	    zygote_parse(&req, blob, fields,
+			 3 + (size_t)req.argc + req.envc) != 0)
+		goto out;
 
-		env[j] = xstrdup("BOX64_UNAME=x86_64");
-		if (!env[j]) { free_env(env); return NULL; } j++;
+	/* argv and envp become NULL-terminated arrays in place */
+	char **argv = fields + 3, **envp = argv + req.argc + 1;
 
-		/*
-		 * Do NOT set BOX64_LD_PRELOAD — the preload .so is ARM64
-		 * glibc and cannot be loaded into box64's x86_64 context.
-		 * Omit LD_PRELOAD entirely so neither box64 nor the
-		 * emulated process inherits a stale value.
-		 */
-	} else {
-		if (preload_path && use_preload) {
-			env[j] = xasprintf("LD_PRELOAD=%s", preload_path);
-			if (!env[j]) { free_env(env); return NULL; } j++;
-		}
-		/* No preload → don't set LD_PRELOAD at all */
-	}
+	memmove(envp, argv + req.argc, req.envc * sizeof(char *));
+	argv[req.argc] = NULL;
+	envp[req.envc] = NULL;
 
-	if (debug) {
-		env[j] = xstrdup("BIONILUX_DEBUG=1");
-		if (!env[j]) { free_env(env); return NULL; } j++;
+	err = EAGAIN;
+	if (*njobs >= ZYGOTE_MAX_JOBS)
+		goto out;
+	err = EPERM;
+	if (!zygote_fits(&req))
+		goto out;
+
+	pid = fork();
+	if (pid == 0)
+		zygote_child(&req, fds, fields[0], fields[1], fields[2],
+			     argv, envp);
+	if (pid < 0) {
+		err = errno;
+		goto out;
 	}
 
-	env[j] = NULL;
-	return env;
-}
+	zygote_reply(cfd, ZYGOTE_PID, (int)pid);
+	jobs[*njobs] = (struct zygote_job){
+		.pid   = pid,
+		.pidfd = (int)syscall(__NR_pidfd_open, pid, 0),
+		.cfd   = cfd,
+	};
+	(*njobs)++;
+	cfd = -1;
+	err = 0;
 
-/* ── wake lock ───────────────────────────────────────────────────── */
+out:
+	if (err && cfd >= 0 && !stop)
+		zygote_reply(cfd, ZYGOTE_PID, -err);
+	for (uint32_t i = 0; i < nfds; i++)
+		close(fds[i]);
+	if (cfd >= 0)
+		close(cfd);
+	free(fields);
+	free(blob);
+	return stop;
+}
 
 /*
- * termux-wake-lock / termux-wake-unlock are fire-and-forget commands.
- * We fork, exec, wait — and that's it.  No PID tracking needed.
+ * Daemon main loop.  Owns @lfd and never returns.  After a stop
+ * request it closes the socket, so new launches fall back to
+ * run_child(), and exits once its running programs have finished.
  */
-static void run_wakelock_cmd(const char *cmd, int debug)
+__attribute__((noreturn))
+static void zygote_daemon(int lfd, const char *preload)
 {
-	char path[PATH_MAX];
+	static struct zygote_pin pins[ZYGOTE_MAX_PINS];
+	static struct zygote_job jobs[ZYGOTE_MAX_JOBS];
+	struct pollfd pfds[ZYGOTE_MAX_JOBS + 1];
+	size_t npins = zygote_pin_all(pins, preload), njobs = 0;
+	int64_t warmed = now_ms();
+
+	for (;;) {
+		int timeout = ZYGOTE_WARM_MS;
+		int status;
+		pid_t pid;
+
+		if (lfd < 0 && !njobs)
+			_exit(0);
+
+		pfds[0] = (struct pollfd){ .fd = lfd, .events = POLLIN };
+		for (size_t i = 0; i < njobs; i++) {
+			pfds[i + 1] = (struct pollfd){
+				.fd = jobs[i].pidfd, .events = POLLIN,
+			};
+			if (jobs[i].pidfd < 0)
+				timeout = 100;
+		}
+
+		if (poll(pfds, njobs + 1, timeout) < 0 && errno != EINTR)
+			_exit(1);
+
+		/* report finished programs (compact in place) */
+		while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+			for (size_t i = 0; i < njobs; i++) {
+				if (jobs[i].pid != pid)
+					continue;
+				zygote_reply(jobs[i].cfd, ZYGOTE_EXIT, status);
+				close(jobs[i].cfd);
+				if (jobs[i].pidfd >= 0)
+					close(jobs[i].pidfd);
+				jobs[i] = jobs[--njobs];
+				break;
+			}
+		}
+
+		if (lfd >= 0 && (pfds[0].revents & POLLIN)) {
+			int cfd;
+
+			while ((cfd = accept4(lfd, NULL, NULL,
+					      SOCK_CLOEXEC)) >= 0) {
+				if (zygote_serve(cfd, jobs, &njobs)) {
+					close(lfd);
+					lfd = -1;
+					break;
+				}
+			}
+		}
+
+		/* unlocked pins: ask the kernel to keep them cached */
+		if (now_ms() - warmed >= ZYGOTE_WARM_MS) {
+			for (size_t i = 0; i < npins; i++)
+				if (!pins[i].locked)
+					madvise(pins[i].addr, pins[i].len,
+						MADV_WILLNEED);
+			warmed = now_ms();
+		}
+	}
+}
+
+/* `bionilux --zygote`: start the per-user zygote unless it runs. */
+static int zygote_start(int debug)
+{
+	struct sockaddr_un sun;
+	socklen_t len = daemon_sock_addr(&sun, ZYGOTE_SOCK_NAME);
+	char preload_buf[PATH_MAX];
+	char *preload;
 	pid_t pid;
-	int status;
+	int lfd, st;
 
-	snprintf(path, sizeof(path), "%s/bin/%s", get_prefix(), cmd);
-	if (access(path, X_OK) != 0) {
-		if (debug)
-			msg_warn("%s not found, skipping", cmd);
-		return;
+	lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (lfd < 0) {
+		perror("socket");
+		return 1;
+	}
+	if (bind(lfd, (struct sockaddr *)&sun, len) != 0) {
+		close(lfd);
+		if (errno != EADDRINUSE) {
+			perror("bind");
+			return 1;
+		}
+		lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		st = lfd >= 0 &&
+		     connect(lfd, (struct sockaddr *)&sun, len) == 0 &&
+		     !daemon_peer_ok(lfd);
+		if (lfd >= 0)
+			close(lfd);
+		if (st) {
+			msg_err("zygote socket owned by another user");
+			return 1;
+		}
+		msg_info("zygote already running");
+		return 0;
+	}
+	if (listen(lfd, 128) != 0) {
+		perror("listen");
+		close(lfd);
+		return 1;
 	}
 
+	preload = extract_preload(preload_buf, sizeof(preload_buf), 0);
+
 	pid = fork();
 	if (pid == 0) {
-		int fd = open("/dev/null", O_WRONLY);
+		setsid();
+		if (fork() != 0)
+			_exit(0);
+
+		int fd = open("/dev/null", O_RDWR);
 		if (fd >= 0) {
+			dup2(fd, STDIN_FILENO);
 			dup2(fd, STDOUT_FILENO);
-			dup2(fd, STDERR_FILENO);
+			if (!debug)
+				dup2(fd, STDERR_FILENO);
 			close(fd);
 		}
-		execl(path, cmd, (char *)NULL);
-		_exit(127);
-	} else if (pid > 0) {
-		waitpid(pid, &status, 0);
-		if (debug)
-			msg_ok("%s done", cmd);
+		if (chdir("/") < 0) { /* keep whatever directory we had */ }
+		signal(SIGPIPE, SIG_IGN);
+		signal(SIGHUP, SIG_IGN);
+		zygote_daemon(lfd, preload);
+	}
+
+	close(lfd);
+	if (pid < 0 || waitpid(pid, &st, 0) < 0 || wait_code(st) != 0) {
+		msg_err("cannot start the zygote");
+		return 1;
 	}
+	msg_ok("zygote started");
+	return 0;
 }
 
-static inline void acquire_wake_lock(int debug)
+/* `bionilux --zygote-stop`.  Running programs are left to finish. */
+static int zygote_stop(void)
 {
-	run_wakelock_cmd("termux-wake-lock", debug);
+	struct zygote_req req = { .magic = ZYGOTE_MAGIC,
+				  .op = ZYGOTE_OP_STOP };
+	struct zygote_resp resp;
+	struct sockaddr_un sun;
+	socklen_t len = daemon_sock_addr(&sun, ZYGOTE_SOCK_NAME);
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+	if (fd < 0 || connect(fd, (struct sockaddr *)&sun, len) != 0) {
+		if (fd >= 0)
+			close(fd);
+		msg_info("zygote not running");
+		return 0;
+	}
+	if (!daemon_peer_ok(fd)) {
+		close(fd);
+		msg_err("zygote socket owned by another user");
+		return 1;
+	}
+	if (write_all(fd, &req, sizeof(req)) != 0 ||
+	    read_all(fd, &resp, sizeof(resp)) != 0) {
+		close(fd);
+		msg_err("zygote did not answer");
+		return 1;
+	}
+	close(fd);
+	msg_ok("zygote stopped (pid %d)", (int)resp.value);
+	return 0;
 }
 
-static inline void release_wake_lock(int debug)
+/*
+ * Collect the descriptors a forked program would inherit — everything
+ * open without FD_CLOEXEC, except @skip.  Returns the count, or -1 if
+ * there are more than ZYGOTE_MAX_FDS.
+ */
+static int zygote_fds(int skip, int32_t *fds)
 {
-	run_wakelock_cmd("termux-wake-unlock", debug);
+	DIR *d = opendir("/proc/self/fd");
+	struct dirent *de;
+	int n = 0;
+
+	if (!d)
+		return -1;
+	while ((de = readdir(d)) != NULL) {
+		int fd, fl;
+
+		if (de->d_name[0] < '0' || de->d_name[0] > '9')
+			continue;
+		fd = atoi(de->d_name);
+		if (fd == skip || fd == dirfd(d))
+			continue;
+		fl = fcntl(fd, F_GETFD);
+		if (fl < 0 || (fl & FD_CLOEXEC))
+			continue;
+		if (n == ZYGOTE_MAX_FDS) {
+			n = -1;
+			break;
+		}
+		fds[n++] = fd;
+	}
+	closedir(d);
+	return n;
 }
 
-/* ── signal forwarding ───────────────────────────────────────────── */
+/*
+ * Hand the launch to a running zygote.  Returns the program's exit
+ * code, or -1 if there is no zygote or it could not fork — the caller
+ * then runs the program itself.
+ */
+static int zygote_run(const char *exec_path, char **argv, char **envp,
+		      const char *binary, const launch_opts_t *o)
+{
+	const char *env = getenv(ZYGOTE_ENV);
+	union {
+		struct cmsghdr h;
+		char buf[CMSG_SPACE(sizeof(int) * ZYGOTE_MAX_FDS)];
+	} ctl;
+	struct zygote_req req = { .magic = ZYGOTE_MAGIC, .op = ZYGOTE_OP_RUN };
+	struct iovec iov = { &req, sizeof(req) };
+	struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+	struct zygote_resp resp;
+	struct sockaddr_un sun;
+	socklen_t len = daemon_sock_addr(&sun, ZYGOTE_SOCK_NAME);
+	char cwd[PATH_MAX], *blob = NULL, *p;
+	sigset_t blocked;
+	uint64_t t;
+	size_t total;
+	int fd, nfds;
+
+	if (env && strcmp(env, "0") == 0)
+		return -1;
+
+	t = stage_begin();
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr *)&sun, len) != 0)
+		goto fallback;
+	/* whoever holds the name would get our fds and environment */
+	if (!daemon_peer_ok(fd)) {
+		msg_warn("zygote: socket owned by another user, not used");
+		goto fallback;
+	}
+
+	nfds = zygote_fds(fd, req.fds);
+	if (nfds < 0) {
+		if (o->debug)
+			msg_warn("zygote: too many open fds, not used");
+		goto fallback;
+	}
+	req.nfds = (uint32_t)nfds;
+
+	if (!getcwd(cwd, sizeof(cwd)))
+		strcpy(cwd, "/");
+
+	/* strings: exec_path, cwd, binary, argv[], envp[] */
+	total = strlen(exec_path) + strlen(cwd) + strlen(binary) + 3;
+	for (; argv[req.argc]; req.argc++)
+		total += strlen(argv[req.argc]) + 1;
+	for (; envp[req.envc]; req.envc++)
+		total += strlen(envp[req.envc]) + 1;
+	if (total > ZYGOTE_MAX_STRINGS || !(blob = malloc(total)))
+		goto fallback;
+	req.len = (uint32_t)total;
+
+	p = stpcpy(blob, exec_path) + 1;
+	p = stpcpy(p, cwd) + 1;
+	p = stpcpy(p, binary) + 1;
+	for (uint32_t i = 0; i < req.argc; i++)
+		p = stpcpy(p, argv[i]) + 1;
+	for (uint32_t i = 0; i < req.envc; i++)
+		p = stpcpy(p, envp[i]) + 1;
+
+	/* the state run_child()'s child would start with */
+	req.umask = (uint32_t)umask(0);
+	umask((mode_t)req.umask);
+	sigprocmask(SIG_SETMASK, NULL, &blocked);
+	for (int sig = 1; sig < 64 && sig < NSIG; sig++) {
+		struct sigaction sa;
+
+		if (sigaction(sig, NULL, &sa) == 0 && sa.sa_handler == SIG_IGN)
+			req.ignored |= 1ULL << sig;
+		if (sigismember(&blocked, sig) == 1)
+			req.blocked |= 1ULL << sig;
+	}
+	for (size_t i = 0; i < ARRAY_SIZE(forwarded_sigs); i++)
+		req.ignored &= ~(1ULL << forwarded_sigs[i]);
+
+	/* taskset, nice and ulimit must apply as they do without a zygote */
+	sched_getaffinity(0, sizeof(cpu_set_t), (cpu_set_t *)req.cpus);
+	errno = 0;
+	req.nice = getpriority(PRIO_PROCESS, 0);
+	for (int i = 0; i < RLIM_NLIMITS; i++) {
+		struct rlimit rl;
+
+		if (getrlimit(i, &rl) != 0)
+			goto fallback;
+		req.rlim[i].cur = rl.rlim_cur;
+		req.rlim[i].max = rl.rlim_max;
+	}
+	zygote_cgroup(req.cgroup, sizeof(req.cgroup));
+
+	if (nfds) {
+		struct cmsghdr *c;
+
+		memset(&ctl, 0, sizeof(ctl));
+		msg.msg_control    = ctl.buf;
+		msg.msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)nfds);
+		c = CMSG_FIRSTHDR(&msg);
+		c->cmsg_level = SOL_SOCKET;
+		c->cmsg_type  = SCM_RIGHTS;
+		c->cmsg_len   = CMSG_LEN(sizeof(int) * (size_t)nfds);
+		memcpy(CMSG_DATA(c), req.fds, sizeof(int) * (size_t)nfds);
+	}
+
+	install_signal_handlers();
+
+	if (sendmsg(fd, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof(req) ||
+	    write_all(fd, blob, total) != 0 ||
+	    read_all(fd, &resp, sizeof(resp)) != 0 ||
+	    resp.kind != ZYGOTE_PID || resp.value <= 0) {
+		if (o->debug)
+			msg_warn("zygote: launch refused, forking locally");
+		goto fallback;
+	}
+	free(blob);
+
+	g_child_pid = (sig_atomic_t)resp.value;
+	exec_trace(exec_path, t, (pid_t)resp.value);
+	if (o->debug)
+		msg_info("zygote: forked pid %d", (int)resp.value);
+
+	if (o->wake_lock) {
+		t = stage_begin();
+		wake_lock_hold((pid_t)resp.value, o->debug);
+		stage_end("wake_lock", t);
+	}
+
+	t = stage_begin();
+	if (read_all(fd, &resp, sizeof(resp)) != 0 ||
+	    resp.kind != ZYGOTE_EXIT) {
+		msg_err("zygote: lost track of pid %d", (int)g_child_pid);
+		close(fd);
+		return 1;
+	}
+	stage_end("wait", t);
+	close(fd);
+	return wait_code(resp.value);
+
+fallback:
+	free(blob);
+	close(fd);
+	return -1;
+}
 
 /*
- * Signals to forward to the child process.
- * Includes SIGWINCH for correct terminal-resize handling in TUI apps.
+ * Dispatch to exec-in-place, a running zygote, or the supervised
+ * fork → exec → wait.  --stats and --profile need the program to be
+ * our own descendant and the event ring the child's PID, so all of
+ * them always take the last.
  */
-static const int forwarded_sigs[] = {
-	SIGINT, SIGTERM, SIGHUP, SIGQUIT, SIGUSR1, SIGUSR2, SIGWINCH,
+static int launch(const char *exec_path, char **argv, char **envp,
+		  const char *binary, const launch_opts_t *o)
+{
+	int rc;
+
+	if (o->stats || o->profile || o->record_io || bl_events)
+		return run_child(exec_path, argv, envp, binary, o);
+	if (o->exec_in_place)
+		return exec_child(exec_path, argv, envp, binary, o);
+	rc = zygote_run(exec_path, argv, envp, binary, o);
+	if (rc >= 0)
+		return rc;
+	return run_child(exec_path, argv, envp, binary, o);
+}
+
+/* ── launch planning ─────────────────────────────────────────────── */
+
+/*
+ * Everything about launching a command that does not depend on its
+ * arguments: the resolved binary, what to execve() and the
+ * environment.  main() builds one plan; the batch runner reuses one
+ * per distinct command name.
+ */
+struct launch_plan {
+	char        name[PATH_MAX];	/* command as given, passed as argv0 */
+	char        binary[PATH_MAX];	/* resolved path */
+	char        box64[PATH_MAX];
+	char        preload_buf[PATH_MAX];
+	const char *exec_path;		/* loader, box64 or the binary */
+	const char *prefix[8];		/* exec argv before the user args */
+	size_t      nprefix;
+	char      **envp;		/* NULL → native, keeps our environ */
+	struct bl_event ev;		/* the decision, for the event ring */
 };
 
+static void plan_free(struct launch_plan *lp)
+{
+	if (lp->envp)
+		free_env(lp->envp);
+	lp->envp = NULL;
+}
+
 /*
- * Use sig_atomic_t — pid_t writes are not guaranteed atomic on all
- * architectures.  Valid PIDs fit comfortably in sig_atomic_t.
+ * Resolve and classify @name and work out how to run it.  Returns 0,
+ * or the exit code to fail with after reporting why.
  */
-static volatile sig_atomic_t g_child_pid;
+static int plan_launch(const char *name, const launch_opts_t *o,
+		       struct launch_plan *lp)
+{
+	int debug = o->debug, use_preload = o->use_preload;
+	char *preload = NULL;
+	uint64_t t;
 
-static void forward_signal(int sig)
+	memset(lp, 0, sizeof(*lp));
+	snprintf(lp->name, sizeof(lp->name), "%s", name);
+
+	/* ── resolve binary ───────────────────────────────────────── */
+	t = stage_begin();
+	if (!find_in_path(name, lp->binary, sizeof(lp->binary))) {
+		msg_err("binary not found: %s", name);
+		return 127;
+	}
+	stage_end("find_in_path", t);
+
+	if (debug)
+		msg_info("resolved: %s", lp->binary);
+
+	/* ── analyse ELF ──────────────────────────────────────────── */
+	t = stage_begin();
+	elf_cache_attach(get_cache_dir());
+
+	binary_info_t info = analyze_binary(lp->binary);
+	stage_end("analyze_binary", t);
+
+	switch (info.arch) {
+	case ARCH_ERROR:   msg_err("cannot read: %s",              lp->binary); return 1;
+	case ARCH_NOT_ELF: msg_err("not an ELF binary: %s",       lp->binary); return 1;
+	case ARCH_UNKNOWN: msg_err("unsupported architecture: %s", lp->binary); return 1;
+	default: break;
+	}
+
+	if (debug) {
+		const char *arch_s = info.arch == ARCH_AARCH64 ? "arm64" : "x86_64";
+		const char *interp_s;
+		switch (info.interp) {
+		case INTERP_GLIBC:  interp_s = "glibc";   break;
+		case INTERP_BIONIC: interp_s = "bionic";   break;
+		case INTERP_MUSL:   interp_s = "musl";     break;
+		case INTERP_NONE:   interp_s = "none";     break;
+		default:            interp_s = "other";    break;
+		}
+		msg_info("arch=%s interp=%s (%s)", arch_s, interp_s,
+			 info.interp_path);
+	}
+
+	/* ── musl: unsupported ────────────────────────────────────── */
+	if (info.interp == INTERP_MUSL) {
+		msg_err("musl binaries are not supported "
+			"(ABI-incompatible with glibc)");
+		return 1;
+	}
+
+	/*
+	 * ── library closure ──────────────────────────────────────
+	 * Start reading an arm64 glibc program's libraries and learned
+	 * files, and see whether anything in it needs the preload.
+	 */
+	if (info.arch == ARCH_AARCH64 && info.interp != INTERP_BIONIC) {
+		struct deps deps = { 0 };
+		int cached = deps_closure(&deps, lp->binary, GLIBC_LOADER,
+					  GLIBC_LIB, 0);
+
+		deps_prefetch(&deps, cached, debug);
+		iot_replay(lp->binary, debug);
+		if (use_preload)
+			use_preload = preload_needed(&deps, o, debug);
+		deps_free(&deps);
+	}
+
+	/*
+	 * ── extract preload library ──────────────────────────────
+	 * Only arm64 glibc programs load it — box64 runs x86_64 code
+	 * that cannot — so skip the work for everything else.
+	 */
+	if (use_preload && info.arch == ARCH_AARCH64 &&
+	    info.interp != INTERP_BIONIC) {
+		t = stage_begin();
+		preload = extract_preload(lp->preload_buf,
+					  sizeof(lp->preload_buf),
+					  o->preload_memfd);
+		stage_end("extract_preload", t);
+
+		if (debug) {
+			if (preload) msg_info("preload: %s", preload);
+			else         msg_warn("no preload library available");
+		}
+	}
+
+	/* ── x86_64 via box64 ─────────────────────────────────────── */
+	if (info.arch == ARCH_X86_64) {
+		t = stage_begin();
+		if (!find_box64(lp->box64, sizeof(lp->box64))) {
+			msg_err("box64 is required for x86_64 binaries "
+				"but not found!");
+			fprintf(stderr, C_YELLOW "hint:" C_RESET
+				" Install box64 or add it to your PATH\n");
+			return 127;
+		}
+
+		ensure_box64_wrapper(lp->box64);
+
+		binary_info_t b64 = analyze_binary(lp->box64);
+		int b64_glibc = (b64.interp == INTERP_GLIBC);
+		stage_end("box64", t);
+
+		deps_readahead(lp->binary, NULL, GLIBC_LIB_X86, 1, debug);
+		deps_readahead(lp->box64, b64_glibc ? GLIBC_LOADER : NULL,
+			       b64_glibc ? GLIBC_LIB : NULL, 0, debug);
+
+		if (debug)
+			msg_info("box64: %s (glibc=%s)", lp->box64,
+				 b64_glibc ? "yes" : "no");
+
+		t = stage_begin();
+		struct tune tune;
+		int tuned = tune_lookup(lp->binary, o->box64_profile, &tune,
+					debug);
+		char b64c[PATH_MAX];
+		const char *b64c_dir = b64c_prepare(lp->binary, lp->box64,
+						    b64c, sizeof(b64c), debug);
+
+		lp->envp = build_environment(preload, 1, use_preload,
+					     lp->binary, tuned ? &tune : NULL,
+					     b64c_dir, debug);
+		if (!lp->envp) { perror("build_environment"); return 1; }
+		stage_end("build_environment", t);
+
+		size_t k = 0;
+
+		if (b64_glibc) {
+			t = stage_begin();
+			int lib_path = !ld_cache_ready(debug);
+			stage_end("ld_cache", t);
+
+			lp->prefix[k++] = GLIBC_LOADER;
+			if (lib_path) {
+				lp->prefix[k++] = "--library-path";
+				lp->prefix[k++] = GLIBC_LIB;
+			}
+			lp->prefix[k++] = "--argv0";
+			lp->prefix[k++] = "box64";
+			lp->prefix[k++] = lp->box64;
+			lp->exec_path = GLIBC_LOADER;
+		} else {
+			lp->prefix[k++] = lp->box64;
+			lp->exec_path = lp->box64;
+		}
+		lp->prefix[k++] = lp->binary;
+		lp->nprefix = k;
+		return 0;
+	}
+
+	/* ── arm64 ────────────────────────────────────────────────── */
+
+	/* native bionic → just exec directly */
+	if (info.interp == INTERP_BIONIC) {
+		if (debug)
+			msg_info("native bionic binary, exec directly");
+		lp->exec_path = lp->binary;
+		lp->prefix[0] = lp->name;
+		lp->nprefix = 1;
+		return 0;
+	}
+
+	/* need glibc loader */
+	if (access(GLIBC_LOADER, X_OK) != 0) {
+		msg_err("glibc loader not found: %s", GLIBC_LOADER);
+		fprintf(stderr, C_YELLOW "hint:" C_RESET
+			" pkg install glibc-repo && "
+			"pkg install glibc\n");
+		return 1;
+	}
+
+	if (access(GLIBC_LIB, F_OK) != 0) {
+		msg_err("glibc lib not found: %s", GLIBC_LIB);
+		return 1;
+	}
+
+
+	/* with a current ld.so.cache the loader needs no search path */
+	t = stage_begin();
+	int lib_path = !ld_cache_ready(debug);
+	stage_end("ld_cache", t);
+
+	size_t k = 0;
+	lp->prefix[k++] = GLIBC_LOADER;
+	if (lib_path) {
+		lp->prefix[k++] = "--library-path";
+		lp->prefix[k++] = GLIBC_LIB;
+	}
+	lp->prefix[k++] = "--argv0";
+	lp->prefix[k++] = lp->name;
+	lp->prefix[k++] = lp->binary;
+	lp->nprefix = k;
+	lp->exec_path = GLIBC_LOADER;
+
+	t = stage_begin();
+	struct tune tune;
+	int tuned = tune_lookup(lp->binary, NULL, &tune, debug);
+
+	lp->envp = build_environment(preload, 0, use_preload, lp->binary,
+				     tuned ? &tune : NULL, NULL, debug);
+	if (!lp->envp) { perror("build_environment"); return 1; }
+	stage_end("build_environment", t);
+
+	if (debug)
+		msg_info("exec: %s %s%s %s", GLIBC_LOADER,
+			 lib_path ? "--library-path " : "",
+			 lib_path ? GLIBC_LIB : "(ld.so.cache)",
+			 lp->binary);
+	return 0;
+}
+
+/*
+ * Full exec argv: the plan's prefix followed by @args[1..@nargs).
+ * Returns a malloc()ed array that borrows its strings, or NULL.
+ */
+static char **plan_argv(const struct launch_plan *lp, size_t nargs,
+			char **args)
 {
-	pid_t pid = (pid_t)g_child_pid;
+	char **av = calloc(lp->nprefix + nargs + 1, sizeof(char *));
+	size_t k = 0;
+
+	if (!av)
+		return NULL;
+	for (size_t i = 0; i < lp->nprefix; i++)
+		av[k++] = (char *)lp->prefix[i];
+	for (size_t i = 1; i < nargs; i++)
+		av[k++] = args[i];
+	av[k] = NULL;
+	return av;
+}
+
+/* Describe the decision of @lp, planned since @t, for events_launch(). */
+static void events_plan(struct launch_plan *lp, uint64_t t)
+{
+	struct bl_event *ev = &lp->ev;
+
+	if (!bl_events)
+		return;
+
+	ev->ts_ns = t;
+	ev->decide_ns = (uint32_t)(bl_now_ns() - t);
+	ev->hook = BL_EV_LAUNCH;
+	ev->action = !lp->envp ? BL_ACT_NATIVE :
+		     lp->box64[0] ? BL_ACT_BOX64 : BL_ACT_LOADER;
+	ev->glibc = ev->action == BL_ACT_LOADER;
+	bl_event_str(ev->path, sizeof(ev->path), lp->name);
+	bl_event_str(ev->exec, sizeof(ev->exec), lp->exec_path);
+}
+
+/* ── batch runner ────────────────────────────────────────────────── */
+
+/*
+ * `bionilux --jobs N --batch <file|->` runs one command per input line,
+ * at most N at a time, under a single supervisor:
+ *
+ *   - each distinct command name is planned once (PATH lookup, ELF
+ *     analysis, preload, environment) and reused by every job naming it
+ *   - one wake-lock hold on the supervisor covers the whole batch
+ *   - exits arrive as pidfd readiness and signals through a signalfd;
+ *     a signal is forwarded to every running job with
+ *     pidfd_send_signal(), so a recycled PID is never hit
+ *
+ * Lines are split on blanks with sh-like '...', "..." and \ quoting —
+ * no expansions; empty lines and lines starting with # are skipped.
+ * Jobs read /dev/null.  Each finished job is reported on stderr with
+ * its exit code and duration, and the batch exits 1 if any failed.
+ */
+#define BATCH_MAX_PLANS		64
+#define BATCH_MAX_ARGS		1024
+
+struct batch_job {
+	pid_t    pid;		/* 0 → slot free */
+	int      pidfd;		/* -1 → only the waitpid() sweep sees it */
+	unsigned line;
+	uint64_t start_ns;
+	char    *cmd;		/* the input line, for the report */
+};
+
+struct batch_plan {
+	char               *name;
+	int                 rc;	/* plan_launch() failure, reused */
+	struct launch_plan  lp;
+};
 
-	if (pid > 0)
-		kill(pid, sig);
-}
+struct batch {
+	const launch_opts_t *o;
+	struct batch_plan   *plans[BATCH_MAX_PLANS];
+	size_t               nplans, evict;
+	sigset_t             oldmask;	/* restored in the jobs */
+	int                  nullfd;	/* the jobs' stdin */
+	unsigned             done, failed;
+};
 
 /*
- * Install signal forwarding handlers.
- * Must be called BEFORE fork() to avoid a race where a signal arrives
- * between fork() and handler installation.
- * g_child_pid is set to 0 initially — the handler checks pid > 0, so
- * signals arriving before we record the real PID are harmlessly ignored.
+ * Split @line in place into @argv (NULL-terminated, at most @max - 1
+ * words).  Returns the word count, or -1 on a bad line.
  */
-static void install_signal_handlers(void)
+static int batch_split(char *line, char **argv, int max)
 {
-	struct sigaction sa;
-
-	memset(&sa, 0, sizeof(sa));
-	sa.sa_handler = forward_signal;
-	sa.sa_flags   = SA_RESTART;
-	sigemptyset(&sa.sa_mask);
+	char *r = line, *w = line;
+	int n = 0;
 
-	g_child_pid = 0;
+	for (;;) {
+		while (*r == ' ' || *r == '\t')
+			r++;
+		if (!*r)
+			break;
+		if (n == max - 1)
+			return -1;
+		argv[n++] = w;
+
+		while (*r && *r != ' ' && *r != '\t') {
+			if (*r == '\'') {
+				char *e = strchr(r + 1, '\'');
+
+				if (!e)
+					return -1;
+				memmove(w, r + 1, (size_t)(e - r - 1));
+				w += e - r - 1;
+				r = e + 1;
+			} else if (*r == '"') {
+				for (r++; *r && *r != '"'; ) {
+					if (*r == '\\' && r[1] &&
+					    strchr("\"\\$`", r[1]))
+						r++;
+					*w++ = *r++;
+				}
+				if (!*r)
+					return -1;
+				r++;
+			} else {
+				if (*r == '\\' && r[1])
+					r++;
+				*w++ = *r++;
+			}
+		}
 
-	for (size_t i = 0; i < ARRAY_SIZE(forwarded_sigs); i++)
-		sigaction(forwarded_sigs[i], &sa, NULL);
+		/* w trails r: read the separator before terminating */
+		if (*r)
+			r++;
+		*w++ = '\0';
+		if (w < r)
+			w = r;
+	}
+	argv[n] = NULL;
+	return n;
 }
 
-/* ── child process execution ─────────────────────────────────────── */
-
-/*
- * Reset signal dispositions so the child starts with defaults.
- * Called between fork() and execve() — only uses async-signal-safe
- * functions.
- */
-static void child_reset_signals(void)
+static void batch_plan_free(struct batch_plan *bp)
 {
-	for (size_t i = 0; i < ARRAY_SIZE(forwarded_sigs); i++)
-		signal(forwarded_sigs[i], SIG_DFL);
+	plan_free(&bp->lp);
+	free(bp->name);
+	free(bp);
 }
 
 /*
- * Change CWD to the directory containing @binary_path.
- * Many programs (servers, benchmarks) expect to run from their own
- * directory so they can find adjacent data files.
+ * The plan for command @name, built on first use.  A full table
+ * evicts round-robin — plans are only read while forking.
  */
-static void chdir_to_binary(const char *binary_path)
+static struct batch_plan *batch_plan(struct batch *b, const char *name)
 {
-	char *copy, *dir;
+	struct batch_plan *bp;
+	uint64_t t;
 
-	copy = strdup(binary_path);
-	if (!copy)
-		return;
+	for (size_t i = 0; i < b->nplans; i++)
+		if (strcmp(b->plans[i]->name, name) == 0)
+			return b->plans[i];
 
-	dir = dirname(copy);
-	if (dir && *dir && strcmp(dir, ".") != 0) {
-		if (chdir(dir) < 0) { /* best-effort, non-fatal */ }
+	bp = calloc(1, sizeof(*bp));
+	if (!bp || !(bp->name = strdup(name))) {
+		free(bp);
+		return NULL;
 	}
+	t = bl_now_ns();
+	bp->rc = plan_launch(name, b->o, &bp->lp);
+	if (!bp->rc)
+		events_plan(&bp->lp, t);
 
-	free(copy);
+	if (b->nplans < BATCH_MAX_PLANS) {
+		b->plans[b->nplans++] = bp;
+	} else {
+		size_t i = b->evict++ % BATCH_MAX_PLANS;
+
+		batch_plan_free(b->plans[i]);
+		b->plans[i] = bp;
+	}
+	return bp;
+}
+
+/* Report the end of @j with exit code @code and free its slot. */
+static void batch_finish(struct batch *b, struct batch_job *j, int code)
+{
+	uint64_t ns = bl_now_ns() - j->start_ns;
+	unsigned long long s = ns / 1000000000, ms = ns / 1000000 % 1000;
+
+	if (code == 0) {
+		msg_ok("[%u] exit 0, %llu.%03llus: %s", j->line, s, ms, j->cmd);
+	} else {
+		msg_err("[%u] exit %d, %llu.%03llus: %s", j->line, code,
+			s, ms, j->cmd);
+		b->failed++;
+	}
+	b->done++;
+
+	if (j->pidfd >= 0)
+		close(j->pidfd);
+	free(j->cmd);
+	*j = (struct batch_job){ .pidfd = -1 };
 }
 
 /*
- * Unified fork → exec → wait.  Used by both arm64 and x86_64 paths.
- *
- * @exec_path  – binary to execve() (loader or box64)
- * @argv       – full argv array (already constructed by caller)
- * @envp       – full envp array
- * @binary     – user's target binary (for chdir)
- * @debug      – debug flag
- *
- * Returns the process exit code (0–255), or 1 on fork failure.
+ * Start input line @lineno in the free slot @j.  Blank and comment
+ * lines are skipped; a job that cannot start is reported at once.
  */
-static int run_child(const char *exec_path, char **argv, char **envp,
-		     const char *binary, int debug)
+static void batch_start(struct batch *b, struct batch_job *j, char *line,
+			unsigned lineno)
 {
-	pid_t child;
-	int status;
+	static char *args[BATCH_MAX_ARGS];
+	struct batch_plan *bp;
+	char **av;
+	uint64_t t;
+	int n;
+
+	line[strcspn(line, "\r\n")] = '\0';
+	line += strspn(line, " \t");
+	if (!*line || *line == '#')
+		return;
 
-	acquire_wake_lock(debug);
+	*j = (struct batch_job){
+		.pidfd = -1, .line = lineno, .start_ns = bl_now_ns(),
+		.cmd = strdup(line),
+	};
+	if (!j->cmd) {
+		perror("strdup");
+		return;
+	}
 
-	/*
-	 * Install signal handlers BEFORE fork() to close the race
-	 * window where a signal could arrive after fork() but before
-	 * handler installation.
-	 */
-	install_signal_handlers();
+	n = batch_split(line, args, BATCH_MAX_ARGS);
+	if (n <= 0) {
+		msg_err("[%u] cannot parse: %s", lineno, j->cmd);
+		batch_finish(b, j, 2);
+		return;
+	}
 
-	child = fork();
-	if (child == 0) {
-		/* child */
-		child_reset_signals();
-		chdir_to_binary(binary);
-		execve(exec_path, argv, envp);
-		msg_err("execve %s: %s", exec_path, strerror(errno));
+	bp = batch_plan(b, args[0]);
+	if (!bp || bp->rc) {
+		batch_finish(b, j, bp ? bp->rc : 1);
+		return;
+	}
+	av = plan_argv(&bp->lp, (size_t)n, args);
+	if (!av) {
+		batch_finish(b, j, 1);
+		return;
+	}
+
+	t = stage_begin();
+	j->pid = fork();
+	if (j->pid == 0) {
+		sigprocmask(SIG_SETMASK, &b->oldmask, NULL);
+		dup2(b->nullfd, STDIN_FILENO);
+		/* native commands keep our directory, as without --batch */
+		if (bp->lp.envp) {
+			chdir_to_binary(bp->lp.binary);
+			execve(bp->lp.exec_path, av, bp->lp.envp);
+		} else {
+			execv(bp->lp.exec_path, av);
+		}
+		msg_err("execve %s: %s", bp->lp.exec_path, strerror(errno));
 		_exit(127);
 	}
+	free(av);
 
-	if (child < 0) {
+	if (j->pid < 0) {
 		perror("fork");
-		release_wake_lock(debug);
+		j->pid = 0;
+		batch_finish(b, j, 1);
+		return;
+	}
+	exec_trace(bp->lp.exec_path, t, j->pid);
+	events_launch(&bp->lp.ev, j->pid);
+	j->pidfd = (int)syscall(__NR_pidfd_open, j->pid, 0);
+}
+
+/* Forward @sig to every running job. */
+static void batch_signal(struct batch_job *jobs, unsigned njobs, int sig)
+{
+	for (unsigned i = 0; i < njobs; i++) {
+		if (!jobs[i].pid)
+			continue;
+#ifdef __NR_pidfd_send_signal
+		if (jobs[i].pidfd >= 0 &&
+		    syscall(__NR_pidfd_send_signal, jobs[i].pidfd, sig,
+			    NULL, 0) == 0)
+			continue;
+#endif
+		kill(jobs[i].pid, sig);
+	}
+}
+
+static int batch_run(const char *path, unsigned njobs,
+		     const launch_opts_t *o)
+{
+	struct batch b = { .o = o };
+	struct batch_job *jobs = calloc(njobs, sizeof(*jobs));
+	struct pollfd *pfds = calloc(njobs + 1, sizeof(*pfds));
+	FILE *in = strcmp(path, "-") ? fopen(path, "re") : stdin;
+	uint64_t t0 = bl_now_ns(), ns;
+	char *line = NULL;
+	size_t cap = 0;
+	unsigned lineno = 0, running = 0;
+	int sfd, eof = 0, stop = 0;
+	sigset_t mask;
+
+	if (!in) {
+		msg_err("cannot open %s: %s", path, strerror(errno));
+		return 1;
+	}
+	if (!jobs || !pfds) {
+		perror("calloc");
 		return 1;
 	}
+	for (unsigned i = 0; i < njobs; i++)
+		jobs[i].pidfd = -1;
 
-	/* parent — record PID so the handler can forward signals */
-	g_child_pid = (sig_atomic_t)child;
-	waitpid(child, &status, 0);
-	release_wake_lock(debug);
+	/* signals become events; SIGCHLD covers kernels without pidfds */
+	sigemptyset(&mask);
+	for (size_t i = 0; i < ARRAY_SIZE(forwarded_sigs); i++)
+		sigaddset(&mask, forwarded_sigs[i]);
+	sigaddset(&mask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &mask, &b.oldmask);
+	sfd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+	b.nullfd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	if (sfd < 0 || b.nullfd < 0) {
+		perror("signalfd");
+		return 1;
+	}
 
-	if (WIFEXITED(status))
-		return WEXITSTATUS(status);
-	if (WIFSIGNALED(status))
-		return 128 + WTERMSIG(status);
-	return 1;
+	if (o->wake_lock)
+		wake_lock_hold(getpid(), o->debug);
+
+	for (;;) {
+		int status;
+		pid_t pid;
+
+		/* fill free slots */
+		for (unsigned i = 0; i < njobs && !eof && !stop; i++) {
+			while (!jobs[i].pid && !eof) {
+				if (getline(&line, &cap, in) < 0) {
+					eof = 1;
+					break;
+				}
+				batch_start(&b, &jobs[i], line, ++lineno);
+			}
+		}
+
+		running = 0;
+		pfds[0] = (struct pollfd){ .fd = sfd, .events = POLLIN };
+		for (unsigned i = 0; i < njobs; i++) {
+			pfds[i + 1] = (struct pollfd){
+				.fd = jobs[i].pid ? jobs[i].pidfd : -1,
+				.events = POLLIN,
+			};
+			running += jobs[i].pid != 0;
+		}
+		if (!running && (eof || stop))
+			break;
+
+		if (poll(pfds, njobs + 1, -1) < 0 && errno != EINTR)
+			break;
+
+		if (pfds[0].revents & POLLIN) {
+			struct signalfd_siginfo si;
+
+			while (read(sfd, &si, sizeof(si)) == sizeof(si)) {
+				int sig = (int)si.ssi_signo;
+
+				if (sig == SIGCHLD)
+					continue;
+				batch_signal(jobs, njobs, sig);
+				if (sig == SIGINT || sig == SIGTERM ||
+				    sig == SIGHUP || sig == SIGQUIT)
+					stop = 1;
+			}
+		}
+
+		while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+			for (unsigned i = 0; i < njobs; i++)
+				if (jobs[i].pid == pid)
+					batch_finish(&b, &jobs[i],
+						     wait_code(status));
+	}
+
+	ns = bl_now_ns() - t0;
+	msg_info("%u jobs, %u failed, %llu.%03llus%s", b.done, b.failed,
+		 (unsigned long long)(ns / 1000000000),
+		 (unsigned long long)(ns / 1000000 % 1000),
+		 stop ? " (interrupted)" : "");
+
+	for (size_t i = 0; i < b.nplans; i++)
+		batch_plan_free(b.plans[i]);
+	if (in != stdin)
+		fclose(in);
+	free(line);
+	free(pfds);
+	free(jobs);
+	close(b.nullfd);
+	close(sfd);
+	return b.failed || stop ? 1 : 0;
 }
 
 /* ── CLI ─────────────────────────────────────────────────────────── */
@@ -710,11 +6368,30 @@ static void print_usage(const char *prog)
 		" — Run glibc/x86_64 binaries on Termux\n\n"
 		C_YELLOW "Usage:" C_RESET " %s [options] <binary> [args...]\n\n"
 		C_YELLOW "Options:" C_RESET "\n"
-		"  -h, --help        Show this help\n"
-		"  -d, --debug       Verbose output\n"
-		"  -n, --no-preload  Skip LD_PRELOAD (for simple binaries)\n"
-		"  -v, --version     Show version\n"
-		"  --                End option parsing\n\n"
+		"  -h, --help          Show this help\n"
+		"  -d, --debug         Verbose output\n"
+		"  -n, --no-preload    Skip LD_PRELOAD (for simple binaries)\n"
+		"  -x, --exec          Exec in place, no resident bionilux parent\n"
+		"  -W, --no-wake-lock  Do not hold a Termux wake lock\n"
+		"  -m, --memfd         Serve the preload from memory, not storage\n"
+		"  -j, --jobs N        Run up to N batch commands at once\n"
+		"  --batch FILE|-      Run one command per line of FILE\n"
+		"  --rebuild-cache     Regenerate the glibc ld.so.cache, prune\n"
+		"                      preloads of older builds\n"
+		"  --zygote            Start the launch server (see README)\n"
+		"  --zygote-stop       Stop the launch server\n"
+		"  --stats[=json]      Report the process tree's resource usage\n"
+		"  --stats-file FILE   Write that report to FILE, not stderr\n"
+		"  --record-execs FILE Record every exec in the tree to FILE\n"
+		"  --profile FILE      Sample call stacks, write folded stacks\n"
+		"  --cpus big|little|all|LIST\n"
+		"                      Run the program on these cores only\n"
+		"  --threads-hint      Export OMP_NUM_THREADS/BOX64_MAXCPU to match\n"
+		"  --record-io[=SECS]  Learn the files read in the first SECS (10) s\n"
+		"  --box64-profile NAME\n"
+		"                      Tuning profile for x86_64 programs\n"
+		"  -v, --version       Show version\n"
+		"  --                  End option parsing\n\n"
 		C_YELLOW "Examples:" C_RESET "\n"
 		"  %s ./my_glibc_app\n"
 		"  %s ./x86_64_app\n"
@@ -743,7 +6420,19 @@ static void print_version(void)
 
 int main(int argc, char *argv[])
 {
-	int debug = 0, use_preload = 1, arg_start = 1;
+	launch_opts_t opts = { .use_preload = 1, .wake_lock = 1 };
+	int arg_start = 1;
+	const char *exec_env = getenv("BIONILUX_EXEC");
+	const char *memfd_env = getenv("BIONILUX_PRELOAD_MEMFD");
+	const char *batch = NULL;
+	unsigned jobs = 0;
+
+	stage_init();
+
+	if (exec_env && *exec_env && strcmp(exec_env, "0") != 0)
+		opts.exec_in_place = 1;
+	if (memfd_env && *memfd_env && strcmp(memfd_env, "0") != 0)
+		opts.preload_memfd = 1;
 
 	/* ── parse options ────────────────────────────────────────── */
 	while (arg_start < argc && argv[arg_start][0] == '-') {
@@ -754,9 +6443,130 @@ int main(int argc, char *argv[])
 		if (!strcmp(opt, "-v") || !strcmp(opt, "--version"))
 			{ print_version(); return 0; }
 		if (!strcmp(opt, "-d") || !strcmp(opt, "--debug"))
-			{ debug = 1; arg_start++; continue; }
+			{ opts.debug = 1; arg_start++; continue; }
 		if (!strcmp(opt, "-n") || !strcmp(opt, "--no-preload"))
-			{ use_preload = 0; arg_start++; continue; }
+			{ opts.use_preload = 0; arg_start++; continue; }
+		if (!strcmp(opt, "-x") || !strcmp(opt, "--exec"))
+			{ opts.exec_in_place = 1; arg_start++; continue; }
+		if (!strcmp(opt, "-W") || !strcmp(opt, "--no-wake-lock"))
+			{ opts.wake_lock = 0; arg_start++; continue; }
+		if (!strcmp(opt, "-m") || !strcmp(opt, "--memfd"))
+			{ opts.preload_memfd = 1; arg_start++; continue; }
+		if (!strcmp(opt, "-j") || !strcmp(opt, "--jobs")) {
+			if (arg_start + 1 >= argc ||
+			    (jobs = (unsigned)atoi(argv[arg_start + 1])) < 1) {
+				msg_err("%s needs a job count", opt);
+				return 1;
+			}
+			arg_start += 2;
+			continue;
+		}
+		if (!strcmp(opt, "--batch")) {
+			if (arg_start + 1 >= argc) {
+				msg_err("--batch needs a file (or -)");
+				return 1;
+			}
+			batch = argv[arg_start + 1];
+			arg_start += 2;
+			continue;
+		}
+		if (!strcmp(opt, "--rebuild-cache")) {
+			int n = ld_cache_rebuild(opts.debug);
+			char path[PATH_MAX];
+
+			if (n < 0 || ld_cache_path(GLIBC_LIB, path,
+						   sizeof(path)) != 0) {
+				msg_err("cannot write ld.so.cache for %s",
+					GLIBC_LIB);
+				return 1;
+			}
+			msg_ok("ld.so.cache: %d libraries → %s", n, path);
+#ifdef EMBED_PRELOAD
+			n = prune_old_preloads();
+			if (n > 0)
+				msg_ok("removed %d preload(s) of older builds",
+				       n);
+#endif
+			return 0;
+		}
+		if (!strcmp(opt, "--zygote"))
+			return zygote_start(opts.debug);
+		if (!strcmp(opt, "--zygote-stop"))
+			return zygote_stop();
+		if (!strcmp(opt, "--stats") || !strcmp(opt, "--stats=text"))
+			{ opts.stats = STATS_TEXT; arg_start++; continue; }
+		if (!strcmp(opt, "--stats=json"))
+			{ opts.stats = STATS_JSON; arg_start++; continue; }
+		if (!strcmp(opt, "--stats-file")) {
+			if (arg_start + 1 >= argc) {
+				msg_err("--stats-file needs a file");
+				return 1;
+			}
+			opts.stats_file = argv[arg_start + 1];
+			if (!opts.stats)
+				opts.stats = STATS_TEXT;
+			arg_start += 2;
+			continue;
+		}
+		if (!strncmp(opt, "--cpus=", 7) && opt[7])
+			{ opts.cpus = opt + 7; arg_start++; continue; }
+		if (!strcmp(opt, "--cpus")) {
+			if (arg_start + 1 >= argc) {
+				msg_err("--cpus needs big, little, all or a list");
+				return 1;
+			}
+			opts.cpus = argv[arg_start + 1];
+			arg_start += 2;
+			continue;
+		}
+		if (!strcmp(opt, "--threads-hint"))
+			{ opts.threads_hint = 1; arg_start++; continue; }
+		if (!strcmp(opt, "--record-io"))
+			{ opts.record_io = IOT_DEFAULT_SECS; arg_start++; continue; }
+		if (!strncmp(opt, "--record-io=", 12)) {
+			char *end;
+			unsigned long secs = strtoul(opt + 12, &end, 10);
+
+			if (*end || !secs || secs > 3600) {
+				msg_err("--record-io: not 1..3600 seconds: %s",
+					opt + 12);
+				return 1;
+			}
+			opts.record_io = (unsigned)secs;
+			arg_start++;
+			continue;
+		}
+		if (!strncmp(opt, "--box64-profile=", 16) && opt[16])
+			{ opts.box64_profile = opt + 16; arg_start++; continue; }
+		if (!strcmp(opt, "--box64-profile")) {
+			if (arg_start + 1 >= argc) {
+				msg_err("--box64-profile needs a profile name");
+				return 1;
+			}
+			opts.box64_profile = argv[arg_start + 1];
+			arg_start += 2;
+			continue;
+		}
+		if (!strncmp(opt, "--profile=", 10) && opt[10])
+			{ opts.profile = opt + 10; arg_start++; continue; }
+		if (!strcmp(opt, "--profile")) {
+			if (arg_start + 1 >= argc) {
+				msg_err("--profile needs a file");
+				return 1;
+			}
+			opts.profile = argv[arg_start + 1];
+			arg_start += 2;
+			continue;
+		}
+		if (!strcmp(opt, "--record-execs")) {
+			if (arg_start + 1 >= argc) {
+				msg_err("--record-execs needs a file");
+				return 1;
+			}
+			opts.record_execs = argv[arg_start + 1];
+			arg_start += 2;
+			continue;
+		}
 		if (!strcmp(opt, "--"))
 			{ arg_start++; break; }
 
@@ -764,176 +6574,80 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
-	if (arg_start >= argc) {
-		print_usage(argv[0]);
+	if ((opts.cpus || opts.threads_hint) &&
+	    cpus_apply(opts.cpus, opts.threads_hint, opts.debug) != 0)
 		return 1;
-	}
-
-	/* ── resolve binary ───────────────────────────────────────── */
-	const char *binary_name = argv[arg_start];
-	char binary_path[PATH_MAX];
-
-	if (!find_in_path(binary_name, binary_path, sizeof(binary_path))) {
-		msg_err("binary not found: %s", binary_name);
-		return 127;
-	}
-
-	if (debug)
-		msg_info("resolved: %s", binary_path);
-
-	/* ── analyse ELF ──────────────────────────────────────────── */
-	binary_info_t info = analyze_binary(binary_path);
-
-	switch (info.arch) {
-	case ARCH_ERROR:   msg_err("cannot read: %s",              binary_path); return 1;
-	case ARCH_NOT_ELF: msg_err("not an ELF binary: %s",       binary_path); return 1;
-	case ARCH_UNKNOWN: msg_err("unsupported architecture: %s", binary_path); return 1;
-	default: break;
-	}
-
-	if (debug) {
-		const char *arch_s = info.arch == ARCH_AARCH64 ? "arm64" : "x86_64";
-		const char *interp_s;
-		switch (info.interp) {
-		case INTERP_GLIBC:  interp_s = "glibc";   break;
-		case INTERP_BIONIC: interp_s = "bionic";   break;
-		case INTERP_MUSL:   interp_s = "musl";     break;
-		case INTERP_NONE:   interp_s = "none";     break;
-		default:            interp_s = "other";    break;
-		}
-		msg_info("arch=%s interp=%s (%s)", arch_s, interp_s,
-			 info.interp_path);
-	}
 
-	/* ── musl: unsupported ────────────────────────────────────── */
-	if (info.interp == INTERP_MUSL) {
-		msg_err("musl binaries are not supported "
-			"(ABI-incompatible with glibc)");
+	if (opts.record_execs && events_create() != 0) {
+		msg_err("--record-execs: %s", strerror(errno));
 		return 1;
 	}
-
-	/* ── extract preload library ──────────────────────────────── */
-	char preload_buf[PATH_MAX];
-	char *preload = extract_preload(preload_buf, sizeof(preload_buf));
-
-	if (debug) {
-		if (preload) msg_info("preload: %s", preload);
-		else         msg_warn("no preload library available");
-	}
-
-	/* ── x86_64 via box64 ─────────────────────────────────────── */
-	if (info.arch == ARCH_X86_64) {
-		char box64_path[PATH_MAX];
-
-		if (!find_box64(box64_path, sizeof(box64_path))) {
-			msg_err("box64 is required for x86_64 binaries "
-				"but not found!");
-			fprintf(stderr, C_YELLOW "hint:" C_RESET
-				" Install box64 or add it to your PATH\n");
-			return 127;
-		}
-
-		ensure_box64_wrapper(box64_path);
-
-		binary_info_t b64 = analyze_binary(box64_path);
-		int b64_glibc = (b64.interp == INTERP_GLIBC);
-
-		if (debug)
-			msg_info("box64: %s (glibc=%s)", box64_path,
-				 b64_glibc ? "yes" : "no");
-
-		char **env = build_environment(preload, 1, use_preload,
-					       binary_path, debug);
-		if (!env) { perror("build_environment"); return 1; }
-
-		size_t orig_argc = (size_t)(argc - arg_start);
-		size_t extra = b64_glibc ? 8 : 3;
-		char **av = calloc(orig_argc + extra, sizeof(char *));
-		if (!av) { perror("calloc"); free_env(env); return 1; }
-
-		const char *exec_path;
-		int k = 0;
-
-		if (b64_glibc) {
-			av[k++] = (char *)GLIBC_LOADER;
-			av[k++] = (char *)"--library-path";
-			av[k++] = (char *)GLIBC_LIB;
-			av[k++] = (char *)"--argv0";
-			av[k++] = (char *)"box64";
-			av[k++] = box64_path;
-			av[k++] = binary_path;
-			exec_path = GLIBC_LOADER;
-		} else {
-			av[k++] = box64_path;
-			av[k++] = binary_path;
-			exec_path = box64_path;
-		}
-
-		for (size_t i = 1; i < orig_argc; i++)
-			av[k++] = argv[arg_start + (int)i];
-		av[k] = NULL;
-
-		int rc = run_child(exec_path, av, env, binary_path, debug);
-		free(av);
-		free_env(env);
-		return rc;
-	}
-
-	/* ── arm64 ────────────────────────────────────────────────── */
-	if (info.arch == ARCH_AARCH64) {
-
-		/* native bionic → just exec directly */
-		if (info.interp == INTERP_BIONIC) {
-			if (debug)
-				msg_info("native bionic binary, exec directly");
-			execv(binary_path, &argv[arg_start]);
-			perror("execv");
+	if (!opts.record_execs)
+		bl_events_attach(getenv(BL_EVENTS_ENV));
+
+	if (batch) {
+		if (opts.stats || opts.profile || opts.record_io) {
+			msg_err("%s does not apply to --batch",
+				opts.stats ? "--stats" :
+				opts.profile ? "--profile" : "--record-io");
 			return 1;
 		}
-
-		/* need glibc loader */
-		if (access(GLIBC_LOADER, X_OK) != 0) {
-			msg_err("glibc loader not found: %s", GLIBC_LOADER);
-			fprintf(stderr, C_YELLOW "hint:" C_RESET
-				" pkg install glibc-repo && "
-				"pkg install glibc\n");
+		if (arg_start < argc) {
+			msg_err("--batch takes its commands from %s", batch);
 			return 1;
 		}
-
-		if (access(GLIBC_LIB, F_OK) != 0) {
-			msg_err("glibc lib not found: %s", GLIBC_LIB);
-			return 1;
+		if (!jobs) {
+			long n = sysconf(_SC_NPROCESSORS_ONLN);
+			jobs = n > 0 ? (unsigned)n : 1;
 		}
+		return events_finish(&opts, batch_run(batch, jobs, &opts));
+	}
+	if (jobs) {
+		msg_err("--jobs needs --batch");
+		return 1;
+	}
 
-		size_t orig_argc = (size_t)(argc - arg_start);
-		char **av = calloc(orig_argc + 7, sizeof(char *));
-		if (!av) { perror("calloc"); return 1; }
-
-		int k = 0;
-		av[k++] = (char *)GLIBC_LOADER;
-		av[k++] = (char *)"--library-path";
-		av[k++] = (char *)GLIBC_LIB;
-		av[k++] = (char *)"--argv0";
-		av[k++] = argv[arg_start];
-		av[k++] = binary_path;
-		for (size_t i = 1; i < orig_argc; i++)
-			av[k++] = argv[arg_start + (int)i];
-		av[k] = NULL;
-
-		char **env = build_environment(preload, 0, use_preload,
-					       binary_path, debug);
-		if (!env) { perror("build_environment"); free(av); return 1; }
+	if (arg_start >= argc) {
+		print_usage(argv[0]);
+		return 1;
+	}
 
-		if (debug)
-			msg_info("exec: %s --library-path %s %s",
-				 GLIBC_LOADER, GLIBC_LIB, binary_path);
+	if (opts.record_io && iot_create(opts.record_io) != 0) {
+		msg_err("--record-io: %s", strerror(errno));
+		return 1;
+	}
 
-		int rc = run_child(GLIBC_LOADER, av, env, binary_path, debug);
-		free(av);
-		free_env(env);
-		return rc;
+	struct launch_plan lp;
+	uint64_t t = bl_now_ns();
+	int rc = plan_launch(argv[arg_start], &opts, &lp);
+
+	if (rc)
+		return events_finish(&opts, rc);
+	events_plan(&lp, t);
+	g_launch_ev = &lp.ev;
+
+	if (!lp.envp && opts.record_io)
+		msg_warn("--record-io: %s does not load the preload, "
+			 "nothing to trace", lp.binary);
+
+	/* native bionic: nothing to supervise, unless asked to account */
+	if (!lp.envp && (opts.stats || opts.profile || bl_events))
+		return events_finish(&opts,
+				     launch(lp.binary, &argv[arg_start],
+					    environ, NULL, &opts));
+	if (!lp.envp) {
+		execv(lp.binary, &argv[arg_start]);
+		perror("execv");
+		return 1;
 	}
 
-	msg_err("unreachable");
-	return 1;
+	char **av = plan_argv(&lp, (size_t)(argc - arg_start),
+			      &argv[arg_start]);
+	if (!av) { perror("calloc"); plan_free(&lp); return 1; }
+
+	rc = launch(lp.exec_path, av, lp.envp, lp.binary, &opts);
+	free(av);
+	plan_free(&lp);
+	iot_save(lp.binary);
+	return events_finish(&opts, rc);
 }
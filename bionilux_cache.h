@@ -0,0 +1,242 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * bionilux_cache.h — Persistent memory-mapped lookup tables
+ *
+ * Used by both bionilux.c (bionic) and bionilux_preload.c (glibc).
+ *
+ * A table is a plain file in the bionilux cache directory that every
+ * process maps MAP_SHARED.  It starts with a small header followed by
+ * fixed-size slots.  Each slot begins with a 64-bit sequence counter
+ * that works as a per-slot seqlock, so readers and writers in
+ * different processes never block each other:
+ *
+ *   seq == 0        empty
+ *   seq odd         being written — readers treat it as a miss
+ *   seq even, > 0   valid
+ *
+ * A writer that loses the race for a slot simply skips its update.
+ * Tables are pure accelerators: every miss falls back to the slow
+ * path, so a lost or torn update only ever costs time.
+ */
+#ifndef BIONILUX_CACHE_H
+#define BIONILUX_CACHE_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* directory holding every persistent table, exported to children */
+#define BL_CACHE_DIR_ENV	"BIONILUX_CACHE_DIR"
+
+struct bl_table_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nslots;	/* power of two */
+	uint32_t slot_size;
+	uint8_t  reserved[48];
+};
+
+/* ── hashing ─────────────────────────────────────────────────────── */
+
+/* FNV-1a, chainable through @h (start with BL_HASH_INIT) */
+#define BL_HASH_INIT	0xcbf29ce484222325ULL
+
+static inline uint64_t bl_hash(uint64_t h, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	while (len--) {
+		h ^= *p++;
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+/* ── time ────────────────────────────────────────────────────────── */
+
+/* CLOCK_MONOTONIC in ns — one timeline shared by every process */
+static inline uint64_t bl_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* ── table mapping ───────────────────────────────────────────────── */
+
+static inline size_t bl_table_size(uint32_t nslots, uint32_t slot_size)
+{
+	return sizeof(struct bl_table_hdr) + (size_t)nslots * slot_size;
+}
+
+static inline void *bl_table_slot(struct bl_table_hdr *hdr, uint32_t idx)
+{
+	return (unsigned char *)(hdr + 1) +
+	       (size_t)(idx & (hdr->nslots - 1)) * hdr->slot_size;
+}
+
+/*
+ * Create a fresh, zero-filled table at @path.  The file is built under
+ * a private name and renamed into place, so concurrent openers only
+ * ever see a complete header.  Losing the rename race is harmless:
+ * processes that mapped the replaced file keep a private orphan.
+ */
+static inline int bl_table_create(const char *path,
+				  const struct bl_table_hdr *want)
+{
+	char tmp[PATH_MAX];
+	size_t size = bl_table_size(want->nslots, want->slot_size);
+	int fd;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid()) >=
+	    (int)sizeof(tmp))
+		return -1;
+
+	fd = open(tmp, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return -1;
+
+	if (ftruncate(fd, (off_t)size) != 0 ||
+	    pwrite(fd, want, sizeof(*want), 0) != (ssize_t)sizeof(*want) ||
+	    rename(tmp, path) != 0) {
+		close(fd);
+		unlink(tmp);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*
+ * Map the table @name inside @dir, creating or replacing it when it is
+ * missing or was written by an incompatible build.
+ *
+ * Returns the mapped header, or NULL if the cache is unavailable.
+ */
+static inline struct bl_table_hdr *bl_table_map(const char *dir,
+						const char *name,
+						uint32_t magic,
+						uint32_t version,
+						uint32_t nslots,
+						uint32_t slot_size)
+{
+	const struct bl_table_hdr want = {
+		.magic = magic, .version = version,
+		.nslots = nslots, .slot_size = slot_size,
+	};
+	size_t size = bl_table_size(nslots, slot_size);
+	char path[PATH_MAX];
+	struct bl_table_hdr *hdr;
+	struct stat st;
+	int fd;
+
+	if (!dir || !*dir ||
+	    snprintf(path, sizeof(path), "%s/%s", dir, name) >=
+	    (int)sizeof(path))
+		return NULL;
+
+	fd = open(path, O_RDWR | O_CLOEXEC);
+	if (fd >= 0 && (fstat(fd, &st) != 0 || (size_t)st.st_size != size)) {
+		close(fd);
+		fd = -1;
+	}
+	if (fd < 0)
+		fd = bl_table_create(path, &want);
+	if (fd < 0)
+		return NULL;
+
+	hdr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (hdr == MAP_FAILED)
+		return NULL;
+
+	if (memcmp(hdr, &want, offsetof(struct bl_table_hdr, reserved)) != 0) {
+		/* stale layout from another build — start over once */
+		munmap(hdr, size);
+		fd = bl_table_create(path, &want);
+		if (fd < 0)
+			return NULL;
+		hdr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			   fd, 0);
+		close(fd);
+		if (hdr == MAP_FAILED)
+			return NULL;
+	}
+
+	return hdr;
+}
+
+/*
+ * Publish a lazily mapped table in @slot exactly once.  Concurrent
+ * callers may both map the file; the loser unmaps its copy.
+ */
+static inline struct bl_table_hdr *
+bl_table_publish(struct bl_table_hdr **slot, struct bl_table_hdr *hdr)
+{
+	struct bl_table_hdr *expected = NULL;
+
+	if (!hdr)
+		return __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+
+	if (!__atomic_compare_exchange_n(slot, &expected, hdr, 0,
+					 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		munmap(hdr, bl_table_size(hdr->nslots, hdr->slot_size));
+		return expected;
+	}
+	return hdr;
+}
+
+/* ── per-slot seqlock ────────────────────────────────────────────── */
+
+/*
+ * Begin reading a slot.  Returns the sequence to pass to
+ * bl_seq_read_ok(), or 0 if the slot is empty or mid-update.
+ */
+static inline uint64_t bl_seq_read_begin(const uint64_t *seq)
+{
+	uint64_t s = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+
+	return (s & 1) ? 0 : s;
+}
+
+/* Returns 1 if the slot was not modified since bl_seq_read_begin(). */
+static inline int bl_seq_read_ok(const uint64_t *seq, uint64_t start)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(seq, __ATOMIC_RELAXED) == start;
+}
+
+/*
+ * Claim a slot for writing.  Returns 0 and stores the claimed
+ * sequence in @out on success, -1 if another writer holds it.
+ */
+static inline int bl_seq_write_begin(uint64_t *seq, uint64_t *out)
+{
+	uint64_t s = __atomic_load_n(seq, __ATOMIC_RELAXED);
+
+	if (s & 1)
+		return -1;
+	if (!__atomic_compare_exchange_n(seq, &s, s + 1, 0,
+					 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return -1;
+	/* the odd sequence must be visible before any of the data stores */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	*out = s + 1;
+	return 0;
+}
+
+static inline void bl_seq_write_end(uint64_t *seq, uint64_t claimed)
+{
+	__atomic_store_n(seq, claimed + 1, __ATOMIC_RELEASE);
+}
+
+#endif /* BIONILUX_CACHE_H */
@@ -12,9 +12,14 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <stdint.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include "bionilux_cache.h"
+
 /* ── EINTR-safe pread ────────────────────────────────────────────── */
 
 /*
@@ -33,89 +38,564 @@ static inline ssize_t elf_pread(int fd, void *buf, size_t count, off_t offset)
 	return n;
 }
 
-/* ── glibc ELF detection ─────────────────────────────────────────── */
+/* ── classification ──────────────────────────────────────────────── */
+
+typedef enum {
+	ARCH_UNKNOWN = 0,
+	ARCH_AARCH64,
+	ARCH_X86_64,
+	ARCH_NOT_ELF,
+	ARCH_ERROR,
+} elf_arch_t;
+
+typedef enum {
+	INTERP_NONE = 0,
+	INTERP_GLIBC,
+	INTERP_BIONIC,
+	INTERP_MUSL,
+	INTERP_OTHER,
+} interp_type_t;
+
+/* binary_info_t.flags */
+#define ELF_F_DYNAMIC	0x0001	/* has PT_DYNAMIC */
+#define ELF_F_SCANNED	0x0002	/* imports scanned, see elf_classify_imports() */
+#define ELF_F_HOOKED	0x0004	/* imports a function the preload hooks */
+
+typedef struct {
+	elf_arch_t    arch;
+	interp_type_t interp;
+	uint16_t      e_type;
+	uint16_t      phnum;
+	uint16_t      flags;
+	char          interp_path[PATH_MAX];
+} binary_info_t;
+
+static inline interp_type_t elf_interp_type(const char *interp)
+{
+	if (strstr(interp, "ld-linux"))
+		return INTERP_GLIBC;
+	if (strstr(interp, "linker64") || strstr(interp, "linker"))
+		return INTERP_BIONIC;
+	if (strstr(interp, "ld-musl"))
+		return INTERP_MUSL;
+	return INTERP_OTHER;
+}
+
+/* ── single-read probe ───────────────────────────────────────────── */
 
 /*
- * Check whether @path is a dynamically-linked glibc ELF that needs
- * to be routed through the Termux glibc loader.
- *
- * @glibc_lib  If non-NULL, interpreter paths that already contain
- *             this string are considered "set up" and return 0.
- *
- * Returns:
- *    1  →  glibc binary, redirect through loader
- *    0  →  not glibc / static / already configured / musl
- *   -1  →  I/O error (cannot open or read)
+ * One pread of the first page normally covers the ELF header, the
+ * whole program header table and the PT_INTERP string, so the probe
+ * costs open + pread.  Anything outside the window is fetched with
+ * one more pread of exactly the span that is missing.
  */
-static inline int is_glibc_elf(const char *path, const char *glibc_lib)
+#define ELF_PROBE_SIZE	4096
+
+struct elf_window {
+	unsigned char *buf;
+	size_t         cap;
+	Elf64_Off      off;
+	size_t         len;
+};
+
+/*
+ * Return a pointer to @len bytes at file offset @off, re-reading the
+ * window only if the range is not already buffered.
+ */
+static inline const unsigned char *elf_window_get(int fd,
+						  struct elf_window *w,
+						  Elf64_Off off, size_t len)
+{
+	ssize_t n;
+
+	if (off >= w->off && len <= w->len && off - w->off <= w->len - len)
+		return w->buf + (off - w->off);
+
+	if (len > w->cap || off > (Elf64_Off)INT64_MAX)
+		return NULL;
+
+	n = elf_pread(fd, w->buf, w->cap, (off_t)off);
+	if (n < (ssize_t)len)
+		return NULL;
+
+	w->off = off;
+	w->len = (size_t)n;
+	return w->buf;
+}
+
+/*
+ * Return the @len bytes at @off, reading only what the window lacks:
+ * the part already buffered is kept and the rest comes from one pread
+ * of exactly [end of window, @off + @len).  A span larger than the
+ * window goes to an anonymous mapping, handed back in *@map for the
+ * caller to munmap(*@map, @len).  *@got is how many bytes are there,
+ * short only at end of file.
+ */
+static inline const unsigned char *elf_window_span(int fd,
+						   struct elf_window *w,
+						   Elf64_Off off, size_t len,
+						   size_t *got, void **map)
+{
+	unsigned char *dst;
+	size_t have = 0;
+	ssize_t n;
+
+	*got = 0;
+	*map = NULL;
+	if (off >= w->off && off - w->off < w->len) {
+		have = w->len - (size_t)(off - w->off);
+		if (have >= len) {
+			*got = len;
+			return w->buf + (off - w->off);
+		}
+	}
+	if (off > (Elf64_Off)INT64_MAX || len > (Elf64_Off)INT64_MAX - off)
+		return NULL;
+
+	if (len <= w->cap) {
+		dst = w->buf;
+		if (have)
+			memmove(dst, w->buf + (off - w->off), have);
+	} else {
+		dst = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (dst == MAP_FAILED)
+			return NULL;
+		if (have)
+			memcpy(dst, w->buf + (off - w->off), have);
+		*map = dst;
+	}
+
+	n = elf_pread(fd, dst + have, len - have, (off_t)(off + have));
+	*got = have + (n > 0 ? (size_t)n : 0);
+	if (dst == w->buf) {
+		w->off = off;
+		w->len = *got;
+	}
+	return dst;
+}
+
+/*
+ * Classify the ELF open on @fd: arch, e_type, PT_DYNAMIC and the
+ * PT_INTERP path with its interpreter type.  Program headers are
+ * walked in memory straight out of the probe buffer.
+ */
+static inline void elf_probe_fd(int fd, binary_info_t *info)
 {
+	unsigned char buf[ELF_PROBE_SIZE] __attribute__((aligned(8)));
+	struct elf_window win = { .buf = buf, .cap = sizeof(buf) };
+	const unsigned char *p;
 	Elf64_Ehdr ehdr;
-	int fd, ret = 0;
 
-	fd = open(path, O_RDONLY | O_CLOEXEC);
-	if (fd < 0)
-		return -1;
+	p = elf_window_get(fd, &win, 0, sizeof(ehdr));
+	if (!p) {
+		info->arch = ARCH_NOT_ELF;
+		return;
+	}
+	memcpy(&ehdr, p, sizeof(ehdr));
 
-	if (elf_pread(fd, &ehdr, sizeof(ehdr), 0) != (ssize_t)sizeof(ehdr))
-		goto out;
+	if (memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0) {
+		info->arch = ARCH_NOT_ELF;
+		return;
+	}
 
-	if (memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0)
-		goto out;
-	if (ehdr.e_ident[EI_CLASS] != ELFCLASS64)
-		goto out;
-	if (ehdr.e_type != ET_EXEC && ehdr.e_type != ET_DYN)
-		goto out;
-	if (ehdr.e_phoff == 0 || ehdr.e_phnum == 0)
-		goto out;
+	if (ehdr.e_ident[EI_CLASS] != ELFCLASS64) {
+		info->arch = ARCH_UNKNOWN;
+		return;
+	}
 
-	for (unsigned i = 0; i < ehdr.e_phnum; i++) {
+	switch (ehdr.e_machine) {
+	case EM_AARCH64: info->arch = ARCH_AARCH64; break;
+	case EM_X86_64:  info->arch = ARCH_X86_64;  break;
+	default:         info->arch = ARCH_UNKNOWN; break;
+	}
+	info->e_type = ehdr.e_type;
+
+	/* ── walk program headers ─────────────────────────────────── */
+	if (ehdr.e_phoff == 0 || ehdr.e_phnum == 0 ||
+	    ehdr.e_phentsize < sizeof(Elf64_Phdr))
+		return;
+
+	info->phnum = ehdr.e_phnum;
+
+	Elf64_Phdr interp = { .p_type = PT_NULL };
+	size_t tbl = (size_t)ehdr.e_phnum * ehdr.e_phentsize, got;
+	void *map;
+
+	/* a truncated table still yields the entries that are there */
+	p = elf_window_span(fd, &win, ehdr.e_phoff, tbl, &got, &map);
+	for (size_t i = 0; p && i < got / ehdr.e_phentsize; i++) {
 		Elf64_Phdr phdr;
-		off_t off = (off_t)(ehdr.e_phoff +
-				    (Elf64_Off)i * ehdr.e_phentsize);
 
-		if (elf_pread(fd, &phdr, sizeof(phdr), off) !=
-		    (ssize_t)sizeof(phdr))
-			break;
+		memcpy(&phdr, p + i * ehdr.e_phentsize, sizeof(phdr));
+
+		if (phdr.p_type == PT_DYNAMIC)
+			info->flags |= ELF_F_DYNAMIC;
+		else if (phdr.p_type == PT_INTERP && interp.p_type == PT_NULL)
+			interp = phdr;
+	}
+	if (map)
+		munmap(map, tbl);
+
+	if (interp.p_type != PT_INTERP || interp.p_filesz == 0 ||
+	    interp.p_filesz >= sizeof(info->interp_path))
+		return;
+
+	/* usually still inside the window, else one exact-size pread */
+	p = elf_window_span(fd, &win, interp.p_offset, interp.p_filesz,
+			    &got, &map);
+	if (!p || got != interp.p_filesz)
+		return;
+	memcpy(info->interp_path, p, interp.p_filesz);
+
+	/*
+	 * The ELF spec includes the NUL terminator in p_filesz.
+	 * Be safe: always NUL-terminate at the end of the data,
+	 * never truncate by using p_filesz - 1.
+	 */
+	info->interp_path[interp.p_filesz] = '\0';
+	info->interp = elf_interp_type(info->interp_path);
+}
+
+/* ── persistent classification cache ─────────────────────────────── */
+
+/*
+ * Classifications are keyed on (st_dev, st_ino, st_size, st_mtim), so
+ * a warm lookup costs one stat() and a hash probe.  Slots are chosen
+ * by (dev, ino) alone: rebuilding a binary in place overwrites its
+ * old entry instead of leaking a slot.
+ */
+#define ELF_CACHE_NAME		"elf.cache"
+#define ELF_CACHE_MAGIC		0x43454c42u	/* "BLEC" */
+#define ELF_CACHE_VERSION	3
+#define ELF_CACHE_SLOTS		2048
+#define ELF_CACHE_PROBE		8
+
+struct elf_cache_slot {
+	uint64_t seq;
+	uint64_t dev;
+	uint64_t ino;
+	int64_t  size;
+	int64_t  mtime_sec;
+	int64_t  mtime_nsec;
+	uint8_t  arch;
+	uint8_t  interp;
+	uint16_t e_type;
+	uint16_t phnum;
+	uint16_t flags;
+	char     interp_path[72];	/* longer interpreters aren't cached */
+};
+
+_Static_assert(sizeof(struct elf_cache_slot) == 128,
+	       "elf_cache_slot must stay 128 bytes");
+
+static struct bl_table_hdr *elf_cache;
+
+/*
+ * Map the classification cache in @dir.  Cheap after the first call;
+ * a NULL or unusable @dir leaves the cache disabled.
+ */
+static inline void elf_cache_attach(const char *dir)
+{
+	if (__atomic_load_n(&elf_cache, __ATOMIC_ACQUIRE) || !dir)
+		return;
+
+	bl_table_publish(&elf_cache,
+			 bl_table_map(dir, ELF_CACHE_NAME, ELF_CACHE_MAGIC,
+				      ELF_CACHE_VERSION, ELF_CACHE_SLOTS,
+				      sizeof(struct elf_cache_slot)));
+}
+
+static inline uint32_t elf_cache_hash(const struct stat *st)
+{
+	uint64_t dev = (uint64_t)st->st_dev, ino = (uint64_t)st->st_ino;
+	uint64_t h = bl_hash(BL_HASH_INIT, &dev, sizeof(dev));
 
-		if (phdr.p_type != PT_INTERP)
+	return (uint32_t)bl_hash(h, &ino, sizeof(ino));
+}
+
+static inline int elf_cache_key_eq(const struct elf_cache_slot *s,
+				   const struct stat *st)
+{
+	return s->dev == (uint64_t)st->st_dev &&
+	       s->ino == (uint64_t)st->st_ino &&
+	       s->size == (int64_t)st->st_size &&
+	       s->mtime_sec == (int64_t)st->st_mtim.tv_sec &&
+	       s->mtime_nsec == (int64_t)st->st_mtim.tv_nsec;
+}
+
+/* Returns 1 and fills @info on a hit, 0 on a miss. */
+static inline int elf_cache_lookup(const struct stat *st,
+				   binary_info_t *info)
+{
+	struct bl_table_hdr *hdr = __atomic_load_n(&elf_cache,
+						   __ATOMIC_ACQUIRE);
+	uint32_t h;
+
+	if (!hdr)
+		return 0;
+
+	h = elf_cache_hash(st);
+	for (uint32_t i = 0; i < ELF_CACHE_PROBE; i++) {
+		struct elf_cache_slot *s = bl_table_slot(hdr, h + i);
+		struct elf_cache_slot copy;
+		uint64_t seq = bl_seq_read_begin(&s->seq);
+
+		if (!seq)
+			continue;
+		memcpy(&copy, s, sizeof(copy));
+		if (!bl_seq_read_ok(&s->seq, seq) ||
+		    !elf_cache_key_eq(&copy, st))
 			continue;
 
-		if (phdr.p_filesz == 0 || phdr.p_filesz >= PATH_MAX)
-			break;
+		info->arch   = (elf_arch_t)copy.arch;
+		info->interp = (interp_type_t)copy.interp;
+		info->e_type = copy.e_type;
+		info->phnum  = copy.phnum;
+		info->flags  = copy.flags;
+		copy.interp_path[sizeof(copy.interp_path) - 1] = '\0';
+		memcpy(info->interp_path, copy.interp_path,
+		       sizeof(copy.interp_path));
+		return 1;
+	}
+	return 0;
+}
+
+static inline void elf_cache_store(const struct stat *st,
+				   const binary_info_t *info)
+{
+	struct bl_table_hdr *hdr = __atomic_load_n(&elf_cache,
+						   __ATOMIC_ACQUIRE);
+	struct elf_cache_slot *victim = NULL;
+	size_t ilen = strlen(info->interp_path);
+	uint64_t seq;
+	uint32_t h;
+
+	if (!hdr || info->arch == ARCH_ERROR ||
+	    ilen >= sizeof(victim->interp_path))
+		return;
 
-		char interp[PATH_MAX];
+	/* prefer this inode's old slot, then an empty one, else evict */
+	h = elf_cache_hash(st);
+	for (uint32_t i = 0; i < ELF_CACHE_PROBE; i++) {
+		struct elf_cache_slot *s = bl_table_slot(hdr, h + i);
 
-		if (elf_pread(fd, interp, phdr.p_filesz,
-			      (off_t)phdr.p_offset) !=
-		    (ssize_t)phdr.p_filesz)
+		if (s->dev == (uint64_t)st->st_dev &&
+		    s->ino == (uint64_t)st->st_ino) {
+			victim = s;
 			break;
+		}
+		if (!victim && __atomic_load_n(&s->seq, __ATOMIC_RELAXED) == 0)
+			victim = s;
+	}
+	if (!victim)
+		victim = bl_table_slot(hdr, h + (h >> 24) % ELF_CACHE_PROBE);
+
+	if (bl_seq_write_begin(&victim->seq, &seq) != 0)
+		return;
+
+	victim->dev        = (uint64_t)st->st_dev;
+	victim->ino        = (uint64_t)st->st_ino;
+	victim->size       = (int64_t)st->st_size;
+	victim->mtime_sec  = (int64_t)st->st_mtim.tv_sec;
+	victim->mtime_nsec = (int64_t)st->st_mtim.tv_nsec;
+	victim->arch       = (uint8_t)info->arch;
+	victim->interp     = (uint8_t)info->interp;
+	victim->e_type     = info->e_type;
+	victim->phnum      = info->phnum;
+	victim->flags      = info->flags;
+	memset(victim->interp_path, 0, sizeof(victim->interp_path));
+	memcpy(victim->interp_path, info->interp_path, ilen);
+
+	bl_seq_write_end(&victim->seq, seq);
+}
+
+/*
+ * Classify @path, consulting the persistent cache first.
+ *
+ * On a miss the binary is opened and the key is taken from fstat() on
+ * that descriptor, so a file replaced between stat() and open() is
+ * never cached under the wrong identity.
+ */
+static inline void elf_classify(const char *path, binary_info_t *info)
+{
+	struct stat st;
+	int fd;
+
+	info->arch   = ARCH_UNKNOWN;
+	info->interp = INTERP_NONE;
+	info->e_type = ET_NONE;
+	info->phnum  = 0;
+	info->flags  = 0;
+	info->interp_path[0] = '\0';
+
+	if (stat(path, &st) == 0 && elf_cache_lookup(&st, info))
+		return;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		info->arch = ARCH_ERROR;
+		return;
+	}
+
+	elf_probe_fd(fd, info);
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+		elf_cache_store(&st, info);
+	close(fd);
+}
+
+/* ── imports ─────────────────────────────────────────────────────── */
+
+/*
+ * Functions whose calls only behave under bionilux if the preload
+ * interposes them.  Fortified __readlink_chk is missing on purpose:
+ * glibc implements it with an internal call the preload never sees.
+ */
+static const char *const elf_hooked_imports[] = {
+	"execve", "execv", "execvp", "execvpe", "execl", "execlp", "execle",
+	"posix_spawn", "posix_spawnp", "system", "popen",
+	"readlink", "readlinkat",
+};
+
+/*
+ * Does the ELF open on @fd import one of elf_hooked_imports?  Walks the
+ * undefined symbols of the section-header-described .dynsym, version
+ * aside: any definition of these names is the one the preload wraps.
+ * Returns 1 or 0, or -1 if there is no readable .dynsym.
+ */
+static inline int elf_scan_imports(int fd)
+{
+	const unsigned char *m;
+	Elf64_Ehdr eh;
+	struct stat st;
+	size_t size;
+	int found = -1;
+
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(eh))
+		return -1;
+	size = (size_t)st.st_size;
+	m = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (m == MAP_FAILED)
+		return -1;
+
+	memcpy(&eh, m, sizeof(eh));
+	if (memcmp(eh.e_ident, ELFMAG, SELFMAG) != 0 ||
+	    eh.e_ident[EI_CLASS] != ELFCLASS64 ||
+	    eh.e_shentsize < sizeof(Elf64_Shdr) || eh.e_shoff > size ||
+	    (size - eh.e_shoff) / eh.e_shentsize < eh.e_shnum)
+		goto out;
 
-		/*
-		 * The ELF spec includes the NUL terminator in p_filesz.
-		 * Be safe: always NUL-terminate at the end of the data,
-		 * never truncate by using p_filesz - 1.
-		 */
-		interp[phdr.p_filesz] = '\0';
+	for (unsigned i = 0; i < eh.e_shnum && found < 0; i++) {
+		Elf64_Shdr sym, str;
+		size_t ent;
 
-		/* musl != glibc — ABI-incompatible, never redirect */
-		if (strstr(interp, "ld-musl"))
+		memcpy(&sym, m + eh.e_shoff + (size_t)i * eh.e_shentsize,
+		       sizeof(sym));
+		if (sym.sh_type != SHT_DYNSYM || sym.sh_link >= eh.e_shnum)
+			continue;
+		memcpy(&str, m + eh.e_shoff +
+			     (size_t)sym.sh_link * eh.e_shentsize, sizeof(str));
+		ent = sym.sh_entsize ? sym.sh_entsize : sizeof(Elf64_Sym);
+		if (ent < sizeof(Elf64_Sym) || sym.sh_offset > size ||
+		    sym.sh_size > size - sym.sh_offset ||
+		    str.sh_offset > size || str.sh_size > size - str.sh_offset)
 			break;
 
-		if (strstr(interp, "ld-linux")) {
-			/*
-			 * If the interpreter already points into the
-			 * Termux glibc prefix, no redirect is needed.
-			 */
-			if (glibc_lib && strstr(interp, glibc_lib))
-				break;
-			ret = 1;
+		found = 0;
+		for (size_t off = 0; off + ent <= sym.sh_size && !found;
+		     off += ent) {
+			const char *name;
+			Elf64_Sym s;
+
+			memcpy(&s, m + sym.sh_offset + off, sizeof(s));
+			if (s.st_shndx != SHN_UNDEF || !s.st_name ||
+			    s.st_name >= str.sh_size ||
+			    !memchr(m + str.sh_offset + s.st_name, '\0',
+				    str.sh_size - s.st_name))
+				continue;
+			name = (const char *)m + str.sh_offset + s.st_name;
+			for (size_t k = 0; k < sizeof(elf_hooked_imports) /
+					       sizeof(elf_hooked_imports[0]); k++)
+				if (!strcmp(name, elf_hooked_imports[k]))
+					found = 1;
 		}
-		break; /* PT_INTERP found, stop */
 	}
-
 out:
+	munmap((void *)m, size);
+	return found;
+}
+
+/*
+ * Classify @path like elf_classify() and also fill in ELF_F_SCANNED and
+ * ELF_F_HOOKED.  The scan reads the symbol tables, so it is done once
+ * per file version and cached with the classification; the preload,
+ * which only needs the classification, never pays for it.  A file
+ * whose imports cannot be read counts as hooked.
+ */
+static inline void elf_classify_imports(const char *path,
+					binary_info_t *info)
+{
+	struct stat st;
+	int fd;
+
+	elf_classify(path, info);
+	if ((info->flags & ELF_F_SCANNED) || info->arch == ARCH_ERROR)
+		return;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	/* probe again so what is cached matches the descriptor's file */
+	memset(info, 0, sizeof(*info));
+	elf_probe_fd(fd, info);
+	info->flags |= ELF_F_SCANNED;
+	if (elf_scan_imports(fd) != 0)
+		info->flags |= ELF_F_HOOKED;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+		elf_cache_store(&st, info);
 	close(fd);
-	return ret;
+}
+
+/* ── glibc ELF detection ─────────────────────────────────────────── */
+
+/*
+ * Check whether @path is a dynamically-linked glibc ELF that needs
+ * to be routed through the Termux glibc loader.
+ *
+ * @glibc_lib  If non-NULL, interpreter paths that already contain
+ *             this string are considered "set up" and return 0.
+ *
+ * Returns:
+ *    1  →  glibc binary, redirect through loader
+ *    0  →  not glibc / static / already configured / musl
+ *   -1  →  I/O error (cannot open or read)
+ */
+static inline int is_glibc_elf(const char *path, const char *glibc_lib)
+{
+	binary_info_t info;
+
+	elf_classify(path, &info);
+
+	if (info.arch == ARCH_ERROR)
+		return -1;
+	if (info.arch == ARCH_NOT_ELF ||
+	    (info.e_type != ET_EXEC && info.e_type != ET_DYN))
+		return 0;
+
+	/* musl != glibc — ABI-incompatible, never redirect */
+	if (info.interp != INTERP_GLIBC)
+		return 0;
+
+	/*
+	 * If the interpreter already points into the Termux glibc
+	 * prefix, no redirect is needed.
+	 */
+	if (glibc_lib && strstr(info.interp_path, glibc_lib))
+		return 0;
+
+	return 1;
 }
 
 #endif /* BIONILUX_ELF_H */
@@ -0,0 +1,197 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * bionilux_events.h — Shared-memory exec event ring (--record-execs)
+ *
+ * Used by both bionilux.c (bionic) and bionilux_preload.c (glibc).
+ *
+ * bionilux creates the ring in a memfd at a high descriptor that every
+ * descendant inherits, and names it in $BIONILUX_EVENTS_FD.  Each
+ * routing decision — bionilux's own and every hooked exec or spawn in
+ * the tree — appends one fixed-size record:
+ *
+ *   ticket = fetch_add(&head, 1)        reserve; never blocks
+ *   slot   = ticket % nslots
+ *   seq    = 2 * ticket + 1             being written
+ *   ... fill the record ...
+ *   seq    = 2 * ticket + 2             complete (release)
+ *
+ * A reader accepts a slot only if its seq matches the ticket it
+ * expects both before and after copying it, so records overwritten
+ * after the ring wrapped, or still being written, are skipped and
+ * counted as dropped.  Appending takes no lock, makes no syscall
+ * beyond clock_gettime() and never allocates, so it is safe on every
+ * preload hook path, including a vfork() child.
+ */
+#ifndef BIONILUX_EVENTS_H
+#define BIONILUX_EVENTS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bionilux_cache.h"
+
+#define BL_EVENTS_ENV		"BIONILUX_EVENTS_FD"
+#define BL_EVENTS_MAGIC		0x56454c42u	/* "BLEV" */
+#define BL_EVENTS_VERSION	1
+#define BL_EVENTS_SLOTS		4096		/* power of two, 2 MiB */
+
+struct bl_events_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nslots;	/* power of two */
+	uint32_t slot_size;
+	uint64_t head;		/* next ticket */
+	uint8_t  reserved[40];
+};
+
+/* which code path made the decision */
+enum { BL_EV_LAUNCH, BL_EV_EXECVE, BL_EV_SPAWN };
+
+/* what it decided */
+enum {
+	BL_ACT_PASSTHROUGH,	/* preload unconfigured, exec untouched */
+	BL_ACT_DIRECT,		/* not glibc, exec untouched */
+	BL_ACT_CLEAN_ENV,	/* not glibc, preload variables stripped */
+	BL_ACT_LOADER,		/* glibc, run through the glibc loader */
+	BL_ACT_BOX64,		/* x86_64, run through box64 */
+	BL_ACT_NATIVE,		/* bionic, exec'd directly by bionilux */
+};
+
+struct bl_event {
+	uint64_t seq;		/* 2 * ticket + 2 once complete */
+	uint64_t ts_ns;		/* CLOCK_MONOTONIC when deciding began */
+	uint32_t decide_ns;	/* time spent deciding, 0 if reused */
+	int32_t  pid;		/* process that decided */
+	int32_t  ppid;
+	int32_t  child;		/* process running the result */
+	uint8_t  hook;		/* BL_EV_* */
+	uint8_t  action;	/* BL_ACT_* */
+	int8_t   glibc;		/* classification: 1, 0 or -1 (unreadable) */
+	uint8_t  pad;
+	int32_t  err;		/* errno of a failed exec or spawn */
+	char     path[236];	/* as requested */
+	char     exec[236];	/* what was actually exec'd */
+};
+
+static inline const char *bl_event_hook_name(unsigned hook)
+{
+	static const char *const names[] = {
+		"bionilux", "execve", "posix_spawn",
+	};
+
+	return hook < sizeof(names) / sizeof(names[0]) ? names[hook] : "?";
+}
+
+static inline const char *bl_event_action_name(unsigned action)
+{
+	static const char *const names[] = {
+		"passthrough", "direct", "clean-env", "loader", "box64",
+		"native",
+	};
+
+	return action < sizeof(names) / sizeof(names[0]) ?
+	       names[action] : "?";
+}
+
+/* ring this process image appends to, NULL when not recording */
+static struct bl_events_hdr *bl_events;
+
+static inline size_t bl_events_size(uint32_t nslots)
+{
+	return sizeof(struct bl_events_hdr) +
+	       (size_t)nslots * sizeof(struct bl_event);
+}
+
+static inline struct bl_event *bl_events_slot(struct bl_events_hdr *hdr,
+					      uint64_t ticket)
+{
+	return (struct bl_event *)(hdr + 1) +
+	       (ticket & (hdr->nslots - 1));
+}
+
+/*
+ * Map the ring inherited through descriptor @fdstr ($BIONILUX_EVENTS_FD).
+ * A descriptor that was closed and reused for something else fails the
+ * size, mapping or magic check and leaves recording off.
+ */
+static inline void bl_events_attach(const char *fdstr)
+{
+	struct bl_events_hdr *hdr;
+	struct stat st;
+	char *end;
+	long fd;
+
+	if (!fdstr || !*fdstr)
+		return;
+	fd = strtol(fdstr, &end, 10);
+	if (*end || fd < 0 || fd > INT32_MAX || fstat((int)fd, &st) != 0 ||
+	    st.st_size != (off_t)bl_events_size(BL_EVENTS_SLOTS))
+		return;
+
+	hdr = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED, (int)fd, 0);
+	if (hdr == MAP_FAILED)
+		return;
+	if (hdr->magic != BL_EVENTS_MAGIC ||
+	    hdr->version != BL_EVENTS_VERSION ||
+	    hdr->nslots != BL_EVENTS_SLOTS ||
+	    hdr->slot_size != sizeof(struct bl_event)) {
+		munmap(hdr, (size_t)st.st_size);
+		return;
+	}
+	bl_events = hdr;
+}
+
+/* Copy @s into the fixed-size field @dst, truncating. */
+static inline void bl_event_str(char *dst, size_t size, const char *s)
+{
+	size_t len = s ? strlen(s) : 0;
+
+	if (len >= size)
+		len = size - 1;
+	memcpy(dst, s ? s : "", len);
+	dst[len] = '\0';
+}
+
+/* Append @ev (its seq is ignored) to the ring. */
+static inline void bl_event_put(const struct bl_event *ev)
+{
+	struct bl_event *slot;
+	uint64_t ticket;
+
+	if (!bl_events)
+		return;
+
+	ticket = __atomic_fetch_add(&bl_events->head, 1, __ATOMIC_RELAXED);
+	slot = bl_events_slot(bl_events, ticket);
+
+	__atomic_store_n(&slot->seq, 2 * ticket + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy((char *)slot + sizeof(slot->seq),
+	       (const char *)ev + sizeof(ev->seq),
+	       sizeof(*ev) - sizeof(ev->seq));
+	__atomic_store_n(&slot->seq, 2 * ticket + 2, __ATOMIC_RELEASE);
+}
+
+/*
+ * Copy record @ticket into @out.  Returns 0, or -1 if it was
+ * overwritten or is still being written.
+ */
+static inline int bl_event_get(struct bl_events_hdr *hdr, uint64_t ticket,
+			       struct bl_event *out)
+{
+	struct bl_event *slot = bl_events_slot(hdr, ticket);
+	uint64_t want = 2 * ticket + 2;
+
+	if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != want)
+		return -1;
+	memcpy(out, slot, sizeof(*out));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == want ? 0 : -1;
+}
+
+#endif /* BIONILUX_EVENTS_H */
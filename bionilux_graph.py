@@ -1,7 +1,11 @@
-from graphviz import Digraph
+import argparse
+import json
+import os
 
 
 def create_bionilux_diagram():
+    from graphviz import Digraph
+
     dot = Digraph('bionilux_architecture', format='png')
     dot.attr(rankdir='TB', nodesep='0.6', ranksep='0.7', dpi='150')
     dot.attr('graph', label='bionilux v0.2.0 \u2014 Architecture',
@@ -66,6 +70,7 @@ def create_bionilux_diagram():
         'libbionilux_preload.so  (LD_PRELOAD into glibc process)\n'
         '\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\u2501\n'
         '\u2022 Hooks: execve execv execvp execvpe execl execlp execle\n'
+        '\u2022 Hooks: posix_spawn posix_spawnp (CLONE_VM kept)\n'
         '\u2022 Hooks: readlink readlinkat (/proc/self/exe fix)\n'
         '\u2022 Redirects glibc children through loader automatically\n'
         '\u2022 Cleans env for bionic children (strips LD_AUDIT etc.)\n'
@@ -107,5 +112,154 @@ def create_bionilux_diagram():
     print('Saved: assets/bionilux_architecture_diagram.png')
 
 
+# ── exec event trees (bionilux --record-execs FILE) ──────────────────
+
+ACTION_COLORS = {
+    'loader': ('#fff9c4', '#f9a825'),
+    'box64': ('#ffccbc', '#bf360c'),
+    'native': ('#e8eaf6', '#283593'),
+    'clean-env': ('#e0f2f1', '#00695c'),
+    'direct': ('#e0f2f1', '#00695c'),
+    'passthrough': ('#f9f9f9', '#757575'),
+}
+
+
+def load_events(path):
+    """Records of a --record-execs file, oldest first, plus its summary."""
+    events, summary = [], {}
+    with open(path) as f:
+        for line in f:
+            if not line.strip():
+                continue
+            rec = json.loads(line)
+            if 'bionilux_events' in rec:
+                summary = rec
+            else:
+                events.append(rec)
+    events.sort(key=lambda e: (e['ts_ns'], e['seq']))
+    return events, summary
+
+
+def build_exec_tree(events):
+    """
+    Turn records into process images, each {'ev', 'parent', 'kids'}.
+
+    A record starts a new image in its 'child' process.  Its parent is
+    the image the deciding process was running, else the one its parent
+    process was running, else the latest root: processes started outside
+    the hooks (a shell behind system(), say) leave no record of their
+    own.  bionilux's own records are roots unless made inside the tree.
+    A failed execve leaves the process running its previous image.
+    """
+    images, current, root = [], {}, None
+    for ev in events:
+        if ev['errno']:
+            if ev['hook'] == 'execve' and current.get(ev['pid']):
+                failed = current[ev['pid']]
+                failed['failed'] = ev['errno']
+                current[ev['pid']] = failed['parent']
+            continue
+        parent = current.get(ev['pid'])
+        if ev['hook'] != 'bionilux':
+            parent = parent or current.get(ev['ppid'])
+        guessed = parent is None and ev['hook'] != 'bionilux'
+        if guessed:
+            parent = root
+        img = {'ev': ev, 'parent': parent, 'kids': [], 'guessed': guessed}
+        if parent:
+            parent['kids'].append(img)
+        images.append(img)
+        if parent is None:
+            root = img
+        if ev['child'] > 0:
+            current[ev['child']] = img
+    return images
+
+
+def image_label(img, t0):
+    ev = img['ev']
+    label = '%s\npid %d · %s · +%.1f ms\ndecided in %.0f µs' % (
+        os.path.basename(ev['path']) or ev['path'], ev['child'],
+        ev['action'], (ev['ts_ns'] - t0) / 1e6, ev['decide_ns'] / 1e3)
+    if img.get('failed'):
+        label += '\nexec failed: errno %d' % img['failed']
+    return label
+
+
+def render_exec_graph(events, out, fmt):
+    from graphviz import Digraph
+
+    images = build_exec_tree(events)
+    t0 = events[0]['ts_ns'] if events else 0
+
+    dot = Digraph('bionilux_execs', format=fmt)
+    dot.attr(rankdir='TB', nodesep='0.4', ranksep='0.5')
+    dot.attr('node', shape='box', style='rounded,filled',
+             fontname='Arial', fontsize='10')
+    dot.attr('edge', fontname='Arial', fontsize='9')
+
+    for i, img in enumerate(images):
+        img['id'] = 'n%d' % i
+        fill, color = ACTION_COLORS.get(img['ev']['action'],
+                                        ('#f9f9f9', '#757575'))
+        dot.node(img['id'], image_label(img, t0), fillcolor=fill,
+                 color='#c62828' if img.get('failed') else color,
+                 tooltip=img['ev']['exec'])
+        if img['parent']:
+            dot.edge(img['parent']['id'], img['id'],
+                     label=img['ev']['hook'],
+                     style='dashed' if img['guessed'] else 'solid')
+
+    dot.render(out, cleanup=True)
+    print('Saved: %s.%s' % (out, fmt))
+
+
+def print_exec_timeline(events):
+    images = build_exec_tree(events)
+    t0 = events[0]['ts_ns'] if events else 0
+
+    def show(img, depth):
+        ev = img['ev']
+        line = '%+10.3f ms  %9.1f µs  %s%-11s [%d] %s' % (
+            (ev['ts_ns'] - t0) / 1e6, ev['decide_ns'] / 1e3,
+            '  ' * depth, ev['hook'], ev['child'], ev['path'])
+        if ev['exec'] != ev['path']:
+            line += '  → %s (%s)' % (ev['exec'], ev['action'])
+        else:
+            line += '  (%s)' % ev['action']
+        if img.get('failed'):
+            line += '  FAILED errno %d' % img['failed']
+        print(line)
+        for kid in img['kids']:
+            show(kid, depth + 1)
+
+    print('%13s  %12s  %s' % ('start', 'decide', 'exec'))
+    for img in images:
+        if img['parent'] is None:
+            show(img, 0)
+
+
 if __name__ == '__main__':
-    create_bionilux_diagram()
+    ap = argparse.ArgumentParser(
+        description='Render the bionilux architecture diagram, or an '
+                    'exec tree recorded with bionilux --record-execs.')
+    ap.add_argument('--events', metavar='FILE',
+                    help='render the --record-execs FILE instead')
+    ap.add_argument('--timeline', action='store_true',
+                    help='print the exec tree as a text timeline')
+    ap.add_argument('-o', '--output', default='bionilux_execs',
+                    help='graph output path without extension')
+    ap.add_argument('-T', '--format', default='svg',
+                    help='graphviz output format (default: svg)')
+    args = ap.parse_args()
+
+    if not args.events:
+        create_bionilux_diagram()
+    else:
+        events, summary = load_events(args.events)
+        if summary.get('dropped'):
+            print('note: %d events were lost' % summary['dropped'])
+        if args.timeline:
+            print_exec_timeline(events)
+        else:
+            render_exec_graph(events, args.output, args.format)
@@ -0,0 +1,239 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * bionilux_ldcache.h — ld.so.cache for the glibc prefix
+ *
+ * Used by both bionilux.c (bionic) and bionilux_preload.c (glibc).
+ *
+ * With --library-path the loader probes GLIBC_LIB (and its hwcaps
+ * subdirectories) for every DT_NEEDED entry of every process.  bionilux
+ * instead writes a glibc-format cache, $GLIBC_PREFIX/etc/ld.so.cache,
+ * which the Termux loader consults by default, and leaves
+ * --library-path out while that cache is current.
+ *
+ * The file uses the "glibc-ld.so.cache1.1" layout that ldconfig writes
+ * (header, entries sorted for the loader's binary search, string
+ * table, extension sections).  Its generator section records
+ *
+ *   "bionilux <state>"
+ *
+ * where <state> hashes the (dev, ino, mtime) of GLIBC_LIB and every
+ * glibc-hwcaps subdirectory.  Installing or removing a library changes
+ * a directory mtime and therefore the state, so a cache is current
+ * exactly when the recorded state matches.  A cache written by anyone
+ * else is never trusted or replaced implicitly.
+ */
+#ifndef BIONILUX_LDCACHE_H
+#define BIONILUX_LDCACHE_H
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "bionilux_cache.h"
+#include "bionilux_elf.h"
+
+#define LD_CACHE_MAGIC		"glibc-ld.so.cache1.1"
+#define LD_CACHE_EXT_MAGIC	0xeaa42174u	/* (uint32_t)-358342284 */
+#define LD_CACHE_GENERATOR	"bionilux "
+#define LD_CACHE_HWCAPS_DIR	"glibc-hwcaps"
+
+/* entry flags: FLAG_ELF_LIBC6 | FLAG_<arch>_LIB64 */
+#define LD_CACHE_FLAGS_AARCH64	0x0a03
+#define LD_CACHE_FLAGS_X86_64	0x0303
+/* entry hwcap: this bit | index into the glibc-hwcaps section */
+#define LD_CACHE_HWCAP_EXT	(1ULL << 62)
+
+enum {
+	LD_CACHE_EXT_GENERATOR = 0,
+	LD_CACHE_EXT_HWCAPS    = 1,
+};
+
+struct ld_cache_hdr {
+	char     magic[20];		/* LD_CACHE_MAGIC, no NUL */
+	uint32_t nlibs;
+	uint32_t len_strings;
+	uint8_t  flags;			/* byte order, see ld_cache_endian() */
+	uint8_t  pad[3];
+	uint32_t extension_offset;
+	uint32_t unused[3];
+};
+
+struct ld_cache_entry {
+	int32_t  flags;
+	uint32_t key, value;		/* string offsets from the file start */
+	uint32_t osversion;
+	uint64_t hwcap;
+};
+
+struct ld_cache_ext {
+	uint32_t magic;			/* LD_CACHE_EXT_MAGIC */
+	uint32_t count;
+};
+
+struct ld_cache_section {
+	uint32_t tag;			/* LD_CACHE_EXT_* */
+	uint32_t flags;
+	uint32_t offset;
+	uint32_t size;
+};
+
+_Static_assert(sizeof(struct ld_cache_hdr) == 48, "ld.so.cache header");
+_Static_assert(sizeof(struct ld_cache_entry) == 24, "ld.so.cache entry");
+
+static inline uint8_t ld_cache_endian(void)
+{
+	return __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ ? 2 : 3;
+}
+
+/* $GLIBC_PREFIX/etc/ld.so.cache for the library directory @lib. */
+static inline int ld_cache_path(const char *lib, char *buf, size_t size)
+{
+	const char *slash = strrchr(lib, '/');
+	int n;
+
+	if (!slash || slash == lib)
+		return -1;
+	n = snprintf(buf, size, "%.*s/etc/ld.so.cache",
+		     (int)(slash - lib), lib);
+	return n > 0 && (size_t)n < size ? 0 : -1;
+}
+
+static inline uint64_t ld_cache_hash_dir(uint64_t h, const char *dir)
+{
+	struct stat st;
+
+	if (stat(dir, &st) != 0)
+		return bl_hash(h, "-", 1);
+
+	uint64_t v[4] = {
+		(uint64_t)st.st_dev, (uint64_t)st.st_ino,
+		(uint64_t)st.st_mtim.tv_sec, (uint64_t)st.st_mtim.tv_nsec,
+	};
+	return bl_hash(h, v, sizeof(v));
+}
+
+/* getdents64(2) record; opendir() would malloc() inside preload hooks */
+struct ld_dirent64 {
+	uint64_t d_ino;
+	int64_t  d_off;
+	uint16_t d_reclen;
+	uint8_t  d_type;
+	char     d_name[];
+};
+
+/*
+ * State of the library tree under @lib: the directory itself,
+ * glibc-hwcaps/ and each subdirectory of it.
+ */
+static inline uint64_t ld_cache_state(const char *lib)
+{
+	char dir[PATH_MAX], sub[PATH_MAX];
+	char buf[2048] __attribute__((aligned(8)));
+	uint64_t h = ld_cache_hash_dir(BL_HASH_INIT, lib);
+	long n;
+	int fd;
+
+	if (snprintf(dir, sizeof(dir), "%s/" LD_CACHE_HWCAPS_DIR,
+		     lib) >= (int)sizeof(dir))
+		return h;
+	h = ld_cache_hash_dir(h, dir);
+
+	fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0)
+		return h;
+	while ((n = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
+		for (long off = 0; off < n;) {
+			struct ld_dirent64 *de = (void *)(buf + off);
+
+			off += de->d_reclen;
+			if (de->d_name[0] == '.' ||
+			    snprintf(sub, sizeof(sub), "%s/%s", dir,
+				     de->d_name) >= (int)sizeof(sub))
+				continue;
+			h = bl_hash(h, de->d_name, strlen(de->d_name) + 1);
+			h = ld_cache_hash_dir(h, sub);
+		}
+	}
+	close(fd);
+	return h;
+}
+
+/*
+ * Read the generator string of the cache at @path into @buf.
+ * Returns its length, or -1 if the file is missing, not a cache or
+ * has no generator.
+ */
+static inline int ld_cache_generator(const char *path, char *buf, size_t size)
+{
+	struct ld_cache_hdr hdr;
+	struct ld_cache_ext ext;
+	struct ld_cache_section sec[4];
+	int fd, len = -1;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	if (elf_pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) ||
+	    memcmp(hdr.magic, LD_CACHE_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    !hdr.extension_offset ||
+	    elf_pread(fd, &ext, sizeof(ext), hdr.extension_offset) !=
+	    (ssize_t)sizeof(ext) || ext.magic != LD_CACHE_EXT_MAGIC)
+		goto out;
+
+	if (ext.count > 4)
+		ext.count = 4;
+	if (elf_pread(fd, sec, ext.count * sizeof(sec[0]),
+		      hdr.extension_offset + sizeof(ext)) !=
+	    (ssize_t)(ext.count * sizeof(sec[0])))
+		goto out;
+
+	for (uint32_t i = 0; i < ext.count; i++) {
+		if (sec[i].tag != LD_CACHE_EXT_GENERATOR ||
+		    sec[i].size >= size)
+			continue;
+		if (elf_pread(fd, buf, sec[i].size, sec[i].offset) ==
+		    (ssize_t)sec[i].size) {
+			buf[sec[i].size] = '\0';
+			len = (int)sec[i].size;
+		}
+		break;
+	}
+out:
+	close(fd);
+	return len;
+}
+
+/* Generator string recording @state. */
+static inline void ld_cache_stamp(uint64_t state, char *buf, size_t size)
+{
+	snprintf(buf, size, LD_CACHE_GENERATOR "%016llx",
+		 (unsigned long long)state);
+}
+
+/*
+ * Is the cache for @lib ours and current?  Returns 1 if so, 0 if it is
+ * ours but stale or missing, -1 if someone else wrote it.
+ */
+static inline int ld_cache_fresh(const char *lib)
+{
+	char path[PATH_MAX], gen[64], want[64];
+
+	if (ld_cache_path(lib, path, sizeof(path)) != 0)
+		return -1;
+	if (ld_cache_generator(path, gen, sizeof(gen)) < 0)
+		return access(path, F_OK) == 0 ? -1 : 0;
+	if (strncmp(gen, LD_CACHE_GENERATOR,
+		    sizeof(LD_CACHE_GENERATOR) - 1) != 0)
+		return -1;
+
+	ld_cache_stamp(ld_cache_state(lib), want, sizeof(want));
+	return strcmp(gen, want) == 0;
+}
+
+#endif /* BIONILUX_LDCACHE_H */
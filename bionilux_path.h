@@ -0,0 +1,255 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * bionilux_path.h — Persistent command-lookup index
+ *
+ * Used by both bionilux.c (bionic) and bionilux_preload.c (glibc).
+ *
+ * Maps (PATH, command name) to the absolute path a PATH search found,
+ * so resolving "git" again costs a hash probe instead of one access()
+ * per PATH directory.  Two kinds of records share one table (see
+ * bionilux_cache.h):
+ *
+ *   PATH record      hash of the (dev, ino, mtime) of every directory
+ *                    in that PATH — its *state* — and when the
+ *                    directories were last stat()ed
+ *   command record   the path found for a name, and the state of its
+ *                    PATH at the time
+ *
+ * Creating, removing or renaming a file changes its directory's mtime
+ * and therefore the state, which orphans every command record of that
+ * PATH.  The directories are re-stat()ed at most every
+ * CMD_INDEX_TTL_MS, so a command newly installed in front of an
+ * indexed one is picked up within that window.  A hit is only a hint:
+ * the caller verifies it (or retries with a full search when the exec
+ * fails).  PATHs with relative or empty components are never indexed.
+ */
+#ifndef BIONILUX_PATH_H
+#define BIONILUX_PATH_H
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "bionilux_cache.h"
+
+#define CMD_INDEX_NAME		"cmd.cache"
+#define CMD_INDEX_MAGIC		0x434d4c42u	/* "BLMC" */
+#define CMD_INDEX_VERSION	1
+#define CMD_INDEX_SLOTS		1024
+#define CMD_INDEX_PROBE		8
+#define CMD_INDEX_TTL_MS	1000
+
+enum {
+	CMD_REC_PATH = 1,
+	CMD_REC_CMD  = 2,
+};
+
+struct cmd_index_slot {
+	uint64_t seq;		/* per-slot seqlock, see bionilux_cache.h */
+	uint64_t key;
+	uint64_t state;		/* PATH state (recorded or resolved under) */
+	uint64_t checked_ns;	/* PATH records: last stat() sweep */
+	uint32_t kind;		/* CMD_REC_* */
+	uint32_t len;		/* command records: strlen(path) */
+	char     path[216];
+};
+
+_Static_assert(sizeof(struct cmd_index_slot) == 256,
+	       "cmd_index_slot must stay 256 bytes");
+
+/* carried from cmd_index_lookup() to cmd_index_store() */
+struct cmd_query {
+	uint64_t key;		/* 0 → this lookup cannot be indexed */
+	uint64_t state;
+};
+
+static struct bl_table_hdr *cmd_index;
+
+/* Map the index from @dir on first use; NULL @dir disables it. */
+static inline void cmd_index_attach(const char *dir)
+{
+	if (__atomic_load_n(&cmd_index, __ATOMIC_ACQUIRE) || !dir)
+		return;
+
+	bl_table_publish(&cmd_index,
+			 bl_table_map(dir, CMD_INDEX_NAME, CMD_INDEX_MAGIC,
+				      CMD_INDEX_VERSION, CMD_INDEX_SLOTS,
+				      sizeof(struct cmd_index_slot)));
+}
+
+/*
+ * Hash the state of every directory in @path_env into @state.
+ * Returns -1 if the PATH has a relative or empty component.
+ */
+static inline int cmd_path_state(const char *path_env, uint64_t *state)
+{
+	uint64_t h = BL_HASH_INIT;
+	char dir[PATH_MAX];
+
+	while (path_env) {
+		const char *end = strchrnul(path_env, ':');
+		size_t len = (size_t)(end - path_env);
+		struct stat st;
+
+		if (!len || path_env[0] != '/' || len >= sizeof(dir))
+			return -1;
+		memcpy(dir, path_env, len);
+		dir[len] = '\0';
+
+		if (stat(dir, &st) == 0) {
+			uint64_t v[4] = {
+				(uint64_t)st.st_dev, (uint64_t)st.st_ino,
+				(uint64_t)st.st_mtim.tv_sec,
+				(uint64_t)st.st_mtim.tv_nsec,
+			};
+			h = bl_hash(h, v, sizeof(v));
+		} else {
+			h = bl_hash(h, "-", 1);	/* missing dir */
+		}
+
+		path_env = *end ? end + 1 : NULL;
+	}
+
+	*state = h;
+	return 0;
+}
+
+/* Copy the valid record @key into @rec.  Returns 1 if found. */
+static inline int cmd_index_get(struct bl_table_hdr *hdr, uint64_t key,
+				struct cmd_index_slot *rec)
+{
+	for (uint32_t i = 0; i < CMD_INDEX_PROBE; i++) {
+		struct cmd_index_slot *s = bl_table_slot(hdr,
+							 (uint32_t)key + i);
+		uint64_t seq = bl_seq_read_begin(&s->seq);
+
+		if (!seq)
+			continue;
+		memcpy(rec, s, sizeof(*rec));
+		if (bl_seq_read_ok(&s->seq, seq) && rec->key == key)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Write @rec (all but its seq) over the old slot for its key, else an
+ * empty slot, else a victim.
+ */
+static inline void cmd_index_put(struct bl_table_hdr *hdr,
+				 const struct cmd_index_slot *rec)
+{
+	struct cmd_index_slot *victim = NULL;
+	uint64_t seq;
+
+	for (uint32_t i = 0; i < CMD_INDEX_PROBE; i++) {
+		struct cmd_index_slot *s = bl_table_slot(hdr,
+							 (uint32_t)rec->key + i);
+
+		if (s->key == rec->key) {
+			victim = s;
+			break;
+		}
+		if (!victim &&
+		    __atomic_load_n(&s->seq, __ATOMIC_RELAXED) == 0)
+			victim = s;
+	}
+	if (!victim)
+		victim = bl_table_slot(hdr, (uint32_t)rec->key +
+				       (uint32_t)(rec->key >> 40) %
+				       CMD_INDEX_PROBE);
+
+	if (bl_seq_write_begin(&victim->seq, &seq) != 0)
+		return;
+	memcpy((char *)victim + sizeof(victim->seq),
+	       (const char *)rec + sizeof(rec->seq),
+	       sizeof(*rec) - sizeof(rec->seq));
+	bl_seq_write_end(&victim->seq, seq);
+}
+
+/*
+ * Current state of @path_env, from its PATH record while that is
+ * younger than the TTL, else by re-stat()ing the directories.
+ */
+static inline int cmd_index_state(struct bl_table_hdr *hdr,
+				  const char *path_env, uint64_t pkey,
+				  uint64_t *state)
+{
+	struct cmd_index_slot rec;
+	uint64_t now = bl_now_ns();
+
+	/* a record from before a reboot looks like it is from the future */
+	if (cmd_index_get(hdr, pkey, &rec) && rec.kind == CMD_REC_PATH &&
+	    now >= rec.checked_ns &&
+	    now - rec.checked_ns < CMD_INDEX_TTL_MS * 1000000ULL) {
+		*state = rec.state;
+		return 0;
+	}
+
+	if (cmd_path_state(path_env, state) != 0)
+		return -1;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.key        = pkey;
+	rec.state      = *state;
+	rec.checked_ns = now;
+	rec.kind       = CMD_REC_PATH;
+	cmd_index_put(hdr, &rec);
+	return 0;
+}
+
+/*
+ * Look up bare command @name on @path_env.  On a hit, copies the
+ * indexed path into @out (PATH_MAX bytes) and returns 1.  Either way
+ * @q is filled for a cmd_index_store() after a full search.
+ */
+static inline int cmd_index_lookup(const char *path_env, const char *name,
+				   char *out, struct cmd_query *q)
+{
+	struct bl_table_hdr *hdr = __atomic_load_n(&cmd_index,
+						   __ATOMIC_ACQUIRE);
+	struct cmd_index_slot rec;
+	uint64_t pkey;
+
+	q->key = q->state = 0;
+	if (!hdr || !path_env || !*path_env)
+		return 0;
+
+	pkey = bl_hash(bl_hash(BL_HASH_INIT, "PATH=", 5),
+		       path_env, strlen(path_env));
+	if (cmd_index_state(hdr, path_env, pkey, &q->state) != 0)
+		return 0;
+
+	q->key = bl_hash(pkey, name, strlen(name) + 1);
+	if (!cmd_index_get(hdr, q->key, &rec) || rec.kind != CMD_REC_CMD ||
+	    rec.state != q->state || rec.len >= sizeof(rec.path))
+		return 0;
+
+	memcpy(out, rec.path, rec.len);
+	out[rec.len] = '\0';
+	return 1;
+}
+
+/* Record @path as the result of the search described by @q. */
+static inline void cmd_index_store(const struct cmd_query *q,
+				   const char *path)
+{
+	struct bl_table_hdr *hdr = __atomic_load_n(&cmd_index,
+						   __ATOMIC_ACQUIRE);
+	struct cmd_index_slot rec;
+	size_t len = strlen(path);
+
+	if (!hdr || !q->key || len >= sizeof(rec.path))
+		return;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.key   = q->key;
+	rec.state = q->state;
+	rec.kind  = CMD_REC_CMD;
+	rec.len   = (uint32_t)len;
+	memcpy(rec.path, path, len);
+	cmd_index_put(hdr, &rec);
+}
+
+#endif /* BIONILUX_PATH_H */
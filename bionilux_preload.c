@@ -2,10 +2,12 @@
 /*
  * bionilux_preload.c — LD_PRELOAD library for bionilux
  *
- * Intercepts exec*() calls so that child processes spawned by a glibc
- * binary are transparently routed through the Termux glibc loader.
+ * Intercepts exec*() and posix_spawn*() calls so that child processes
+ * spawned by a glibc binary are transparently routed through the
+ * Termux glibc loader.
  * Also fixes /proc/self/exe readlink so programs can locate their own
- * resources.
+ * resources, and logs the files a program opens while bionilux
+ * --record-io is learning its startup I/O.
  *
  * Loaded into arm64 glibc processes only (never into box64 x86_64).
  *
@@ -19,15 +21,21 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <spawn.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #include <unistd.h>
 
 #include "bionilux_elf.h"
+#include "bionilux_events.h"
+#include "bionilux_ldcache.h"
+#include "bionilux_path.h"
+#include "bionilux_trace.h"
 
 /* ── environment variable names ──────────────────────────────────── */
 
@@ -35,27 +43,64 @@
 #define GLIBC_LOADER_ENV	"BIONILUX_GLIBC_LOADER"
 #define BIONILUX_DEBUG_ENV	"BIONILUX_DEBUG"
 #define BIONILUX_ORIG_EXE_ENV	"BIONILUX_ORIG_EXE"
+#define BIONILUX_TUNABLES_ENV	"BIONILUX_TUNABLES"
+#define BIONILUX_IOTRACE_ENV	"BIONILUX_IOTRACE"
 
 /* compile-time prefix match for environment variables */
 #define ENVPREFIX(var, lit)	(strncmp((var), (lit), sizeof(lit) - 1) == 0)
 
+/* ── cached configuration (set in constructor) ──────────────────── */
+
+/*
+ * The BIONILUX_* variables are read once in init() and copied into
+ * static storage.  The hooks below must stay usable in vfork()
+ * children and fork() children of multithreaded programs, so they
+ * never call malloc() or stdio; the only lookup left on the hot path
+ * is getenv("PATH"), which walks environ in place.
+ */
+static char g_glibc_lib[PATH_MAX];
+static char g_glibc_loader[PATH_MAX];
+static char g_orig_exe[PATH_MAX];
+static char g_cache_dir[PATH_MAX];
+static char g_self_fd[32];	/* "/proc/self/fd/N" when loaded from a memfd */
+static char g_tunables[1040];	/* "GLIBC_TUNABLES=" of the tuning profile */
+static int  g_iotrace_fd = -1;	/* --record-io log, -1 when not recording */
+static uint64_t g_iotrace_end;	/* CLOCK_MONOTONIC ns to stop logging at */
+static size_t g_iotrace_page;	/* page size, for the residency snapshot */
+
+static inline const char *cfg(const char *value)
+{
+	return value[0] ? value : NULL;
+}
+
 /* ── debug logging ───────────────────────────────────────────────── */
 
 static int debug_enabled;
 
+/*
+ * Format into a stack buffer and write(2) it in one go — no stdio
+ * locks and no allocation, so it is safe on every hook path.
+ */
 __attribute__((format(printf, 1, 2)))
 static void debug_print(const char *fmt, ...)
 {
+	char line[1024];
+	va_list ap;
+	int n;
+
 	if (!debug_enabled)
 		return;
 
-	va_list ap;
-
+	memcpy(line, "[bionilux] ", 11);
 	va_start(ap, fmt);
-	fprintf(stderr, "[bionilux] ");
-	vfprintf(stderr, fmt, ap);
-	fputc('\n', stderr);
+	n = vsnprintf(line + 11, sizeof(line) - 12, fmt, ap);
 	va_end(ap);
+	if (n < 0)
+		return;
+
+	n = 11 + (n < (int)sizeof(line) - 12 ? n : (int)sizeof(line) - 13);
+	line[n++] = '\n';
+	if (write(STDERR_FILENO, line, (size_t)n) < 0) { /* best-effort */ }
 }
 
 /* ── real function pointers (set in constructor) ─────────────────── */
@@ -63,6 +108,20 @@ static void debug_print(const char *fmt, ...)
 static int     (*real_execve)(const char *, char *const[], char *const[]);
 static ssize_t (*real_readlink)(const char *, char *, size_t);
 static ssize_t (*real_readlinkat)(int, const char *, char *, size_t);
+static int     (*real_posix_spawn)(pid_t *, const char *,
+				   const posix_spawn_file_actions_t *,
+				   const posix_spawnattr_t *,
+				   char *const[], char *const[]);
+static int     (*real_posix_spawnp)(pid_t *, const char *,
+				    const posix_spawn_file_actions_t *,
+				    const posix_spawnattr_t *,
+				    char *const[], char *const[]);
+/* resolved on first use: other libraries' constructors may open first */
+static int     (*real_open)(const char *, int, ...);
+static int     (*real_openat)(int, const char *, int, ...);
+static int     (*real_open_2)(const char *, int);
+static int     (*real_openat_2)(int, const char *, int);
+static FILE   *(*real_fopen)(const char *, const char *);
 
 /*
  * Fallback execve via raw syscall — used when dlsym(RTLD_NEXT) fails.
@@ -89,131 +148,245 @@ static inline int safe_execve(const char *path, char *const argv[],
 
 /* ── path resolution ─────────────────────────────────────────────── */
 
+/*
+ * Write "@dir/@name" (@dlen bytes of @dir) into @out.
+ * Returns 0 on success, -1 if it does not fit in PATH_MAX.
+ */
+static int path_join(char *out, const char *dir, size_t dlen,
+		     const char *name)
+{
+	size_t nlen = strlen(name);
+
+	if (dlen + 1 + nlen + 1 > PATH_MAX)
+		return -1;
+
+	memcpy(out, dir, dlen);
+	out[dlen] = '/';
+	memcpy(out + dlen + 1, name, nlen + 1);
+	return 0;
+}
+
 /*
  * Resolve @path to an absolute path.
  *
  *   Absolute        → copy as-is
- *   Bare name       → search $PATH
+ *   Bare name       → command index (bionilux_path.h), else search $PATH
  *   Relative with / → prepend CWD
  *
- * Always returns @resolved (caller-owned buffer of PATH_MAX bytes).
+ * $PATH is walked in place (no strdup/strtok).  With @use_index 0 the
+ * index is not consulted, only refreshed — for a retry after an
+ * indexed path failed to exec.
+ *
+ * Always fills @resolved (caller-owned buffer of PATH_MAX bytes).
+ * Returns 1 if the result came from the index and is unverified, -1 if
+ * a bare name is not on $PATH (@resolved is then CWD/name, which is
+ * what execve() means by it) — execvp() and posix_spawnp() then fail
+ * with ENOENT like glibc's, rather than run a file of that name from
+ * the current directory.
  */
-static char *resolve_path(const char *path, char *resolved)
+static int resolve_path(const char *path, char *resolved, int use_index)
 {
+	int ret = 0;
+
 	if (path[0] == '/') {
 		snprintf(resolved, PATH_MAX, "%s", path);
-		return resolved;
+		return 0;
 	}
 
 	if (!strchr(path, '/')) {
-		const char *path_env = getenv("PATH");
-
-		if (path_env) {
-			char *dup = strdup(path_env);
-
-			if (dup) {
-				char *saveptr;
-				char *dir;
-
-				for (dir = strtok_r(dup, ":", &saveptr);
-				     dir;
-				     dir = strtok_r(NULL, ":", &saveptr)) {
-					snprintf(resolved, PATH_MAX,
-						 "%s/%s", dir, path);
-					if (access(resolved, X_OK) == 0) {
-						free(dup);
-						return resolved;
-					}
-				}
-				free(dup);
+		const char *dir = getenv("PATH");
+		struct cmd_query q;
+
+		cmd_index_attach(cfg(g_cache_dir));
+		if (cmd_index_lookup(dir, path, resolved, &q) && use_index)
+			return 1;
+
+		while (dir && *dir) {
+			const char *end = strchrnul(dir, ':');
+			size_t dlen = (size_t)(end - dir);
+
+			if (dlen && path_join(resolved, dir, dlen, path) == 0 &&
+			    access(resolved, X_OK) == 0) {
+				cmd_index_store(&q, resolved);
+				return 0;
 			}
+
+			dir = *end ? end + 1 : NULL;
 		}
+		ret = -1;
 	}
 
-	/* relative path with '/' → prepend CWD */
+	/* relative path, or a bare name not on $PATH → prepend CWD */
 	{
 		char cwd[PATH_MAX];
 
-		if (getcwd(cwd, sizeof(cwd))) {
-			snprintf(resolved, PATH_MAX, "%s/%s", cwd, path);
-			return resolved;
-		}
+		if (getcwd(cwd, sizeof(cwd)) &&
+		    path_join(resolved, cwd, strlen(cwd), path) == 0)
+			return ret;
 	}
 
 	snprintf(resolved, PATH_MAX, "%s", path);
-	return resolved;
+	return ret;
+}
+
+/* Would a fresh PATH search help after an exec of an indexed path failed? */
+static inline int stale_hit(int err)
+{
+	return err == ENOENT || err == EACCES || err == ENOTDIR;
 }
 
 /* ── argv / envp builders ────────────────────────────────────────── */
 
-static void free_strarray(char **arr)
+/*
+ * Pointer arrays for the rebuilt argv/envp.  They only ever hold
+ * pointers into the caller's arrays or into the plan's own buffers;
+ * no string is copied.  Small lists live on the stack, larger ones in
+ * a private anonymous mapping — never the malloc heap.
+ */
+#define SCRATCH_INLINE	256
+
+struct ptr_scratch {
+	char  **v;
+	size_t  mapped;		/* bytes mapped, 0 for inline storage */
+	char   *inline_v[SCRATCH_INLINE];
+};
+
+static char **scratch_get(struct ptr_scratch *s, size_t n)
 {
-	if (!arr)
-		return;
-	for (int i = 0; arr[i]; i++)
-		free(arr[i]);
-	free(arr);
+	void *p;
+
+	if (n <= SCRATCH_INLINE) {
+		s->v = s->inline_v;
+		return s->v;
+	}
+
+	p = mmap(NULL, n * sizeof(char *), PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+
+	s->v = p;
+	s->mapped = n * sizeof(char *);
+	return s->v;
+}
+
+static void scratch_put(struct ptr_scratch *s)
+{
+	if (s->mapped)
+		munmap(s->v, s->mapped);
+	s->mapped = 0;
+}
+
+static size_t strarray_len(char *const arr[])
+{
+	size_t n = 0;
+
+	while (arr[n])
+		n++;
+	return n;
+}
+
+/*
+ * Everything needed to perform one redirected exec.  Lives on the
+ * hook's stack; plan_release() undoes any large-list mappings.
+ */
+struct exec_plan {
+	const char        *path;	/* what to actually execve() */
+	uint8_t            action;	/* BL_ACT_*, for tracing and events */
+	int8_t             glibc;	/* is_glibc_elf() of the target */
+	char *const       *argv;
+	char *const       *envp;
+	struct ptr_scratch av;
+	struct ptr_scratch ev;
+	char               resolved[PATH_MAX];
+	char               orig_exe[sizeof(BIONILUX_ORIG_EXE_ENV) + PATH_MAX];
+	char               ld_path[PATH_MAX * 4];
+};
+
+/*
+ * Can the loader run without --library-path?  Only if @envp sets no
+ * LD_LIBRARY_PATH (which --library-path would have overridden) and the
+ * ld.so.cache bionilux maintains is current.  The cache is checked
+ * once per process image; only bionilux itself regenerates it.
+ */
+static int use_ld_cache(char *const envp[])
+{
+	static int fresh = -1;
+
+	for (size_t i = 0; envp[i]; i++)
+		if (ENVPREFIX(envp[i], "LD_LIBRARY_PATH=") &&
+		    envp[i][sizeof("LD_LIBRARY_PATH=") - 1])
+			return 0;
+
+	if (fresh < 0)
+		fresh = ld_cache_fresh(g_glibc_lib) == 1;
+	return fresh;
 }
 
 /*
  * Build argv for the glibc loader invocation:
- *   loader --library-path lib --argv0 argv[0] binary [argv[1]...]
+ *   loader [--library-path lib] --argv0 argv[0] binary [argv[1]...]
  */
-static char **build_loader_argv(const char *loader, const char *lib_path,
-				const char *binary, char *const argv[])
+static int build_loader_argv(struct exec_plan *p, char *const argv[],
+			     char *const envp[])
 {
-	size_t argc = 0;
-	size_t new_argc, k;
+	size_t argc = strarray_len(argv);
+	size_t k = 0;
 	char **av;
 
-	while (argv[argc])
-		argc++;
-
-	new_argc = 6 + (argc > 0 ? argc - 1 : 0);
-	av = calloc(new_argc + 1, sizeof(char *));
+	av = scratch_get(&p->av, 6 + (argc > 0 ? argc - 1 : 0) + 1);
 	if (!av)
-		return NULL;
+		return -1;
 
-	k = 0;
-	av[k++] = strdup(loader);
-	av[k++] = strdup("--library-path");
-	av[k++] = strdup(lib_path);
-	av[k++] = strdup("--argv0");
-	av[k++] = strdup(argv[0] ? argv[0] : binary);
-	av[k++] = strdup(binary);
+	av[k++] = g_glibc_loader;
+	if (!use_ld_cache(envp)) {
+		av[k++] = (char *)"--library-path";
+		av[k++] = g_glibc_lib;
+	}
+	av[k++] = (char *)"--argv0";
+	av[k++] = argv[0] ? argv[0] : p->resolved;
+	av[k++] = p->resolved;
 
 	for (size_t i = 1; i < argc; i++)
-		av[k++] = strdup(argv[i]);
+		av[k++] = argv[i];
 	av[k] = NULL;
 
-	/* check for OOM */
-	for (size_t i = 0; i < k; i++) {
-		if (!av[i]) {
-			free_strarray(av);
-			return NULL;
-		}
-	}
-
-	return av;
+	p->argv = av;
+	return 0;
 }
 
 /*
  * Build envp for glibc child: keep everything, update BIONILUX_ORIG_EXE.
  * Strips libtermux-exec from LD_PRELOAD (bionic-only, breaks glibc).
+ * If envp already has exactly that shape it is passed through as-is.
  */
-static char **build_new_envp(char *const envp[], const char *orig_exe)
+static int build_new_envp(struct exec_plan *p, char *const envp[])
 {
-	size_t envc = 0;
-	size_t j = 0;
-	size_t len;
+	size_t envc = 0, j = 0;
+	int dirty = 1, tunables = !g_tunables[0];
 	char **ev;
 
-	while (envp[envc])
-		envc++;
+	snprintf(p->orig_exe, sizeof(p->orig_exe), "%s=%s",
+		 BIONILUX_ORIG_EXE_ENV, p->resolved);
+
+	for (; envp[envc]; envc++) {
+		if (ENVPREFIX(envp[envc], "LD_PRELOAD=") &&
+		    strstr(envp[envc], "libtermux-exec"))
+			break;
+		if (ENVPREFIX(envp[envc], BIONILUX_ORIG_EXE_ENV "="))
+			dirty = strcmp(envp[envc], p->orig_exe) != 0;
+		if (ENVPREFIX(envp[envc], "GLIBC_TUNABLES="))
+			tunables = 1;
+	}
+	if (!envp[envc] && !dirty && tunables) {
+		p->envp = envp;
+		return 0;
+	}
+	envc += strarray_len(envp + envc);
 
-	ev = calloc(envc + 2, sizeof(char *));
+	ev = scratch_get(&p->ev, envc + 3);
 	if (!ev)
-		return NULL;
+		return -1;
 
 	for (size_t i = 0; i < envc; i++) {
 		/* skip bionic-only LD_PRELOAD (libtermux-exec) */
@@ -225,26 +398,89 @@ static char **build_new_envp(char *const envp[], const char *orig_exe)
 		if (ENVPREFIX(envp[i], BIONILUX_ORIG_EXE_ENV "="))
 			continue;
 
-		ev[j] = strdup(envp[i]);
-		if (!ev[j]) {
-			free_strarray(ev);
-			return NULL;
-		}
-		j++;
+		ev[j++] = envp[i];
 	}
 
 	/* add BIONILUX_ORIG_EXE */
-	len = sizeof(BIONILUX_ORIG_EXE_ENV) + strlen(orig_exe) + 1;
-	ev[j] = malloc(len);
-	if (!ev[j]) {
-		free_strarray(ev);
-		return NULL;
-	}
-	snprintf(ev[j], len, "%s=%s", BIONILUX_ORIG_EXE_ENV, orig_exe);
-	j++;
+	ev[j++] = p->orig_exe;
 
+	/*
+	 * Keep the tuning profile for children of programs that build
+	 * the environment from scratch.  The scan above may have stopped
+	 * early, so look again before adding it.
+	 */
+	if (g_tunables[0] && !tunables) {
+		for (size_t i = 0; i < envc; i++)
+			if (ENVPREFIX(envp[i], "GLIBC_TUNABLES="))
+				tunables = 1;
+		if (!tunables)
+			ev[j++] = g_tunables;
+	}
 	ev[j] = NULL;
-	return ev;
+
+	p->envp = ev;
+	return 0;
+}
+
+/*
+ * Rewrite "LD_LIBRARY_PATH=..." in @entry into @p->ld_path without
+ * any component containing the glibc lib dir.  Returns NULL when
+ * nothing is left, in which case the variable is dropped.
+ */
+static char *clean_library_path(struct exec_plan *p, const char *entry)
+{
+	const size_t start = sizeof("LD_LIBRARY_PATH=") - 1;
+	const char *seg = entry + start;
+	char *buf = p->ld_path;
+	size_t off = start;
+
+	memcpy(buf, entry, start);
+
+	while (seg) {
+		const char *end = strchrnul(seg, ':');
+		size_t len = (size_t)(end - seg);
+		size_t at = off == start ? off : off + 1;
+
+		if (len && at + len < sizeof(p->ld_path)) {
+			memcpy(buf + at, seg, len);
+			buf[at + len] = '\0';
+			if (!strstr(buf + at, g_glibc_lib)) {
+				if (at != off)
+					buf[off] = ':';
+				off = at + len;
+			}
+		}
+		seg = *end ? end + 1 : NULL;
+	}
+
+	buf[off] = '\0';
+	return off > start ? buf : NULL;
+}
+
+/* Does the LD_PRELOAD @entry load this library? */
+static int preloads_us(const char *entry)
+{
+	size_t len = strlen(g_self_fd);
+	const char *p;
+
+	if (strstr(entry, "libbionilux_preload"))
+		return 1;
+
+	/* memfd mode: /proc/self/fd/N, but not /proc/self/fd/N0 */
+	for (p = entry; len && (p = strstr(p, g_self_fd)) != NULL; p += len)
+		if (p[len] == '\0' || p[len] == ':' || p[len] == ' ')
+			return 1;
+	return 0;
+}
+
+/* Does @entry have to be removed or rewritten for a bionic child? */
+static int needs_cleaning(const char *entry)
+{
+	if (ENVPREFIX(entry, "LD_LIBRARY_PATH="))
+		return strstr(entry, g_glibc_lib) != NULL;
+	if (ENVPREFIX(entry, "LD_PRELOAD="))
+		return preloads_us(entry);
+	return ENVPREFIX(entry, "LD_AUDIT=") || ENVPREFIX(entry, "LD_DEBUG=");
 }
 
 /*
@@ -252,167 +488,206 @@ static char **build_new_envp(char *const envp[], const char *orig_exe)
  * Removes glibc paths from LD_LIBRARY_PATH and the bionilux LD_PRELOAD.
  * Also strips LD_AUDIT and LD_DEBUG inherited from the glibc environment
  * — they are glibc-specific and meaningless (or harmful) under bionic.
+ * When none of those are present envp is passed through untouched.
  */
-static char **build_clean_envp(char *const envp[])
+static int build_clean_envp(struct exec_plan *p, char *const envp[])
 {
-	const char *glibc_lib = getenv(GLIBC_LIB_ENV);
-	size_t envc = 0;
-	size_t j = 0;
+	size_t envc = 0, j = 0;
 	char **ev;
 
-	while (envp[envc])
+	while (envp[envc] && !needs_cleaning(envp[envc]))
 		envc++;
+	if (!envp[envc]) {
+		p->envp = envp;
+		return 0;
+	}
+	envc += strarray_len(envp + envc);
 
-	ev = calloc(envc + 1, sizeof(char *));
+	ev = scratch_get(&p->ev, envc + 1);
 	if (!ev)
-		return NULL;
+		return -1;
 
 	for (size_t i = 0; i < envc; i++) {
+		if (!needs_cleaning(envp[i])) {
+			ev[j++] = envp[i];
+			continue;
+		}
+
 		/* filter glibc paths from LD_LIBRARY_PATH */
-		if (ENVPREFIX(envp[i], "LD_LIBRARY_PATH=") &&
-		    glibc_lib && strstr(envp[i], glibc_lib)) {
-			const char *value = envp[i] + 16;
-			char *dup = strdup(value);
-
-			if (!dup) {
-				/* OOM fallback: copy as-is */
-				ev[j] = strdup(envp[i]);
-				if (!ev[j]) {
-					free_strarray(ev);
-					return NULL;
-				}
-				j++;
-				continue;
-			}
+		if (ENVPREFIX(envp[i], "LD_LIBRARY_PATH=")) {
+			char *cleaned = clean_library_path(p, envp[i]);
 
-			char result[PATH_MAX * 4];
-			size_t off = 0;
-			char *saveptr;
-
-			for (char *tok = strtok_r(dup, ":", &saveptr);
-			     tok;
-			     tok = strtok_r(NULL, ":", &saveptr)) {
-				if (strstr(tok, glibc_lib))
-					continue;
-				int n = snprintf(result + off,
-						 sizeof(result) - off,
-						 "%s%s",
-						 off ? ":" : "", tok);
-				if (n > 0 &&
-				    (size_t)n < sizeof(result) - off)
-					off += (size_t)n;
-			}
-			free(dup);
-
-			if (off > 0) {
-				size_t sz = 17 + off + 1;
-
-				ev[j] = malloc(sz);
-				if (!ev[j]) {
-					free_strarray(ev);
-					return NULL;
-				}
-				snprintf(ev[j], sz,
-					 "LD_LIBRARY_PATH=%s", result);
-				j++;
-			}
+			if (cleaned)
+				ev[j++] = cleaned;
 			continue;
 		}
 
 		/* remove glibc preload */
-		if (ENVPREFIX(envp[i], "LD_PRELOAD=") &&
-		    strstr(envp[i], "libbionilux_preload")) {
+		if (ENVPREFIX(envp[i], "LD_PRELOAD="))
 			debug_print("stripping glibc LD_PRELOAD for "
 				    "bionic child");
-			continue;
-		}
 
 		/*
-		 * Strip LD_AUDIT and LD_DEBUG — glibc-specific,
-		 * meaningless and potentially harmful under bionic.
+		 * LD_AUDIT and LD_DEBUG are dropped as well — glibc-
+		 * specific, meaningless and potentially harmful under
+		 * bionic.
 		 */
-		if (ENVPREFIX(envp[i], "LD_AUDIT=") ||
-		    ENVPREFIX(envp[i], "LD_DEBUG="))
-			continue;
-
-		ev[j] = strdup(envp[i]);
-		if (!ev[j]) {
-			free_strarray(ev);
-			return NULL;
-		}
-		j++;
 	}
 
 	ev[j] = NULL;
-	return ev;
+	p->envp = ev;
+	return 0;
 }
 
-/* ── hooked exec functions ───────────────────────────────────────── */
+static void plan_release(struct exec_plan *p)
+{
+	scratch_put(&p->av);
+	scratch_put(&p->ev);
+}
 
 /*
- * Central execve hook — all other exec wrappers funnel through here.
- *
- * Logic:
+ * Decide how @pathname must be executed and fill @p accordingly:
  *   1. If BIONILUX env vars are not set → pass through.
  *   2. Resolve the binary path.
  *   3. If it is a glibc ELF → rewrite argv to go through the loader.
  *   4. Otherwise → clean the environment and exec normally.
+ *
+ * On any failure the plan falls back to the caller's arguments.
  */
-int execve(const char *pathname, char *const argv[], char *const envp[])
+static void plan_exec(struct exec_plan *p, const char *pathname,
+		      char *const argv[], char *const envp[])
 {
-	const char *glibc_lib    = getenv(GLIBC_LIB_ENV);
-	const char *glibc_loader = getenv(GLIBC_LOADER_ENV);
-	char resolved[PATH_MAX];
+	static char *const empty[] = { NULL };
 	int glibc_bin;
 
-	if (!glibc_lib || !glibc_loader) {
+	/* Linux accepts NULL argv/envp and treats them as empty */
+	if (!argv)
+		argv = empty;
+	if (!envp)
+		envp = empty;
+
+	p->path = pathname;
+	p->action = BL_ACT_PASSTHROUGH;
+	p->glibc = -1;
+	p->argv = argv;
+	p->envp = envp;
+	p->av.mapped = 0;
+	p->ev.mapped = 0;
+
+	if (!cfg(g_glibc_lib) || !cfg(g_glibc_loader)) {
 		debug_print("BIONILUX env vars not set, pass-through");
-		return safe_execve(pathname, argv, envp);
+		return;
 	}
 
-	resolve_path(pathname, resolved);
-	debug_print("execve: %s -> %s", pathname, resolved);
+	resolve_path(pathname, p->resolved, 0);
+	debug_print("execve: %s -> %s", pathname, p->resolved);
 
-	glibc_bin = is_glibc_elf(resolved, glibc_lib);
+	elf_cache_attach(cfg(g_cache_dir));
+	glibc_bin = is_glibc_elf(p->resolved, g_glibc_lib);
+	p->glibc = (int8_t)glibc_bin;
 	if (glibc_bin != 1) {
 		debug_print("not glibc (result=%d), cleaning env", glibc_bin);
+		if (build_clean_envp(p, envp) != 0)
+			p->envp = envp;
+		p->action = p->envp != envp ? BL_ACT_CLEAN_ENV : BL_ACT_DIRECT;
+		return;
+	}
 
-		char **clean = build_clean_envp(envp);
-
-		if (clean) {
-			int ret = safe_execve(pathname, argv, clean);
-			int e = errno;
+	debug_print("glibc binary detected, redirecting through loader");
 
-			free_strarray(clean);
-			errno = e;
-			return ret;
-		}
-		return safe_execve(pathname, argv, envp);
+	if (build_loader_argv(p, argv, envp) != 0 ||
+	    build_new_envp(p, envp) != 0) {
+		plan_release(p);
+		p->argv = argv;
+		p->envp = envp;
+		return;
 	}
 
-	debug_print("glibc binary detected, redirecting through loader");
+	p->path = g_glibc_loader;
+	p->action = BL_ACT_LOADER;
+	debug_print("exec: %s %s %s %s %s",
+		    p->argv[0], p->argv[1], p->argv[2], p->argv[3],
+		    p->argv[4] ? p->argv[4] : "");
+}
 
-	char **new_argv = build_loader_argv(glibc_loader, glibc_lib,
-					    resolved, argv);
-	if (!new_argv)
-		return safe_execve(pathname, argv, envp);
+/*
+ * Record the decision made by @p as a trace slice that started at @t,
+ * and hand the trace over to @pid, the process that runs the result.
+ */
+static void plan_trace(const char *hook, const struct exec_plan *p,
+		       const char *requested, uint64_t t, pid_t pid)
+{
+	struct bl_trace_args a = { 0, "" };
 
-	char **new_envp = build_new_envp(envp, resolved);
+	if (!bl_tracing())
+		return;
 
-	if (!new_envp) {
-		free_strarray(new_argv);
-		return safe_execve(pathname, argv, envp);
-	}
+	bl_trace_arg_str(&a, "path", requested);
+	bl_trace_arg_str(&a, "exec", p->path);
+	bl_trace_arg_str(&a, "action", bl_event_action_name(p->action));
+	bl_trace_slice(hook, t, &a);
+	if (pid > 0)
+		bl_trace_flow_start(t, pid);
+}
 
-	debug_print("exec: %s %s %s %s %s %s",
-		    new_argv[0], new_argv[1], new_argv[2],
-		    new_argv[3], new_argv[4], new_argv[5]);
+/*
+ * Append the decision made by @p, which started at @t and was done at
+ * @done, to the --record-execs ring.  @child runs the result; @err is
+ * the errno of a failed exec or spawn.
+ */
+static void plan_event(unsigned hook, const struct exec_plan *p,
+		       const char *requested, uint64_t t, uint64_t done,
+		       pid_t child, int err)
+{
+	struct bl_event ev;
 
-	int ret = safe_execve(glibc_loader, new_argv, new_envp);
-	int e = errno;
+	if (!bl_events)
+		return;
 
-	free_strarray(new_argv);
-	free_strarray(new_envp);
+	ev.ts_ns = t;
+	ev.decide_ns = (uint32_t)(done - t);
+	ev.pid = (int32_t)getpid();
+	ev.ppid = (int32_t)getppid();
+	ev.child = (int32_t)child;
+	ev.hook = (uint8_t)hook;
+	ev.action = p->action;
+	ev.glibc = p->glibc;
+	ev.pad = 0;
+	ev.err = err;
+	bl_event_str(ev.path, sizeof(ev.path), requested);
+	bl_event_str(ev.exec, sizeof(ev.exec), p->path);
+	bl_event_put(&ev);
+}
+
+/* ── hooked exec functions ───────────────────────────────────────── */
+
+/*
+ * Central execve hook — all other exec wrappers funnel through here.
+ * Allocation-free: see plan_exec().
+ */
+int execve(const char *pathname, char *const argv[], char *const envp[])
+{
+	struct exec_plan plan;
+	uint64_t t = bl_tracing() || bl_events ? bl_now_ns() : 0, done = 0;
+	int ret, e;
+
+	plan_exec(&plan, pathname, argv, envp);
+	if (bl_events)
+		done = bl_now_ns();
+	plan_trace("execve", &plan, pathname, t, getpid());
+	plan_event(BL_EV_EXECVE, &plan, pathname, t, done, getpid(), 0);
+	ret = safe_execve(plan.path, plan.argv, plan.envp);
+	e = errno;
+	plan_event(BL_EV_EXECVE, &plan, pathname, t, done, getpid(), e);
+	plan_release(&plan);
+
+	if (bl_tracing()) {
+		struct bl_trace_args a = { 0, "" };
+
+		bl_trace_arg_str(&a, "exec", plan.path);
+		bl_trace_arg_int(&a, "errno", e);
+		bl_trace_instant("execve failed", &a);
+	}
 	errno = e;
 	return ret;
 }
@@ -424,45 +699,59 @@ int execv(const char *pathname, char *const argv[])
 
 int execvp(const char *file, char *const argv[])
 {
-	char resolved[PATH_MAX];
-
-	resolve_path(file, resolved);
-	return execve(resolved, argv, environ);
+	return execvpe(file, argv, environ);
 }
 
 int execvpe(const char *file, char *const argv[], char *const envp[])
 {
 	char resolved[PATH_MAX];
+	int ret;
 
-	resolve_path(file, resolved);
+	ret = resolve_path(file, resolved, 1);
+	if (ret == 0)
+		return execve(resolved, argv, envp);
+
+	/* an indexed path — if it is gone, search PATH for real */
+	if (ret == 1) {
+		ret = execve(resolved, argv, envp);
+		if (!stale_hit(errno))
+			return ret;
+		ret = resolve_path(file, resolved, 0);
+	}
+	if (ret < 0) {
+		errno = ENOENT;
+		return -1;
+	}
 	return execve(resolved, argv, envp);
 }
 
 /*
- * Variadic exec wrappers — convert va_list to argv[], then call
- * through our hooked execve / execvp.
+ * Variadic exec wrappers — convert va_list to an argv[] on the stack
+ * (as glibc does), then call through our hooked execve / execvp.
  *
  * These are necessary because glibc's internal implementation of
  * execl() may bypass our execve() hook by calling __execve directly.
  */
+static size_t count_va_args(va_list ap)
+{
+	size_t argc = 1;
+
+	while (va_arg(ap, const char *))
+		argc++;
+	return argc;
+}
+
 int execl(const char *pathname, const char *arg, ...)
 {
 	va_list ap;
-	size_t argc = 1;
-	char **argv;
-	int ret;
+	size_t argc;
 
 	/* count arguments (including the first, excluding trailing NULL) */
 	va_start(ap, arg);
-	while (va_arg(ap, const char *))
-		argc++;
+	argc = count_va_args(ap);
 	va_end(ap);
 
-	argv = calloc(argc + 1, sizeof(char *));
-	if (!argv) {
-		errno = ENOMEM;
-		return -1;
-	}
+	char *argv[argc + 1];
 
 	argv[0] = (char *)arg;
 	va_start(ap, arg);
@@ -471,28 +760,19 @@ int execl(const char *pathname, const char *arg, ...)
 	va_end(ap);
 	argv[argc] = NULL;
 
-	ret = execv(pathname, argv);
-	free(argv);
-	return ret;
+	return execv(pathname, argv);
 }
 
 int execlp(const char *file, const char *arg, ...)
 {
 	va_list ap;
-	size_t argc = 1;
-	char **argv;
-	int ret;
+	size_t argc;
 
 	va_start(ap, arg);
-	while (va_arg(ap, const char *))
-		argc++;
+	argc = count_va_args(ap);
 	va_end(ap);
 
-	argv = calloc(argc + 1, sizeof(char *));
-	if (!argv) {
-		errno = ENOMEM;
-		return -1;
-	}
+	char *argv[argc + 1];
 
 	argv[0] = (char *)arg;
 	va_start(ap, arg);
@@ -501,44 +781,103 @@ int execlp(const char *file, const char *arg, ...)
 	va_end(ap);
 	argv[argc] = NULL;
 
-	ret = execvp(file, argv);
-	free(argv);
-	return ret;
+	return execvp(file, argv);
 }
 
 int execle(const char *pathname, const char *arg, ... /*, char *const envp[] */)
 {
 	va_list ap;
-	size_t argc = 1;
-	char **argv;
+	size_t argc;
 	char *const *envp;
-	int ret;
 
 	/* count args (the envp pointer follows the trailing NULL) */
 	va_start(ap, arg);
-	while (va_arg(ap, const char *))
-		argc++;
+	argc = count_va_args(ap);
 	va_end(ap);
 
-	argv = calloc(argc + 1, sizeof(char *));
-	if (!argv) {
-		errno = ENOMEM;
-		return -1;
-	}
+	char *argv[argc + 1];
 
 	argv[0] = (char *)arg;
 	va_start(ap, arg);
 	for (size_t i = 1; i < argc; i++)
 		argv[i] = va_arg(ap, char *);
+	(void)va_arg(ap, char *);	/* trailing NULL */
 	envp = va_arg(ap, char *const *);
 	va_end(ap);
 	argv[argc] = NULL;
 
-	ret = execve(pathname, argv, envp);
-	free(argv);
+	return execve(pathname, argv, envp);
+}
+
+/* ── hooked posix_spawn / posix_spawnp ───────────────────────────── */
+
+/*
+ * glibc's posix_spawn() execs through an internal __execve that the
+ * hooks above never see, so spawned children need their own hook.
+ * The plan is computed in the parent and handed to the real
+ * posix_spawn(), which keeps its clone(CLONE_VM | CLONE_VFORK) fast
+ * path — large-heap parents never pay for a page-table copy.
+ */
+int posix_spawn(pid_t *pid, const char *path,
+		const posix_spawn_file_actions_t *file_actions,
+		const posix_spawnattr_t *attrp,
+		char *const argv[], char *const envp[])
+{
+	struct exec_plan plan;
+	uint64_t t = bl_tracing() || bl_events ? bl_now_ns() : 0, done = 0;
+	pid_t child = 0;
+	int ret;
+
+	if (!real_posix_spawn)
+		return ENOSYS;
+
+	plan_exec(&plan, path, argv, envp);
+	if (bl_events)
+		done = bl_now_ns();
+	ret = real_posix_spawn(&child, plan.path, file_actions, attrp,
+			       plan.argv, plan.envp);
+	plan_trace("posix_spawn", &plan, path, t, ret == 0 ? child : 0);
+	plan_event(BL_EV_SPAWN, &plan, path, t, done, ret == 0 ? child : 0,
+		   ret);
+	plan_release(&plan);
+	if (ret == 0 && pid)
+		*pid = child;
 	return ret;
 }
 
+int posix_spawnp(pid_t *pid, const char *file,
+		 const posix_spawn_file_actions_t *file_actions,
+		 const posix_spawnattr_t *attrp,
+		 char *const argv[], char *const envp[])
+{
+	char resolved[PATH_MAX];
+	int ret;
+
+	/* unconfigured → keep glibc's own PATH search semantics */
+	if (!cfg(g_glibc_lib) || !cfg(g_glibc_loader)) {
+		if (!real_posix_spawnp)
+			return ENOSYS;
+		return real_posix_spawnp(pid, file, file_actions, attrp,
+					 argv, envp);
+	}
+
+	ret = resolve_path(file, resolved, 1);
+	if (ret == 0)
+		return posix_spawn(pid, resolved, file_actions, attrp,
+				   argv, envp);
+
+	if (ret == 1) {
+		ret = posix_spawn(pid, resolved, file_actions, attrp,
+				  argv, envp);
+		if (!stale_hit(ret))
+			return ret;
+		ret = resolve_path(file, resolved, 0);
+	}
+	if (ret < 0)
+		return ENOENT;
+	return posix_spawn(pid, resolved, file_actions, attrp, argv, envp);
+}
+
 /* ── hooked readlink / readlinkat ────────────────────────────────── */
 
 /*
@@ -593,7 +932,7 @@ ssize_t readlink(const char *pathname, char *buf, size_t bufsiz)
 	ret = real_readlink(pathname, buf, bufsiz);
 
 	if (ret > 0 && strcmp(pathname, "/proc/self/exe") == 0) {
-		const char *orig = getenv(BIONILUX_ORIG_EXE_ENV);
+		const char *orig = cfg(g_orig_exe);
 
 		if (orig) {
 			size_t len = strlen(orig);
@@ -623,7 +962,7 @@ ssize_t readlinkat(int dirfd, const char *pathname,
 	ret = real_readlinkat(dirfd, pathname, buf, bufsiz);
 
 	if (ret > 0 && is_proc_self_exe(dirfd, pathname)) {
-		const char *orig = getenv(BIONILUX_ORIG_EXE_ENV);
+		const char *orig = cfg(g_orig_exe);
 
 		if (orig) {
 			size_t len = strlen(orig);
@@ -640,11 +979,288 @@ ssize_t readlinkat(int dirfd, const char *pathname,
 	return ret;
 }
 
+/* ── hooked open / openat / fopen (--record-io) ──────────────────── */
+
+/*
+ * While bionilux records a program's startup I/O it passes an O_APPEND
+ * descriptor and a deadline in $BIONILUX_IOTRACE ("fd:ns").  Every file
+ * opened for reading before the deadline is logged as one line holding
+ * its absolute path, taken from /proc/self/fd so relative and *at()
+ * paths need no resolving, and the pages of it already cached.  Each
+ * line is a single write(), which O_APPEND keeps whole across the
+ * processes of the tree.  Outside a recording the hooks only pass the
+ * call on.
+ *
+ * The hooks can run before init(): constructors of the program's other
+ * libraries run first, so the real functions are looked up on first use
+ * and a failed lookup falls back to the syscall rather than failing.
+ * _FORTIFY_SOURCE builds call __open_2() and __openat_2() instead of
+ * open() and openat(), so those are hooked as well.
+ */
+#define OPEN_NEEDS_MODE(flags) \
+	(((flags) & O_CREAT) || ((flags) & O_TMPFILE) == O_TMPFILE)
+
+static void *real_sym(void *slot, const char *name)
+{
+	void *fn = __atomic_load_n((void **)slot, __ATOMIC_ACQUIRE);
+
+	if (!fn) {
+		fn = dlsym(RTLD_NEXT, name);
+		__atomic_store_n((void **)slot, fn, __ATOMIC_RELEASE);
+	}
+	return fn;
+}
+
+/* Append @v in decimal to @buf at @len; no snprintf() in here. */
+static size_t iotrace_num(char *buf, size_t len, uint64_t v)
+{
+	char digits[20];
+	int n = 0;
+
+	do {
+		digits[n++] = (char)('0' + v % 10);
+		v /= 10;
+	} while (v);
+	while (n)
+		buf[len++] = digits[--n];
+	return len;
+}
+
+/* Append " @start+@count" to @buf at @len, or return 0 past @cap. */
+static size_t iotrace_range(char *buf, size_t len, size_t cap,
+			    size_t start, size_t count)
+{
+	if (len + 42 > cap)
+		return 0;
+	buf[len++] = ' ';
+	len = iotrace_num(buf, len, start);
+	buf[len++] = '+';
+	return iotrace_num(buf, len, count);
+}
+
+/*
+ * Append " page+count ..." to @buf at @len for the pages of @fd (@size
+ * bytes) that are in the page cache before the program reads any of
+ * them; iot_save() leaves them out of the trace.  Returns the new
+ * length, or 0 if residency cannot be read or the ranges pass @cap.
+ */
+static size_t iotrace_cached(int fd, size_t size, char *buf, size_t len,
+			     size_t cap)
+{
+	size_t page = g_iotrace_page, npages = (size + page - 1) / page;
+	size_t start = 0, run = 0;
+	unsigned char vec[256];
+	unsigned char *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+
+	if (map == MAP_FAILED)
+		return 0;
+	for (size_t i = 0; i < npages; i++) {
+		size_t k = i % sizeof(vec);
+
+		if (!k && mincore(map + i * page,
+				  npages - i > sizeof(vec) ?
+				  sizeof(vec) * page : size - i * page,
+				  vec) != 0) {
+			len = 0;
+			break;
+		}
+		if (vec[k] & 1) {
+			if (!run++)
+				start = i;
+			continue;
+		}
+		if (run && !(len = iotrace_range(buf, len, cap, start, run)))
+			break;
+		run = 0;
+	}
+	if (len && run)
+		len = iotrace_range(buf, len, cap, start, run);
+	munmap(map, size);
+	return len;
+}
+
+/*
+ * Log the file open on @fd as "path<TAB>cached ranges" (see
+ * iotrace_cached(), "?" if unknown) to the --record-io log.
+ */
+static void iotrace_note(int fd, int flags)
+{
+	char link[32] = "/proc/self/fd/", path[PATH_MAX + 2048];
+	size_t len = 14, end;
+	struct stat st;
+	ssize_t r;
+
+	if (g_iotrace_fd < 0 || fd < 0 || (flags & O_ACCMODE) == O_WRONLY ||
+	    (flags & (O_PATH | O_DIRECTORY)))
+		return;
+	if (bl_now_ns() > g_iotrace_end) {
+		g_iotrace_fd = -1;
+		return;
+	}
+	/* directories, pipes and devices have no pages to read ahead */
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+		return;
+
+	/* no snprintf(): this can run in a signal handler */
+	len = iotrace_num(link, len, (uint64_t)fd);
+	link[len] = '\0';
+
+	r = syscall(SYS_readlinkat, AT_FDCWD, link, path, PATH_MAX);
+	if (r <= 0 || path[0] != '/')
+		return;
+	path[r++] = '\t';
+	end = st.st_size > 0 ? iotrace_cached(fd, (size_t)st.st_size, path,
+					      (size_t)r, sizeof(path) - 1) : 0;
+	if (!end) {
+		path[r++] = '?';
+		end = (size_t)r;
+	}
+	path[end++] = '\n';
+	if (write(g_iotrace_fd, path, end) < 0) { /* best-effort */ }
+}
+
+static int do_openat(int dirfd, const char *pathname, int flags,
+		     mode_t mode)
+{
+	int fd;
+
+	if (dirfd == AT_FDCWD && real_sym(&real_open, "open"))
+		fd = real_open(pathname, flags, mode);
+	else if (real_sym(&real_openat, "openat"))
+		fd = real_openat(dirfd, pathname, flags, mode);
+	else
+		fd = (int)syscall(SYS_openat, dirfd, pathname, flags, mode);
+	iotrace_note(fd, flags);
+	return fd;
+}
+
+int open(const char *pathname, int flags, ...)
+{
+	mode_t mode = 0;
+
+	if (OPEN_NEEDS_MODE(flags)) {
+		va_list ap;
+
+		va_start(ap, flags);
+		mode = va_arg(ap, mode_t);
+		va_end(ap);
+	}
+	return do_openat(AT_FDCWD, pathname, flags, mode);
+}
+
+int openat(int dirfd, const char *pathname, int flags, ...)
+{
+	mode_t mode = 0;
+
+	if (OPEN_NEEDS_MODE(flags)) {
+		va_list ap;
+
+		va_start(ap, flags);
+		mode = va_arg(ap, mode_t);
+		va_end(ap);
+	}
+	return do_openat(dirfd, pathname, flags, mode);
+}
+
+/* fortified variants: never given a mode, glibc aborts on O_CREAT */
+int __open_2(const char *pathname, int flags)
+{
+	int fd;
+
+	if (!real_sym(&real_open_2, "__open_2"))
+		return do_openat(AT_FDCWD, pathname, flags, 0);
+	fd = real_open_2(pathname, flags);
+	iotrace_note(fd, flags);
+	return fd;
+}
+
+int __openat_2(int dirfd, const char *pathname, int flags)
+{
+	int fd;
+
+	if (!real_sym(&real_openat_2, "__openat_2"))
+		return do_openat(dirfd, pathname, flags, 0);
+	fd = real_openat_2(dirfd, pathname, flags);
+	iotrace_note(fd, flags);
+	return fd;
+}
+
+/* fopen() without the real one: "r", "w", "a", "+", "x" and "e" */
+static FILE *fallback_fopen(const char *pathname, const char *mode)
+{
+	int flags, fd;
+	FILE *f;
+
+	switch (mode[0]) {
+	case 'r': flags = O_RDONLY; break;
+	case 'w': flags = O_WRONLY | O_CREAT | O_TRUNC; break;
+	case 'a': flags = O_WRONLY | O_CREAT | O_APPEND; break;
+	default:
+		errno = EINVAL;
+		return NULL;
+	}
+	if (strchr(mode, '+'))
+		flags = (flags & ~O_ACCMODE) | O_RDWR;
+	if (strchr(mode, 'x'))
+		flags |= O_EXCL;
+	if (strchr(mode, 'e'))
+		flags |= O_CLOEXEC;
+
+	fd = (int)syscall(SYS_openat, AT_FDCWD, pathname, flags, 0666);
+	if (fd < 0)
+		return NULL;
+	f = fdopen(fd, mode);
+	if (!f)
+		close(fd);
+	return f;
+}
+
+FILE *fopen(const char *pathname, const char *mode)
+{
+	FILE *f;
+
+	if (real_sym(&real_fopen, "fopen"))
+		f = real_fopen(pathname, mode);
+	else
+		f = fallback_fopen(pathname, mode);
+	if (f && mode[0] == 'r')
+		iotrace_note(fileno(f), O_RDONLY);
+	return f;
+}
+
+/* 64-bit file offsets are the only kind on aarch64 */
+int open64(const char *, int, ...) __attribute__((alias("open")));
+int openat64(int, const char *, int, ...) __attribute__((alias("openat")));
+int __open64_2(const char *, int) __attribute__((alias("__open_2")));
+int __openat64_2(int, const char *, int) __attribute__((alias("__openat_2")));
+FILE *fopen64(const char *, const char *) __attribute__((alias("fopen")));
+
 /* ── constructor ─────────────────────────────────────────────────── */
 
+/* Copy $@name into @dst; values that do not fit are treated as unset. */
+static void cache_env(char *dst, size_t size, const char *name)
+{
+	const char *v = getenv(name);
+	size_t len = v ? strlen(v) : size;
+
+	if (len >= size) {
+		dst[0] = '\0';
+		return;
+	}
+	memcpy(dst, v, len + 1);
+}
+
 __attribute__((constructor))
 static void init(void)
 {
+	const char *trace = getenv(BL_TRACE_ENV);
+	uint64_t t = 0;
+
+	if (trace && *trace && bl_trace_open(trace) >= 0) {
+		bl_trace_process_start(program_invocation_short_name);
+		t = bl_now_ns();
+	}
+
 	/*
 	 * Use *(void **)& to assign dlsym results to function pointers
 	 * without triggering -Wpedantic warnings about void* → fptr
@@ -669,7 +1285,67 @@ static void init(void)
 			"failed: %s\n",
 			dlerror() ? dlerror() : "unknown");
 
+	*(void **)&real_posix_spawn = dlsym(RTLD_NEXT, "posix_spawn");
+	if (!real_posix_spawn)
+		fprintf(stderr, "[bionilux] WARNING: dlsym(posix_spawn) "
+			"failed: %s\n",
+			dlerror() ? dlerror() : "unknown");
+
+	*(void **)&real_posix_spawnp = dlsym(RTLD_NEXT, "posix_spawnp");
+	if (!real_posix_spawnp)
+		fprintf(stderr, "[bionilux] WARNING: dlsym(posix_spawnp) "
+			"failed: %s\n",
+			dlerror() ? dlerror() : "unknown");
+
 	debug_enabled = (getenv(BIONILUX_DEBUG_ENV) != NULL);
+	bl_events_attach(getenv(BL_EVENTS_ENV));
+
+	cache_env(g_glibc_lib,    sizeof(g_glibc_lib),    GLIBC_LIB_ENV);
+	cache_env(g_glibc_loader, sizeof(g_glibc_loader), GLIBC_LOADER_ENV);
+	cache_env(g_orig_exe,     sizeof(g_orig_exe),     BIONILUX_ORIG_EXE_ENV);
+	cache_env(g_cache_dir,    sizeof(g_cache_dir),    BL_CACHE_DIR_ENV);
+
+	{
+		const char *io = getenv(BIONILUX_IOTRACE_ENV);
+		char *end;
+
+		if (io && *io) {
+			long fd = strtol(io, &end, 10);
+			int fl = *end == ':' && fd >= 0 && fd <= INT32_MAX ?
+				 fcntl((int)fd, F_GETFL) : -1;
+
+			if (fl >= 0 && (fl & O_APPEND)) {
+				g_iotrace_end = strtoull(end + 1, NULL, 10);
+				g_iotrace_page = (size_t)sysconf(_SC_PAGESIZE);
+				g_iotrace_fd = (int)fd;
+			}
+		}
+	}
+
+	{
+		const char *tun = getenv(BIONILUX_TUNABLES_ENV);
+
+		if (tun && *tun && strlen(tun) < sizeof(g_tunables) -
+					      sizeof("GLIBC_TUNABLES="))
+			snprintf(g_tunables, sizeof(g_tunables),
+				 "GLIBC_TUNABLES=%s", tun);
+	}
+
+	{
+		Dl_info self;
+
+		if (dladdr(g_self_fd, &self) && self.dli_fname &&
+		    ENVPREFIX(self.dli_fname, "/proc/self/fd/") &&
+		    strlen(self.dli_fname) < sizeof(g_self_fd))
+			strcpy(g_self_fd, self.dli_fname);
+	}
 
 	debug_print("bionilux_preload loaded (pid=%d)", (int)getpid());
+
+	if (bl_tracing()) {
+		struct bl_trace_args a = { 0, "" };
+
+		bl_trace_arg_str(&a, "orig_exe", g_orig_exe);
+		bl_trace_slice("preload init", t, &a);
+	}
 }
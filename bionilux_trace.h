@@ -0,0 +1,250 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * bionilux_trace.h — Chrome trace-event output (BIONILUX_TRACE=<file>)
+ *
+ * Used by both bionilux.c (bionic) and bionilux_preload.c (glibc).
+ *
+ * Every process appends whole JSON objects to one shared file opened
+ * O_APPEND, a single write(2) per event, so events from concurrent
+ * processes never interleave.  The file uses the JSON Array Format
+ * without the closing bracket, which chrome://tracing and
+ * ui.perfetto.dev both accept:
+ *
+ *   [
+ *   {"name":"find_in_path","cat":"bionilux","ph":"X","ts":...},
+ *   ...
+ *
+ * Timestamps are CLOCK_MONOTONIC, so all processes share a timeline.
+ * An exec or spawn emits a flow start ("s") keyed by the PID that will
+ * run the new image, and that image's first event is the matching
+ * flow end ("f"); the viewer draws the hand-off as an arrow.
+ *
+ * Emitting never allocates — events are formatted on the stack — so
+ * it is safe on every preload hook path.
+ */
+#ifndef BIONILUX_TRACE_H
+#define BIONILUX_TRACE_H
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "bionilux_cache.h"
+
+#define BL_TRACE_ENV	"BIONILUX_TRACE"
+
+/* append-only trace file of this process image, -1 when disabled */
+static int bl_trace_fd = -1;
+
+static inline int bl_tracing(void)
+{
+	return bl_trace_fd >= 0;
+}
+
+/*
+ * Open the trace file at @path for appending, creating it with the
+ * opening "[" if needed.  A new file is seeded under a private name
+ * and link()ed into place, so no process can append before the
+ * bracket; losing that race just means someone else created it.
+ */
+static inline int bl_trace_open(const char *path)
+{
+	char tmp[PATH_MAX];
+	int fd;
+
+	if (!path || !*path)
+		return -1;
+
+	bl_trace_fd = open(path, O_WRONLY | O_APPEND | O_CLOEXEC);
+	if (bl_trace_fd >= 0)
+		return bl_trace_fd;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid()) >=
+	    (int)sizeof(tmp))
+		return -1;
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (fd >= 0) {
+		if (write(fd, "[\n", 2) == 2 && link(tmp, path) != 0) {
+			/* lost the race — the winner's file is fine */
+		}
+		close(fd);
+		unlink(tmp);
+	}
+
+	bl_trace_fd = open(path, O_WRONLY | O_APPEND | O_CLOEXEC);
+	return bl_trace_fd;
+}
+
+/* ── event arguments ─────────────────────────────────────────────── */
+
+struct bl_trace_args {
+	size_t len;
+	char   buf[1536];
+};
+
+/* Append @s to @buf as the body of a JSON string, truncating if full. */
+static inline void bl_json_put(char *buf, size_t cap, size_t *off,
+			       const char *s)
+{
+	static const char hex[] = "0123456789abcdef";
+	size_t o = *off;
+
+	for (; s && *s; s++) {
+		unsigned char c = (unsigned char)*s;
+
+		if (o + 7 > cap)
+			break;
+		if (c == '"' || c == '\\') {
+			buf[o++] = '\\';
+			buf[o++] = (char)c;
+		} else if (c < 0x20) {
+			memcpy(buf + o, "\\u00", 4);
+			buf[o + 4] = hex[c >> 4];
+			buf[o + 5] = hex[c & 15];
+			o += 6;
+		} else {
+			buf[o++] = (char)c;
+		}
+	}
+	*off = o;
+}
+
+static inline void bl_trace_arg_str(struct bl_trace_args *a,
+				    const char *key, const char *val)
+{
+	size_t cap = sizeof(a->buf);
+
+	if (a->len + strlen(key) + 8 > cap)
+		return;
+	a->len += (size_t)snprintf(a->buf + a->len, cap - a->len,
+				   "%s\"%s\":\"", a->len ? "," : "", key);
+	bl_json_put(a->buf, cap - 1, &a->len, val);
+	a->buf[a->len++] = '"';
+	a->buf[a->len] = '\0';
+}
+
+static inline void bl_trace_arg_int(struct bl_trace_args *a,
+				    const char *key, long long val)
+{
+	size_t cap = sizeof(a->buf);
+	int n;
+
+	n = snprintf(a->buf + a->len, cap - a->len, "%s\"%s\":%lld",
+		     a->len ? "," : "", key, val);
+	if (n > 0 && (size_t)n < cap - a->len)
+		a->len += (size_t)n;
+	else
+		a->buf[a->len] = '\0';
+}
+
+/* ── events ──────────────────────────────────────────────────────── */
+
+/*
+ * Format one event and append it.  @dur_ns is used for "X" events,
+ * @id for flow events ("s"/"f"); @args may be NULL.
+ */
+static inline void bl_trace_write(const char *ph, const char *name,
+				  const char *cat, uint64_t ts_ns,
+				  uint64_t dur_ns, long long id,
+				  const struct bl_trace_args *args)
+{
+	char ev[2048];
+	size_t off = 0;
+	int n;
+
+	if (bl_trace_fd < 0)
+		return;
+
+	memcpy(ev, "{\"name\":\"", 9);
+	off = 9;
+	bl_json_put(ev, 256, &off, name);
+
+	n = snprintf(ev + off, sizeof(ev) - off,
+		     "\",\"cat\":\"%s\",\"ph\":\"%s\",\"ts\":%llu.%03llu,"
+		     "\"pid\":%d,\"tid\":%d",
+		     cat, ph,
+		     (unsigned long long)(ts_ns / 1000),
+		     (unsigned long long)(ts_ns % 1000),
+		     (int)getpid(), (int)syscall(SYS_gettid));
+	if (n < 0 || (size_t)n >= sizeof(ev) - off)
+		return;
+	off += (size_t)n;
+
+	if (ph[0] == 'X')
+		n = snprintf(ev + off, sizeof(ev) - off,
+			     ",\"dur\":%llu.%03llu",
+			     (unsigned long long)(dur_ns / 1000),
+			     (unsigned long long)(dur_ns % 1000));
+	else if (ph[0] == 's' || ph[0] == 'f')
+		n = snprintf(ev + off, sizeof(ev) - off, ",\"id\":%lld", id);
+	else if (ph[0] == 'i')
+		n = snprintf(ev + off, sizeof(ev) - off, ",\"s\":\"t\"");
+	else
+		n = 0;
+	if (n < 0 || (size_t)n >= sizeof(ev) - off)
+		return;
+	off += (size_t)n;
+
+	n = snprintf(ev + off, sizeof(ev) - off, ",\"args\":{%s}},\n",
+		     args ? args->buf : "");
+	if (n < 0 || (size_t)n >= sizeof(ev) - off)
+		return;
+	off += (size_t)n;
+
+	if (write(bl_trace_fd, ev, off) < 0) { /* best-effort */ }
+}
+
+/* A completed span [@begin_ns, now) on the current thread. */
+static inline void bl_trace_slice(const char *name, uint64_t begin_ns,
+				  struct bl_trace_args *args)
+{
+	struct bl_trace_args none = { 0, "" };
+
+	if (bl_trace_fd < 0)
+		return;
+	if (!args)
+		args = &none;
+	bl_trace_arg_int(args, "ppid", (long long)getppid());
+	bl_trace_write("X", name, "bionilux", begin_ns,
+		       bl_now_ns() - begin_ns, 0, args);
+}
+
+static inline void bl_trace_instant(const char *name,
+				    const struct bl_trace_args *args)
+{
+	bl_trace_write("i", name, "bionilux", bl_now_ns(), 0, 0, args);
+}
+
+/*
+ * Hand-off to the process image that @pid runs next.  Emit at a time
+ * covered by the slice that performs the exec or spawn.
+ */
+static inline void bl_trace_flow_start(uint64_t ts_ns, pid_t pid)
+{
+	bl_trace_write("s", "exec", "exec", ts_ns, 0, (long long)pid, NULL);
+}
+
+/*
+ * Start of a new process image: name the process and terminate the
+ * flow started by whoever exec'd or spawned it.  The flow binds to
+ * the next slice this process emits.
+ */
+static inline void bl_trace_process_start(const char *name)
+{
+	struct bl_trace_args a = { 0, "" };
+
+	if (bl_trace_fd < 0)
+		return;
+
+	bl_trace_arg_str(&a, "name", name);
+	bl_trace_write("M", "process_name", "__metadata", 0, 0, 0, &a);
+	bl_trace_write("f", "exec", "exec", bl_now_ns(), 0,
+		       (long long)getpid(), NULL);
+}
+
+#endif /* BIONILUX_TRACE_H */